@@ -2,6 +2,7 @@ package com.nagarro.techmappoc.ble
 
 import android.bluetooth.BluetoothDevice
 import com.nagarro.techmappoc.model.ConnectionState
+import com.nagarro.techmappoc.model.KioskStats
 import com.nagarro.techmappoc.model.PassportData
 import com.nagarro.techmappoc.model.PassportStatus
 import kotlinx.coroutines.flow.StateFlow
@@ -29,6 +30,16 @@ interface BleManager {
      */
     val passportData: StateFlow<PassportData?>
 
+    /**
+     * Face image (JPEG or JPEG 2000) from DG2, null until streamed
+     */
+    val passportPhoto: StateFlow<ByteArray?>
+
+    /**
+     * Throughput and latency counters while in kiosk mode, null otherwise
+     */
+    val kioskStats: StateFlow<KioskStats?>
+
     /**
      * Connect to a BLE device
      * Note: Different name to avoid conflict with Nordic's connect() method
@@ -47,6 +58,12 @@ interface BleManager {
      */
     fun startPassportScan()
 
+    /**
+     * Scan continuously: every document is read and pushed as soon as it is
+     * placed, the next one as soon as it is removed, until stopPassportScan()
+     */
+    fun startKioskScan()
+
     /**
      * Stop the passport scanning process
      */
@@ -61,4 +78,13 @@ interface BleManager {
      * Reset the reader to initial state
      */
     fun resetReader()
+
+    /**
+     * Send the MRZ fields used for Basic Access Control, so the reader can
+     * derive its keys before the passport is placed on it
+     * @param documentNumber Document number (up to 9 characters)
+     * @param dateOfBirth Date of birth as YYMMDD
+     * @param dateOfExpiry Date of expiry as YYMMDD
+     */
+    fun setMrzKey(documentNumber: String, dateOfBirth: String, dateOfExpiry: String)
 }
@@ -0,0 +1,146 @@
+package com.nagarro.techmappoc.ble
+
+import android.util.Log
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.zip.CRC32
+
+/**
+ * Rebuilds framed payloads from data characteristic notifications
+ * (firmware: passport_frame_hdr_t in ble_passport_service.h).
+ *
+ * Fragments are taken in order only. The returned acks tell the reader how
+ * much arrived in order; a resend ack makes it go back to that offset, which
+ * covers a lost frame as well as a transfer cut off by a disconnect.
+ */
+class FrameReassembler {
+
+    companion object {
+        private const val TAG = "FrameReassembler"
+
+        // xfer_id, type, seq (u16), offset (u16), total length (u16), CRC-32, little endian
+        const val HEADER_LENGTH = 12
+
+        // Payload types (passport_xfer_type_t)
+        const val TYPE_PASSPORT_DATA = 0x01
+
+        // Ack well inside the reader's window (2 KiB by default) so it never waits on us
+        private const val ACK_INTERVAL_BYTES = 512
+    }
+
+    /** Ack to write back with CMD_XFER_ACK */
+    data class Ack(val xferId: Int, val offset: Int, val resend: Boolean)
+
+    /** A complete payload that passed the CRC check */
+    class Payload(val type: Int, val data: ByteArray)
+
+    class Result(val ack: Ack? = null, val payload: Payload? = null)
+
+    private var xferId = -1
+    private var type = 0
+    private var crc = 0L
+    private var buffer: ByteArray? = null
+    private var received = 0
+    private var lastAcked = 0
+    private var expectedSeq = 0
+    private var resendPending = false
+    private var complete = false
+
+    fun onFrame(bytes: ByteArray): Result {
+        if (bytes.size < HEADER_LENGTH) {
+            Log.e(TAG, "Frame too short: ${bytes.size} bytes")
+            return Result()
+        }
+
+        val header = ByteBuffer.wrap(bytes, 0, HEADER_LENGTH).order(ByteOrder.LITTLE_ENDIAN)
+        val id = header.get().toInt() and 0xFF
+        val frameType = header.get().toInt() and 0xFF
+        val seq = header.short.toInt() and 0xFFFF
+        val offset = header.short.toInt() and 0xFFFF
+        val total = header.short.toInt() and 0xFFFF
+        val frameCrc = header.int.toLong() and 0xFFFFFFFFL
+        val length = bytes.size - HEADER_LENGTH
+
+        // A new id replaces whatever was still being assembled. The CRC is part of
+        // the identity: after a reader reboot the id can repeat with another payload
+        if (id != xferId || buffer?.size != total || frameCrc != crc) {
+            xferId = id
+            type = frameType
+            crc = frameCrc
+            buffer = ByteArray(total)
+            received = 0
+            lastAcked = 0
+            expectedSeq = seq
+            resendPending = false
+            complete = false
+        }
+
+        // Resent after our final ack got lost: confirm again
+        if (complete) {
+            return Result(ack = Ack(xferId, total, false))
+        }
+
+        if (seq != expectedSeq) {
+            Log.d(TAG, "Transfer $id: frame $seq, expected $expectedSeq")
+        }
+        expectedSeq = (seq + 1) and 0xFFFF
+
+        if (offset != received) {
+            // Behind us: a duplicate from a resend. Ahead: a frame went missing, ask once
+            if (offset > received && !resendPending) {
+                resendPending = true
+                return Result(ack = Ack(xferId, received, true))
+            }
+            return Result()
+        }
+
+        val data = buffer ?: return Result()
+        if (offset + length > total) {
+            Log.e(TAG, "Transfer $id: fragment past the end ($offset + $length > $total)")
+            return Result()
+        }
+
+        System.arraycopy(bytes, HEADER_LENGTH, data, offset, length)
+        received += length
+        resendPending = false
+
+        if (received == total) {
+            val check = CRC32().apply { update(data) }.value
+            if (check != crc) {
+                Log.e(TAG, "Transfer $id: CRC mismatch, requesting it again")
+                received = 0
+                lastAcked = 0
+                resendPending = true
+                return Result(ack = Ack(xferId, 0, true))
+            }
+
+            complete = true
+            return Result(ack = Ack(xferId, total, false), payload = Payload(type, data))
+        }
+
+        if (received - lastAcked >= ACK_INTERVAL_BYTES) {
+            lastAcked = received
+            return Result(ack = Ack(xferId, received, false))
+        }
+
+        return Result()
+    }
+
+    /** Forget the current payload, for a connection to a different reader */
+    fun reset() {
+        xferId = -1
+        buffer = null
+        received = 0
+        lastAcked = 0
+        resendPending = false
+        complete = false
+    }
+
+    /** After a reconnect: where an unfinished payload should continue, if there is one */
+    fun resumeAck(): Ack? {
+        val data = buffer ?: return null
+        if (complete || received >= data.size) return null
+        resendPending = true
+        return Ack(xferId, received, true)
+    }
+}
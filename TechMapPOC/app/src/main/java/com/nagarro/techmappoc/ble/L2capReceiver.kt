@@ -0,0 +1,95 @@
+package com.nagarro.techmappoc.ble
+
+import android.annotation.SuppressLint
+import android.bluetooth.BluetoothDevice
+import android.bluetooth.BluetoothSocket
+import android.util.Log
+import java.io.DataInputStream
+import java.io.IOException
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Reads document files from the reader's LE L2CAP channel
+ * (firmware: ble_l2cap.c, SDU layout passport_l2cap_hdr_t in ble_passport_service.h).
+ *
+ * The channel runs next to the GATT connection; the reader sends DG2 over it
+ * instead of photo notifications while it is open. Credits are handed out by
+ * the Android stack as this thread drains the socket, so a slow consumer slows
+ * the reader down rather than losing data.
+ */
+class L2capReceiver(
+    private val device: BluetoothDevice,
+    private val psm: Int,
+    private val onChunk: (Chunk) -> Unit
+) {
+
+    companion object {
+        private const val TAG = "L2capReceiver"
+
+        // file, offset (u16), length (u16), total length (u16), little endian
+        const val HEADER_LENGTH = 7
+
+        // Files (passport_file_t): EF short file identifiers
+        const val FILE_DG2 = 0x02
+        const val FILE_DG11 = 0x0B
+        const val FILE_DG12 = 0x0C
+        const val FILE_SOD = 0x1D
+        const val FILE_BENCH = 0xFF
+    }
+
+    /** One SDU worth of file bytes, delivered on the reader thread */
+    class Chunk(val file: Int, val offset: Int, val total: Int, val data: ByteArray)
+
+    @Volatile
+    private var socket: BluetoothSocket? = null
+
+    @SuppressLint("MissingPermission")
+    fun open() {
+        Thread({
+            try {
+                val channel = device.createInsecureL2capChannel(psm)
+                socket = channel
+                channel.connect()
+                Log.d(TAG, "L2CAP channel open on PSM 0x${psm.toString(16)}")
+                read(DataInputStream(channel.inputStream))
+            } catch (e: IOException) {
+                // Also how close() ends the blocking read
+                Log.d(TAG, "L2CAP channel closed: ${e.message}")
+            } finally {
+                close()
+            }
+        }, "l2cap-rx").apply { start() }
+    }
+
+    fun close() {
+        try {
+            socket?.close()
+        } catch (e: IOException) {
+            Log.w(TAG, "Closing L2CAP socket: ${e.message}")
+        }
+        socket = null
+    }
+
+    // Parsed as a stream: reads need not line up with SDU boundaries
+    private fun read(input: DataInputStream) {
+        val header = ByteArray(HEADER_LENGTH)
+
+        while (true) {
+            input.readFully(header)
+            val buffer = ByteBuffer.wrap(header).order(ByteOrder.LITTLE_ENDIAN)
+            val file = buffer.get().toInt() and 0xFF
+            val offset = buffer.short.toInt() and 0xFFFF
+            val length = buffer.short.toInt() and 0xFFFF
+            val total = buffer.short.toInt() and 0xFFFF
+
+            val data = ByteArray(length)
+            input.readFully(data)
+
+            // Throughput test fill (ble_bench shell command), timed on the reader
+            if (file == FILE_BENCH) continue
+
+            onChunk(Chunk(file, offset, total, data))
+        }
+    }
+}
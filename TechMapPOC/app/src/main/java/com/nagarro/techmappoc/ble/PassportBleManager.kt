@@ -5,14 +5,22 @@ import android.bluetooth.BluetoothDevice
 import android.bluetooth.BluetoothGatt
 import android.bluetooth.BluetoothGattCharacteristic
 import android.content.Context
+import android.os.Handler
+import android.os.Looper
+import android.os.SystemClock
 import android.util.Log
 import com.nagarro.techmappoc.model.ConnectionState
+import com.nagarro.techmappoc.model.KioskStats
 import com.nagarro.techmappoc.model.PassportData
 import com.nagarro.techmappoc.model.PassportStatus
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import no.nordicsemi.android.ble.PhyRequest
 import no.nordicsemi.android.ble.callback.DataReceivedCallback
+import no.nordicsemi.android.ble.data.Data
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 import java.util.UUID
 
 /**
@@ -40,7 +48,7 @@ class PassportBleManager(context: Context) :
             UUID.fromString("6e400002-b5a3-f393-e0a9-e50e24dcca9e")
 
         // Data Characteristic UUID: 6E400003-B5A3-F393-E0A9-E50E24DCCA9E
-        // Properties: NOTIFY (firmware sends passport data to Android)
+        // Properties: NOTIFY (framed payloads, see FrameReassembler)
         private val DATA_CHARACTERISTIC_UUID =
             UUID.fromString("6e400003-b5a3-f393-e0a9-e50e24dcca9e")
 
@@ -49,6 +57,38 @@ class PassportBleManager(context: Context) :
         private val COMMAND_CHARACTERISTIC_UUID =
             UUID.fromString("6e400004-b5a3-f393-e0a9-e50e24dcca9e")
 
+        // Photo Characteristic UUID: 6E400005-B5A3-F393-E0A9-E50E24DCCA9E
+        // Properties: NOTIFY (firmware streams EF.DG2 in chunks; optional)
+        private val PHOTO_CHARACTERISTIC_UUID =
+            UUID.fromString("6e400005-b5a3-f393-e0a9-e50e24dcca9e")
+
+        // Kiosk Stats Characteristic UUID: 6E400006-B5A3-F393-E0A9-E50E24DCCA9E
+        // Properties: READ, NOTIFY (counters pushed after each document; optional)
+        private val KIOSK_STATS_CHARACTERISTIC_UUID =
+            UUID.fromString("6e400006-b5a3-f393-e0a9-e50e24dcca9e")
+
+        // L2CAP PSM Characteristic UUID: 6E400008-B5A3-F393-E0A9-E50E24DCCA9E
+        // Properties: READ (uint16 PSM of the bulk transfer channel, 0 if none; optional)
+        private val L2CAP_PSM_CHARACTERISTIC_UUID =
+            UUID.fromString("6e400008-b5a3-f393-e0a9-e50e24dcca9e")
+
+        // Link Characteristic UUID: 6E400009-B5A3-F393-E0A9-E50E24DCCA9E
+        // Properties: READ, NOTIFY (negotiated PHY/DLE/MTU/interval, last DG2 throughput; optional)
+        private val LINK_CHARACTERISTIC_UUID =
+            UUID.fromString("6e400009-b5a3-f393-e0a9-e50e24dcca9e")
+
+        // Generic Attribute service: the Database Hash changes with the reader's GATT layout
+        private val GENERIC_ATTRIBUTE_SERVICE_UUID =
+            UUID.fromString("00001801-0000-1000-8000-00805f9b34fb")
+        private val DATABASE_HASH_CHARACTERISTIC_UUID =
+            UUID.fromString("00002b2a-0000-1000-8000-00805f9b34fb")
+
+        // Database Hash last seen per reader address, with our CCCs written under it
+        private const val GATT_CACHE_PREFS = "gatt_cache"
+
+        // Largest ATT MTU Android accepts; the reader settles on its own maximum (247)
+        private const val MTU_MAX = 517
+
         // ============================================================
         // Command bytes (matches firmware passport_command_t)
         // ============================================================
@@ -56,12 +96,59 @@ class PassportBleManager(context: Context) :
         private const val CMD_STOP_SCAN: Byte = 0x02
         private const val CMD_GET_DATA: Byte = 0x03
         private const val CMD_RESET: Byte = 0x04
+        private const val CMD_SET_MRZ_KEY: Byte = 0x05
+        private const val CMD_START_KIOSK: Byte = 0x06
+        private const val CMD_XFER_ACK: Byte = 0x07
+        private const val XFER_ACK_RESEND = 0x01
+
+        // MRZ key payload: document number (9, '<' padded), DOB and expiry (YYMMDD)
+        private const val MRZ_DOCUMENT_NUMBER_LENGTH = 9
+        private const val MRZ_DATE_LENGTH = 6
+
+        // passport_data_t: NUL padded ASCII fields, then the UID
+        private const val DOCUMENT_NUMBER_LENGTH = 10
+        private const val NAME_LENGTH = 40
+        private const val NATIONALITY_LENGTH = 4
+        private const val DATE_LENGTH = 9
+        private const val SEX_LENGTH = 2
+        private const val UID_MAX_LENGTH = 10
+        private const val PASSPORT_DATA_LENGTH = DOCUMENT_NUMBER_LENGTH + 2 * NAME_LENGTH +
+                NATIONALITY_LENGTH + 2 * DATE_LENGTH + SEX_LENGTH + UID_MAX_LENGTH + 2
+
+        // Photo chunk header: offset and total length of EF.DG2, little endian
+        private const val PHOTO_HEADER_LENGTH = 4
+
+        // Kiosk stats: documents, errors (uint32), docs/min, last, avg, max ms (uint16)
+        private const val KIOSK_STATS_LENGTH = 16
+
+        // Link info: profile, tx/rx PHY (uint8), tx/rx length, MTU, interval, latency,
+        // timeout (uint16), bulk bytes, ms, kbit/s (uint32)
+        private const val LINK_INFO_LENGTH = 27
+
+        // Image signatures inside the DG2 biometric template
+        private val JPEG_SIGNATURE = byteArrayOf(0xFF.toByte(), 0xD8.toByte(), 0xFF.toByte())
+        private val JPEG2000_SIGNATURE = byteArrayOf(
+            0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20
+        )
     }
 
     // GATT Characteristics
     private var commandCharacteristic: BluetoothGattCharacteristic? = null
     private var statusCharacteristic: BluetoothGattCharacteristic? = null
     private var dataCharacteristic: BluetoothGattCharacteristic? = null
+    private var photoCharacteristic: BluetoothGattCharacteristic? = null
+    private var kioskStatsCharacteristic: BluetoothGattCharacteristic? = null
+    private var l2capPsmCharacteristic: BluetoothGattCharacteristic? = null
+    private var linkCharacteristic: BluetoothGattCharacteristic? = null
+    private var databaseHashCharacteristic: BluetoothGattCharacteristic? = null
+    private var bluetoothGatt: BluetoothGatt? = null
+
+    private val gattCache = context.getSharedPreferences(GATT_CACHE_PREFS, Context.MODE_PRIVATE)
+
+    // Reconnect timing: connect request to ready and to the first status notification
+    private var connectStarted = 0L
+    private var firstNotificationSeen = false
+    private var cccRestored = false
 
     // State flows for reactive UI updates
     private val _connectionState = MutableStateFlow(ConnectionState.DISCONNECTED)
@@ -73,8 +160,32 @@ class PassportBleManager(context: Context) :
     private val _passportData = MutableStateFlow<PassportData?>(null)
     override val passportData: StateFlow<PassportData?> = _passportData.asStateFlow()
 
+    private val _passportPhoto = MutableStateFlow<ByteArray?>(null)
+    override val passportPhoto: StateFlow<ByteArray?> = _passportPhoto.asStateFlow()
+
+    private val _kioskStats = MutableStateFlow<KioskStats?>(null)
+    override val kioskStats: StateFlow<KioskStats?> = _kioskStats.asStateFlow()
+
+    // Payloads being reassembled from data notifications; kept across reconnects to resume
+    private val frameReassembler = FrameReassembler()
+    private var frameReassemblerDevice: String? = null // Reader the unfinished payload came from
+
+    // EF.DG2 being reassembled from photo notifications or the L2CAP channel
+    private var photoBuffer: ByteArray? = null
+    private var photoReceived = 0
+    private var photoStarted = 0L
+
+    // Bulk transfer channel; its chunks are handed to the main thread like notifications
+    private var l2capReceiver: L2capReceiver? = null
+    private val mainHandler = Handler(Looper.getMainLooper())
+
     // Callbacks for BLE notifications
     private val statusCallback = DataReceivedCallback { _, data ->
+        if (!firstNotificationSeen) {
+            firstNotificationSeen = true
+            Log.d(TAG, "First notification ${SystemClock.elapsedRealtime() - connectStarted} ms after connect" +
+                    if (cccRestored) " (CCCs restored)" else " (CCCs written)")
+        }
         data.value?.let { bytes ->
             if (bytes.isNotEmpty()) {
                 handleStatusUpdate(bytes[0])
@@ -83,8 +194,26 @@ class PassportBleManager(context: Context) :
     }
 
     private val dataCallback = DataReceivedCallback { _, data ->
-        data?.value?.let { bytes ->
-            handlePassportData(bytes)
+        data.value?.let { bytes ->
+            handleDataFrame(bytes)
+        }
+    }
+
+    private val photoCallback = DataReceivedCallback { _, data ->
+        data.value?.let { bytes ->
+            handlePhotoChunk(bytes)
+        }
+    }
+
+    private val kioskStatsCallback = DataReceivedCallback { _, data ->
+        data.value?.let { bytes ->
+            handleKioskStats(bytes)
+        }
+    }
+
+    private val linkCallback = DataReceivedCallback { _, data ->
+        data.value?.let { bytes ->
+            handleLinkInfo(bytes)
         }
     }
 
@@ -110,18 +239,24 @@ class PassportBleManager(context: Context) :
     override fun onDeviceReady() {
         super.onDeviceReady()
         _connectionState.value = ConnectionState.CONNECTED
-        Log.d(TAG, "Device is ready for communication")
+        Log.d(TAG, "Device is ready ${SystemClock.elapsedRealtime() - connectStarted} ms after connect")
     }
 
     /**
-     * Called when device is disconnected
+     * Called when device is disconnected. Android keeps its copy of the reader's
+     * services: the Database Hash tells in initialize() whether it is still valid.
      */
     override fun shouldClearCacheWhenDisconnected(): Boolean {
         super.shouldClearCacheWhenDisconnected()
         _connectionState.value = ConnectionState.DISCONNECTED
         _passportStatus.value = PassportStatus.IDLE
         _passportData.value = null
-        return true
+        _passportPhoto.value = null
+        _kioskStats.value = null
+        photoBuffer = null
+        l2capReceiver?.close()
+        l2capReceiver = null
+        return false
     }
 
     // ========================================
@@ -136,6 +271,15 @@ class PassportBleManager(context: Context) :
     override fun connectToDevice(device: BluetoothDevice) {
         _connectionState.value = ConnectionState.CONNECTING
         Log.d(TAG, "Connecting to device: ${device.name} (${device.address})")
+        connectStarted = SystemClock.elapsedRealtime()
+        firstNotificationSeen = false
+        cccRestored = false
+
+        // Only the same reader can continue an unfinished payload
+        if (device.address != frameReassemblerDevice) {
+            frameReassembler.reset()
+            frameReassemblerDevice = device.address
+        }
 
         // Call Nordic's connect() method which returns ConnectRequest
         connect(device)
@@ -160,6 +304,11 @@ class PassportBleManager(context: Context) :
         sendCommand(CMD_START_SCAN)
     }
 
+    override fun startKioskScan() {
+        _kioskStats.value = null
+        sendCommand(CMD_START_KIOSK)
+    }
+
     override fun stopPassportScan() {
         sendCommand(CMD_STOP_SCAN)
     }
@@ -171,9 +320,31 @@ class PassportBleManager(context: Context) :
     override fun resetReader() {
         sendCommand(CMD_RESET)
         _passportData.value = null
+        _passportPhoto.value = null
         _passportStatus.value = PassportStatus.IDLE
     }
 
+    override fun setMrzKey(documentNumber: String, dateOfBirth: String, dateOfExpiry: String) {
+        val docNumber = documentNumber.uppercase().replace(" ", "")
+        require(docNumber.isNotEmpty() && docNumber.length <= MRZ_DOCUMENT_NUMBER_LENGTH) {
+            "Document number must be 1-$MRZ_DOCUMENT_NUMBER_LENGTH characters"
+        }
+        require(dateOfBirth.length == MRZ_DATE_LENGTH && dateOfExpiry.length == MRZ_DATE_LENGTH) {
+            "Dates must be YYMMDD"
+        }
+
+        val payload = byteArrayOf(CMD_SET_MRZ_KEY) +
+                docNumber.padEnd(MRZ_DOCUMENT_NUMBER_LENGTH, '<').toByteArray(Charsets.US_ASCII) +
+                dateOfBirth.toByteArray(Charsets.US_ASCII) +
+                dateOfExpiry.toByteArray(Charsets.US_ASCII)
+
+        commandCharacteristic?.let { characteristic ->
+            writeCharacteristic(characteristic, payload).enqueue()
+        } ?: run {
+            Log.e(TAG, "Command characteristic not initialized")
+        }
+    }
+
     // ========================================
     // HELPER METHODS
     // ========================================
@@ -188,44 +359,205 @@ class PassportBleManager(context: Context) :
     }
 
     private fun handleStatusUpdate(statusByte: Byte) {
-        _passportStatus.value = when (statusByte.toInt()) {
-            0 -> PassportStatus.IDLE
-            1 -> PassportStatus.SCANNING
-            2 -> PassportStatus.NO_CARD
-            3 -> PassportStatus.CARD_DETECTED
-            4 -> PassportStatus.READING
-            5 -> PassportStatus.DATA_READ
-            else -> PassportStatus.ERROR
-        }
+        _passportStatus.value = PassportStatus.fromByte(statusByte.toInt())
         Log.d(TAG, "Status updated: ${_passportStatus.value}")
     }
 
-    private fun handlePassportData(bytes: ByteArray) {
-        try {
-            val data = String(bytes, Charsets.UTF_8)
-            val parts = data.split("|")
-
-            if (parts.size >= 8) {
-                _passportData.value = PassportData(
-                    documentNumber = parts[0],
-                    surname = parts[1],
-                    givenNames = parts[2],
-                    nationality = parts[3],
-                    dateOfBirth = parts[4],
-                    sex = parts[5],
-                    expiryDate = parts[6],
-                    uid = parts[7].toByteArray(),
-                    photoAvailable = parts.getOrNull(8)?.toBoolean() ?: false
-                )
-                Log.d(TAG, "Passport data received and parsed")
-            } else {
-                Log.e(TAG, "Invalid passport data format: expected 8+ parts, got ${parts.size}")
-                _passportStatus.value = PassportStatus.ERROR
+    private fun sendXferAck(ack: FrameReassembler.Ack) {
+        val payload = byteArrayOf(
+            CMD_XFER_ACK,
+            ack.xferId.toByte(),
+            (if (ack.resend) XFER_ACK_RESEND else 0).toByte(),
+            ack.offset.toByte(),
+            (ack.offset shr 8).toByte()
+        )
+
+        commandCharacteristic?.let { characteristic ->
+            writeCharacteristic(characteristic, payload).enqueue()
+        } ?: run {
+            Log.e(TAG, "Command characteristic not initialized")
+        }
+    }
+
+    private fun handleDataFrame(bytes: ByteArray) {
+        val result = frameReassembler.onFrame(bytes)
+
+        result.ack?.let { sendXferAck(it) }
+        result.payload?.let { payload ->
+            when (payload.type) {
+                FrameReassembler.TYPE_PASSPORT_DATA -> handlePassportData(payload.data)
+                else -> Log.w(TAG, "Unknown payload type ${payload.type}")
             }
-        } catch (e: Exception) {
-            Log.e(TAG, "Error parsing passport data", e)
+        }
+    }
+
+    private fun handlePassportData(bytes: ByteArray) {
+        if (bytes.size < PASSPORT_DATA_LENGTH) {
+            Log.e(TAG, "Invalid passport data length: ${bytes.size}")
             _passportStatus.value = PassportStatus.ERROR
+            return
+        }
+
+        val buffer = ByteBuffer.wrap(bytes)
+        fun field(length: Int): String {
+            val raw = ByteArray(length).also { buffer.get(it) }
+            val end = raw.indexOf(0.toByte()).takeIf { it >= 0 } ?: length
+            return String(raw, 0, end, Charsets.US_ASCII).trim()
+        }
+
+        val documentNumber = field(DOCUMENT_NUMBER_LENGTH)
+        val surname = field(NAME_LENGTH)
+        val givenNames = field(NAME_LENGTH)
+        val nationality = field(NATIONALITY_LENGTH)
+        val dateOfBirth = field(DATE_LENGTH)
+        val sex = field(SEX_LENGTH)
+        val expiryDate = field(DATE_LENGTH)
+        val uid = ByteArray(UID_MAX_LENGTH).also { buffer.get(it) }
+        val uidLength = (buffer.get().toInt() and 0xFF).coerceAtMost(UID_MAX_LENGTH)
+        val photoAvailable = buffer.get().toInt() != 0
+
+        _passportData.value = PassportData(
+            documentNumber = documentNumber,
+            surname = surname,
+            givenNames = givenNames,
+            nationality = nationality,
+            dateOfBirth = dateOfBirth,
+            sex = sex,
+            expiryDate = expiryDate,
+            uid = uid.copyOf(uidLength),
+            photoAvailable = photoAvailable
+        )
+        Log.d(TAG, "Passport data received and parsed")
+    }
+
+    private fun handleKioskStats(bytes: ByteArray) {
+        if (bytes.size < KIOSK_STATS_LENGTH) {
+            Log.e(TAG, "Invalid kiosk stats length: ${bytes.size}")
+            return
+        }
+
+        val buffer = ByteBuffer.wrap(bytes).order(ByteOrder.LITTLE_ENDIAN)
+        _kioskStats.value = KioskStats(
+            documents = buffer.int.toLong() and 0xFFFFFFFFL,
+            errors = buffer.int.toLong() and 0xFFFFFFFFL,
+            docsPerMinute = buffer.short.toInt() and 0xFFFF,
+            lastMs = buffer.short.toInt() and 0xFFFF,
+            avgMs = buffer.short.toInt() and 0xFFFF,
+            maxMs = buffer.short.toInt() and 0xFFFF
+        )
+        Log.d(TAG, "Kiosk stats: ${_kioskStats.value}")
+    }
+
+    private fun handleLinkInfo(bytes: ByteArray) {
+        if (bytes.size < LINK_INFO_LENGTH) {
+            Log.e(TAG, "Link info too short: ${bytes.size} bytes")
+            return
+        }
+
+        val buffer = ByteBuffer.wrap(bytes).order(ByteOrder.LITTLE_ENDIAN)
+        val profile = if (buffer.get().toInt() == 1) "bulk" else "idle"
+        val txPhy = buffer.get().toInt() and 0xFF
+        val rxPhy = buffer.get().toInt() and 0xFF
+        val txLength = buffer.short.toInt() and 0xFFFF
+        val rxLength = buffer.short.toInt() and 0xFFFF
+        val mtu = buffer.short.toInt() and 0xFFFF
+        val interval = buffer.short.toInt() and 0xFFFF
+        val latency = buffer.short.toInt() and 0xFFFF
+        val timeout = buffer.short.toInt() and 0xFFFF
+        val bulkBytes = buffer.int.toLong() and 0xFFFFFFFFL
+        val bulkMs = buffer.int.toLong() and 0xFFFFFFFFL
+        val bulkKbps = buffer.int.toLong() and 0xFFFFFFFFL
+
+        Log.d(TAG, "Link ($profile): PHY $txPhy/$rxPhy, data length $txLength/$rxLength, " +
+                "MTU $mtu, interval ${interval * 1.25} ms, latency $latency, " +
+                "timeout ${timeout * 10} ms; last DG2 $bulkBytes bytes in $bulkMs ms " +
+                "($bulkKbps kbit/s)")
+    }
+
+    private fun handlePhotoChunk(bytes: ByteArray) {
+        if (bytes.size <= PHOTO_HEADER_LENGTH) return
+
+        val offset = (bytes[0].toInt() and 0xFF) or ((bytes[1].toInt() and 0xFF) shl 8)
+        val total = (bytes[2].toInt() and 0xFF) or ((bytes[3].toInt() and 0xFF) shl 8)
+
+        // Total length 0: throughput test fill (ble_bench shell command)
+        if (total == 0) return
+
+        handlePhotoData(offset, total, bytes, PHOTO_HEADER_LENGTH, "GATT")
+    }
+
+    private fun handleL2capChunk(chunk: L2capReceiver.Chunk) {
+        when (chunk.file) {
+            L2capReceiver.FILE_DG2 -> handlePhotoData(chunk.offset, chunk.total, chunk.data, 0, "L2CAP")
+            else -> Log.d(TAG, "L2CAP: ignoring file 0x${chunk.file.toString(16)}")
+        }
+    }
+
+    private fun openL2capChannel(psm: Int) {
+        val device = bluetoothDevice ?: return
+        if (psm == 0) {
+            Log.d(TAG, "No L2CAP channel, photo comes as notifications")
+            return
+        }
+
+        l2capReceiver?.close()
+        l2capReceiver = L2capReceiver(device, psm) { chunk ->
+            mainHandler.post { handleL2capChunk(chunk) }
+        }.also { it.open() }
+    }
+
+    private fun handlePhotoData(offset: Int, total: Int, bytes: ByteArray, start: Int, path: String) {
+        val length = bytes.size - start
+
+        // Chunks arrive in order; offset 0 starts a new photo
+        if (offset == 0 || photoBuffer?.size != total) {
+            photoBuffer = ByteArray(total)
+            photoReceived = 0
+            photoStarted = SystemClock.elapsedRealtime()
+            _passportPhoto.value = null
+        }
+
+        val buffer = photoBuffer ?: return
+        if (offset != photoReceived || offset + length > total) {
+            Log.e(TAG, "Photo chunk out of order: offset $offset, expected $photoReceived")
+            photoBuffer = null
+            return
+        }
+
+        System.arraycopy(bytes, start, buffer, offset, length)
+        photoReceived += length
+
+        if (photoReceived == total) {
+            val ms = maxOf(SystemClock.elapsedRealtime() - photoStarted, 1)
+            _passportPhoto.value = extractImage(buffer)
+            photoBuffer = null
+            Log.d(TAG, "Photo received over $path: $total bytes in $ms ms (${total * 8 / ms} kbit/s)")
+        }
+    }
+
+    /**
+     * Cut the JPEG or JPEG 2000 image out of the DG2 biometric template
+     * (the face image block follows a variable size record header).
+     */
+    private fun extractImage(dg2: ByteArray): ByteArray? {
+        for (signature in listOf(JPEG_SIGNATURE, JPEG2000_SIGNATURE)) {
+            val start = dg2.indexOf(signature)
+            if (start >= 0) {
+                return dg2.copyOfRange(start, dg2.size)
+            }
         }
+        Log.e(TAG, "No JPEG/JPEG 2000 image found in DG2")
+        return null
+    }
+
+    private fun ByteArray.indexOf(pattern: ByteArray): Int {
+        outer@ for (i in 0..size - pattern.size) {
+            for (j in pattern.indices) {
+                if (this[i + j] != pattern[j]) continue@outer
+            }
+            return i
+        }
+        return -1
     }
 
     // ========================================
@@ -236,13 +568,20 @@ class PassportBleManager(context: Context) :
 
         override fun isRequiredServiceSupported(gatt: BluetoothGatt): Boolean {
             Log.d(TAG, "Checking for required services...")
+            bluetoothGatt = gatt
 
             val service = gatt.getService(PASSPORT_SERVICE_UUID)
             if (service != null) {
                 commandCharacteristic = service.getCharacteristic(COMMAND_CHARACTERISTIC_UUID)
                 statusCharacteristic = service.getCharacteristic(STATUS_CHARACTERISTIC_UUID)
                 dataCharacteristic = service.getCharacteristic(DATA_CHARACTERISTIC_UUID)
+                photoCharacteristic = service.getCharacteristic(PHOTO_CHARACTERISTIC_UUID)
+                kioskStatsCharacteristic = service.getCharacteristic(KIOSK_STATS_CHARACTERISTIC_UUID)
+                l2capPsmCharacteristic = service.getCharacteristic(L2CAP_PSM_CHARACTERISTIC_UUID)
+                linkCharacteristic = service.getCharacteristic(LINK_CHARACTERISTIC_UUID)
             }
+            databaseHashCharacteristic = gatt.getService(GENERIC_ATTRIBUTE_SERVICE_UUID)
+                ?.getCharacteristic(DATABASE_HASH_CHARACTERISTIC_UUID)
 
             val supported = commandCharacteristic != null &&
                     statusCharacteristic != null &&
@@ -263,26 +602,102 @@ class PassportBleManager(context: Context) :
             super.initialize()
             Log.d(TAG, "Initializing device...")
 
-            // Enable status notifications
-            statusCharacteristic?.let { characteristic ->
-                setNotificationCallback(characteristic).with(statusCallback)
-                enableNotifications(characteristic).enqueue()
+            // Link tuning: the reader asks for DLE and the connection interval itself
+            requestMtu(MTU_MAX)
+                .with { _, mtu -> Log.d(TAG, "MTU $mtu") }
+                .fail { _, status -> Log.w(TAG, "MTU request failed: $status") }
+                .enqueue()
+            setPreferredPhy(PhyRequest.PHY_LE_2M_MASK, PhyRequest.PHY_LE_2M_MASK,
+                PhyRequest.PHY_OPTION_NO_PREFERRED)
+                .with { _, txPhy, rxPhy -> Log.d(TAG, "PHY tx $txPhy rx $rxPhy") }
+                .fail { _, status -> Log.w(TAG, "2M PHY not available: $status") }
+                .enqueue()
+
+            // Bond once, so the reader keeps our CCCs and encrypts the link on reconnect
+            if (!isBonded) {
+                createBondInsecure()
+                    .fail { _, status -> Log.w(TAG, "Bonding failed: $status") }
+                    .enqueue()
             }
 
-            // Enable data notifications
-            dataCharacteristic?.let { characteristic ->
-                setNotificationCallback(characteristic).with(dataCallback)
-                enableNotifications(characteristic).enqueue()
+            // Unchanged database and a bond: the reader restored our CCCs, skip writing them
+            val hashCharacteristic = databaseHashCharacteristic
+            if (hashCharacteristic != null) {
+                readCharacteristic(hashCharacteristic)
+                    .with { device, data ->
+                        val hash = data.value?.joinToString("") { "%02x".format(it) }
+                        val restored = isBonded && hash != null &&
+                                hash == gattCache.getString(device.address, null)
+                        Log.d(TAG, "Database hash $hash, ${if (restored) "cache hit" else "cache miss"}")
+                        subscribe(restored)
+                        if (!restored) {
+                            gattCache.edit().putString(device.address, hash).apply()
+                        }
+                    }
+                    .fail { _, status ->
+                        Log.w(TAG, "Database hash read failed: $status")
+                        subscribe(false)
+                    }
+                    .enqueue()
+            } else {
+                subscribe(false)
             }
 
             Log.d(TAG, "Initialization complete")
         }
 
+        /**
+         * Register the notification callbacks. Android only delivers notifications
+         * for characteristics enabled locally, so that is done on every connection;
+         * the CCC writes are only needed when the reader does not hold them from the bond
+         */
+        @SuppressLint("MissingPermission")
+        private fun subscribe(restored: Boolean) {
+            cccRestored = restored
+            listOf(
+                statusCharacteristic to statusCallback,
+                dataCharacteristic to dataCallback,
+                photoCharacteristic to photoCallback, // older firmware has no photo characteristic
+                kioskStatsCharacteristic to kioskStatsCallback,
+                linkCharacteristic to linkCallback
+            ).forEach { (characteristic, callback) ->
+                characteristic?.let {
+                    setNotificationCallback(it).with(callback)
+                    if (restored) {
+                        bluetoothGatt?.setCharacteristicNotification(it, true)
+                    } else {
+                        enableNotifications(it).enqueue()
+                    }
+                }
+            }
+
+            // DG2 moves to the L2CAP channel if the reader offers one (optional)
+            l2capPsmCharacteristic?.let { characteristic ->
+                readCharacteristic(characteristic).with { _, data ->
+                    data.getIntValue(Data.FORMAT_UINT16_LE, 0)?.let { psm -> openL2capChannel(psm) }
+                }.enqueue()
+            }
+
+            // A payload cut off by the last disconnect continues where it stopped
+            frameReassembler.resumeAck()?.let { ack ->
+                Log.d(TAG, "Resuming transfer ${ack.xferId} at ${ack.offset}")
+                sendXferAck(ack)
+            }
+        }
+
         override fun onServicesInvalidated() {
             Log.d(TAG, "Services invalidated, clearing characteristics")
             commandCharacteristic = null
             statusCharacteristic = null
             dataCharacteristic = null
+            photoCharacteristic = null
+            kioskStatsCharacteristic = null
+            l2capPsmCharacteristic = null
+            linkCharacteristic = null
+            databaseHashCharacteristic = null
+            bluetoothGatt = null
+            l2capReceiver?.close()
+            l2capReceiver = null
         }
     }
 }
\ No newline at end of file
@@ -6,5 +6,7 @@ data class BleDevice(
     val device: BluetoothDevice,
     val name: String?,
     val address: String,
-    val rssi: Int
+    val rssi: Int,
+    // Reader state from the advertising data, null for devices that do not send it
+    val beacon: ReaderBeacon? = null
 )
@@ -0,0 +1,13 @@
+package com.nagarro.techmappoc.model
+
+/**
+ * Counters the reader pushes after every document in kiosk mode
+ */
+data class KioskStats(
+    val documents: Long,
+    val errors: Long,
+    val docsPerMinute: Int,
+    val lastMs: Int,
+    val avgMs: Int,
+    val maxMs: Int
+)
@@ -7,5 +7,17 @@ enum class PassportStatus {
     NO_CARD,
     CARD_DETECTED,
     DATA_READ,
-    ERROR
+    ERROR;
+
+    companion object {
+        /** Status byte from the status characteristic or the advertisement (firmware: passport_status_t) */
+        fun fromByte(value: Int): PassportStatus = when (value and 0xFF) {
+            0x00 -> IDLE
+            0x01 -> SCANNING
+            0x02 -> READING
+            0x03 -> DATA_READ // PASSPORT_STATUS_SUCCESS
+            0x05 -> NO_CARD
+            else -> ERROR
+        }
+    }
 }
@@ -0,0 +1,37 @@
+package com.nagarro.techmappoc.model
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Reader state from the advertising packet, readable without connecting
+ * (firmware: passport_adv_t in ble_passport_service.h)
+ */
+data class ReaderBeacon(
+    val status: PassportStatus,
+    val resultSeq: Int,
+    val documents: Int,
+    val errors: Int
+) {
+
+    companion object {
+        // 0xFFFF: reserved for testing and internal use (PASSPORT_ADV_COMPANY_ID)
+        const val COMPANY_ID = 0xFFFF
+
+        // status, result sequence, documents (u16), errors (u16), little endian
+        private const val LENGTH = 6
+
+        /** Decode the manufacturer data that follows the company ID, null if malformed */
+        fun parse(data: ByteArray?): ReaderBeacon? {
+            if (data == null || data.size < LENGTH) return null
+
+            val buffer = ByteBuffer.wrap(data).order(ByteOrder.LITTLE_ENDIAN)
+            return ReaderBeacon(
+                status = PassportStatus.fromByte(buffer.get().toInt()),
+                resultSeq = buffer.get().toInt() and 0xFF,
+                documents = buffer.short.toInt() and 0xFFFF,
+                errors = buffer.short.toInt() and 0xFFFF
+            )
+        }
+    }
+}
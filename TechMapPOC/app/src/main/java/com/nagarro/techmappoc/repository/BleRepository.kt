@@ -4,13 +4,17 @@ import android.Manifest
 import android.bluetooth.BluetoothAdapter
 import android.bluetooth.BluetoothManager
 import android.bluetooth.le.ScanCallback
+import android.bluetooth.le.ScanFilter
 import android.bluetooth.le.ScanResult
+import android.bluetooth.le.ScanSettings
 import android.content.Context
 import androidx.core.content.ContextCompat
 import android.content.pm.PackageManager
 import android.os.Build
+import android.os.ParcelUuid
 import android.util.Log
 import com.nagarro.techmappoc.model.BleDevice
+import com.nagarro.techmappoc.model.ReaderBeacon
 import kotlinx.coroutines.channels.awaitClose
 import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.callbackFlow
@@ -19,6 +23,10 @@ class BleRepository(private val context: Context) {
 
     companion object {
         private const val TAG = "BleRepository"
+
+        // Advertised by the reader, so the controller can filter before waking the app
+        private val PASSPORT_SERVICE_UUID =
+            ParcelUuid.fromString("6e400001-b5a3-f393-e0a9-e50e24dcca9e")
     }
 
     private val bluetoothManager = context.getSystemService(Context.BLUETOOTH_SERVICE) as BluetoothManager
@@ -26,7 +34,9 @@ class BleRepository(private val context: Context) {
 
     /**
      * Scan for BLE devices with optional name filter
-     * Returns a Flow that emits updated device lists as devices are discovered
+     * Returns a Flow that emits updated device lists as devices are discovered,
+     * and again whenever a reader's advertised state changes, so readers can be
+     * monitored without connecting
      *
      * @param nameFilter Optional filter to only include devices with names containing this string
      * @return Flow of device lists
@@ -74,11 +84,20 @@ class BleRepository(private val context: Context) {
                         }
                     }
 
+                    val beacon = ReaderBeacon.parse(
+                        result.scanRecord?.getManufacturerSpecificData(ReaderBeacon.COMPANY_ID)
+                    )
+                    // Advertisements repeat every few hundred ms; log only when the reader's state changes
+                    if (beacon != null && beacon != devices[result.device.address]?.beacon) {
+                        Log.d(TAG, "Reader ${result.device.address}: ${beacon.status}, result #${beacon.resultSeq}, ${beacon.documents} docs, ${beacon.errors} errors")
+                    }
+
                     val bleDevice = BleDevice(
                         device = result.device,
                         name = deviceName,
                         address = result.device.address,
-                        rssi = result.rssi
+                        rssi = result.rssi,
+                        beacon = beacon
                     )
 
                     devices[result.device.address] = bleDevice
@@ -131,8 +150,15 @@ class BleRepository(private val context: Context) {
                 }
             }
 
+            // Readers only; every advertisement is reported so state changes show up
+            val filters = listOf(ScanFilter.Builder().setServiceUuid(PASSPORT_SERVICE_UUID).build())
+            val settings = ScanSettings.Builder()
+                .setScanMode(ScanSettings.SCAN_MODE_LOW_LATENCY)
+                .setCallbackType(ScanSettings.CALLBACK_TYPE_ALL_MATCHES)
+                .build()
+
             Log.d(TAG, "Starting BLE scan with filter: ${nameFilter ?: "none"}")
-            scanner.startScan(scanCallback)
+            scanner.startScan(filters, settings, scanCallback)
             Log.d(TAG, "BLE scan started successfully")
 
         } catch (e: SecurityException) {
@@ -47,6 +47,13 @@ fun DeviceItem(
                     style = MaterialTheme.typography.bodySmall,
                     color = MaterialTheme.colorScheme.onSurfaceVariant
                 )
+                device.beacon?.let { beacon ->
+                    Text(
+                        text = "${beacon.status} · ${beacon.documents} docs, ${beacon.errors} errors",
+                        style = MaterialTheme.typography.labelSmall,
+                        color = MaterialTheme.colorScheme.onSurfaceVariant
+                    )
+                }
             }
             
             Column(horizontalAlignment = Alignment.End) {
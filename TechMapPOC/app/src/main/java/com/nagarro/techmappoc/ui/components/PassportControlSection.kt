@@ -6,6 +6,7 @@ import androidx.compose.runtime.Composable
 import androidx.compose.ui.Alignment
 import androidx.compose.ui.Modifier
 import androidx.compose.ui.unit.dp
+import com.nagarro.techmappoc.model.KioskStats
 import com.nagarro.techmappoc.model.PassportData
 import com.nagarro.techmappoc.model.PassportStatus
 
@@ -13,7 +14,9 @@ import com.nagarro.techmappoc.model.PassportStatus
 fun PassportControlSection(
     passportStatus: PassportStatus,
     passportData: PassportData?,
+    kioskStats: KioskStats?,
     onStartScan: () -> Unit,
+    onStartKiosk: () -> Unit,
     onStopScan: () -> Unit,
     onGetData: () -> Unit,
     onReset: () -> Unit,
@@ -26,12 +29,24 @@ fun PassportControlSection(
             passportStatus = passportStatus,
             passportData = passportData,
             onStartScan = onStartScan,
+            onStartKiosk = onStartKiosk,
             onStopScan = onStopScan,
             onGetData = onGetData,
             onReset = onReset,
             onDisconnect = onDisconnect
         )
 
+        // Kiosk counters
+        kioskStats?.let { stats ->
+            Text(
+                text = "Kiosk: ${stats.documents} docs, ${stats.errors} errors, " +
+                        "${stats.docsPerMinute}/min, last ${stats.lastMs} ms " +
+                        "(avg ${stats.avgMs}, max ${stats.maxMs})",
+                style = MaterialTheme.typography.bodySmall,
+                modifier = Modifier.padding(top = 8.dp)
+            )
+        }
+
         Spacer(modifier = Modifier.height(16.dp))
 
         // Passport data or status display
@@ -48,6 +63,7 @@ private fun ControlButtons(
     passportStatus: PassportStatus,
     passportData: PassportData?,
     onStartScan: () -> Unit,
+    onStartKiosk: () -> Unit,
     onStopScan: () -> Unit,
     onGetData: () -> Unit,
     onReset: () -> Unit,
@@ -98,6 +114,16 @@ private fun ControlButtons(
             }
         }
 
+        OutlinedButton(
+            onClick = onStartKiosk,
+            modifier = Modifier
+                .fillMaxWidth()
+                .padding(top = 8.dp),
+            enabled = passportStatus != PassportStatus.SCANNING
+        ) {
+            Text("Kiosk Mode")
+        }
+
         Button(
             onClick = onDisconnect,
             modifier = Modifier
@@ -22,6 +22,7 @@ fun PassportReaderScreen(
     val connectionState by viewModel.connectionState.collectAsState()
     val passportStatus by viewModel.passportStatus.collectAsState()
     val passportData by viewModel.passportData.collectAsState()
+    val kioskStats by viewModel.kioskStats.collectAsState()
     val isScanning by viewModel.isScanning.collectAsState()
     val devices by viewModel.discoveredDevices.collectAsState()
     val errorMessage by viewModel.errorMessage.collectAsState()
@@ -76,7 +77,9 @@ fun PassportReaderScreen(
                     PassportControlSection(
                         passportStatus = passportStatus,
                         passportData = passportData,
+                        kioskStats = kioskStats,
                         onStartScan = { viewModel.startPassportScan() },
+                        onStartKiosk = { viewModel.startKioskScan() },
                         onStopScan = { viewModel.stopPassportScan() },
                         onGetData = { viewModel.getPassportData() },
                         onReset = { viewModel.resetReader() },
@@ -8,6 +8,7 @@ import androidx.lifecycle.viewModelScope
 import com.nagarro.techmappoc.ble.BleManager
 import com.nagarro.techmappoc.model.BleDevice
 import com.nagarro.techmappoc.model.ConnectionState
+import com.nagarro.techmappoc.model.KioskStats
 import com.nagarro.techmappoc.model.PassportData
 import com.nagarro.techmappoc.model.PassportStatus
 import com.nagarro.techmappoc.repository.BleRepository
@@ -41,6 +42,8 @@ class PassportReaderViewModel(
     val connectionState: StateFlow<ConnectionState> = bleManager.connectionState
     val passportStatus: StateFlow<PassportStatus> = bleManager.passportStatus
     val passportData: StateFlow<PassportData?> = bleManager.passportData
+    val passportPhoto: StateFlow<ByteArray?> = bleManager.passportPhoto
+    val kioskStats: StateFlow<KioskStats?> = bleManager.kioskStats
 
     // Error State
     private val _errorMessage = MutableStateFlow<String?>(null)
@@ -158,6 +161,17 @@ class PassportReaderViewModel(
         }
     }
 
+    fun startKioskScan() {
+        Log.d(TAG, "Starting kiosk mode")
+        try {
+            bleManager.startKioskScan()
+            _errorMessage.value = null
+        } catch (e: Exception) {
+            Log.e(TAG, "Error starting kiosk mode", e)
+            _errorMessage.value = "Error starting kiosk mode: ${e.message}"
+        }
+    }
+
     fun stopPassportScan() {
         Log.d(TAG, "Stopping passport scan")
         try {
@@ -190,6 +204,17 @@ class PassportReaderViewModel(
         }
     }
 
+    fun setMrzKey(documentNumber: String, dateOfBirth: String, dateOfExpiry: String) {
+        Log.d(TAG, "Sending MRZ key")
+        try {
+            bleManager.setMrzKey(documentNumber, dateOfBirth, dateOfExpiry)
+            _errorMessage.value = null
+        } catch (e: Exception) {
+            Log.e(TAG, "Error sending MRZ key", e)
+            _errorMessage.value = "Error sending MRZ key: ${e.message}"
+        }
+    }
+
     fun clearError() {
         _errorMessage.value = null
     }
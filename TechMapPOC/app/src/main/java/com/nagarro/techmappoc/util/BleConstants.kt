@@ -19,16 +19,16 @@ object BleConstants {
         const val STOP_SCAN: Byte = 0x02
         const val GET_DATA: Byte = 0x03
         const val RESET: Byte = 0x04
+        const val SET_MRZ_KEY: Byte = 0x05
     }
     
-    // Status Bytes
+    // Status Bytes (firmware: passport_status_t, decoded by PassportStatus.fromByte)
     object Status {
         const val IDLE: Byte = 0x00
         const val SCANNING: Byte = 0x01
-        const val NO_CARD: Byte = 0x02
-        const val CARD_DETECTED: Byte = 0x03
-        const val READING: Byte = 0x04
-        const val DATA_READ: Byte = 0x05
-        const val ERROR: Byte = 0xFF.toByte()
+        const val READING: Byte = 0x02
+        const val SUCCESS: Byte = 0x03
+        const val ERROR: Byte = 0x04
+        const val NO_CARD: Byte = 0x05
     }
 }
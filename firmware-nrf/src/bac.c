@@ -0,0 +1,335 @@
+/**
+ * @file bac.c
+ * @brief ICAO 9303 Basic Access Control (3DES, SHA-1 key derivation)
+ *
+ * The document keys only depend on the MRZ, so they are derived as soon
+ * as the app sends the MRZ key, before a document is presented. Only the
+ * challenge/response and session key derivation remain on the RF path.
+ */
+
+#include "bac.h"
+#include "pn532.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/des.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/platform_util.h>
+#include <mbedtls/sha1.h>
+
+LOG_MODULE_REGISTER(bac, LOG_LEVEL_DBG);
+
+#define BAC_RND_LEN 8
+#define BAC_MAC_LEN 8
+#define BAC_CRYPTOGRAM_LEN (2 * BAC_RND_LEN + BAC_KEY_LEN) // RND.A || RND.B || K.A
+#define BAC_MRZ_INFO_LEN 24                                // Doc(9)+cd DOB(6)+cd DOE(6)+cd
+
+#define BAC_KDF_ENC 1
+#define BAC_KDF_MAC 2
+
+/* ==================== Global Variables ==================== */
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static bool drbg_ready;
+
+/* ==================== Primitives ==================== */
+
+int bac_init(void)
+{
+        static const char pers[] = "passport_bac";
+        int ret;
+
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ctr_drbg_init(&drbg);
+
+        ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char *)pers, sizeof(pers) - 1);
+        if (ret != 0)
+        {
+                LOG_ERR("DRBG seed failed: -0x%04X", -ret);
+                return -EIO;
+        }
+
+        drbg_ready = true;
+        return 0;
+}
+
+size_t bac_pad(uint8_t *buf, size_t len, size_t block_size)
+{
+        buf[len++] = 0x80;
+        while (len % block_size)
+        {
+                buf[len++] = 0x00;
+        }
+
+        return len;
+}
+
+/* K = SHA-1(K_seed || c)[0..15] with DES parity bits adjusted */
+static int bac_kdf(const uint8_t seed[BAC_KEY_LEN], uint32_t c, uint8_t key[BAC_KEY_LEN])
+{
+        uint8_t buf[BAC_KEY_LEN + 4];
+        uint8_t hash[20];
+        int ret;
+
+        memcpy(buf, seed, BAC_KEY_LEN);
+        sys_put_be32(c, &buf[BAC_KEY_LEN]);
+
+        ret = mbedtls_sha1(buf, sizeof(buf), hash);
+        if (ret == 0)
+        {
+                memcpy(key, hash, BAC_KEY_LEN);
+                mbedtls_des_key_set_parity(key);
+                mbedtls_des_key_set_parity(key + 8);
+        }
+
+        mbedtls_platform_zeroize(buf, sizeof(buf));
+        mbedtls_platform_zeroize(hash, sizeof(hash));
+        return ret == 0 ? 0 : -EIO;
+}
+
+int bac_retail_mac(const uint8_t key[BAC_KEY_LEN], const uint8_t *data, size_t len,
+                   uint8_t mac[BAC_MAC_LEN])
+{
+        mbedtls_des_context des;
+        uint8_t y[BAC_MAC_LEN] = {0};
+
+        if (len % BAC_MAC_LEN)
+        {
+                return -EINVAL;
+        }
+
+        mbedtls_des_init(&des);
+
+        // Single DES CBC with K1 over every block
+        mbedtls_des_setkey_enc(&des, key);
+        for (size_t i = 0; i < len; i += BAC_MAC_LEN)
+        {
+                for (int j = 0; j < BAC_MAC_LEN; j++)
+                {
+                        y[j] ^= data[i + j];
+                }
+                mbedtls_des_crypt_ecb(&des, y, y);
+        }
+
+        // Output transformation: decrypt with K2, encrypt with K1
+        mbedtls_des_setkey_dec(&des, key + 8);
+        mbedtls_des_crypt_ecb(&des, y, y);
+        mbedtls_des_setkey_enc(&des, key);
+        mbedtls_des_crypt_ecb(&des, y, mac);
+
+        mbedtls_des_free(&des);
+        mbedtls_platform_zeroize(y, sizeof(y));
+        return 0;
+}
+
+static int bac_3des_cbc(const uint8_t key[BAC_KEY_LEN], int mode, const uint8_t *in,
+                        uint8_t *out, size_t len)
+{
+        mbedtls_des3_context des3;
+        uint8_t iv[8] = {0};
+        int ret;
+
+        mbedtls_des3_init(&des3);
+        ret = (mode == MBEDTLS_DES_ENCRYPT) ? mbedtls_des3_set2key_enc(&des3, key) :
+                                              mbedtls_des3_set2key_dec(&des3, key);
+        if (ret == 0)
+        {
+                ret = mbedtls_des3_crypt_cbc(&des3, mode, len, iv, in, out);
+        }
+        mbedtls_des3_free(&des3);
+
+        return ret == 0 ? 0 : -EIO;
+}
+
+/* ==================== Key Derivation ==================== */
+
+int bac_derive_keys(const char *doc_number, size_t doc_len, const char *dob,
+                    const char *expiry, struct bac_keys *keys)
+{
+        char info[BAC_MRZ_INFO_LEN];
+        uint8_t hash[20];
+        int ret;
+
+        if (doc_len == 0 || doc_len > 9)
+        {
+                return -EINVAL;
+        }
+
+        memset(info, '<', 9);
+        memcpy(info, doc_number, doc_len);
+        info[9] = mrtd_check_digit(info, 9);
+        memcpy(&info[10], dob, 6);
+        info[16] = mrtd_check_digit(&info[10], 6);
+        memcpy(&info[17], expiry, 6);
+        info[23] = mrtd_check_digit(&info[17], 6);
+
+        ret = mbedtls_sha1((const uint8_t *)info, sizeof(info), hash);
+        if (ret == 0)
+        {
+                ret = bac_kdf(hash, BAC_KDF_ENC, keys->k_enc);
+        }
+        if (ret == 0)
+        {
+                ret = bac_kdf(hash, BAC_KDF_MAC, keys->k_mac);
+        }
+        if (ret == 0)
+        {
+                memcpy(keys->mrz_hash, hash, sizeof(keys->mrz_hash));
+        }
+
+        mbedtls_platform_zeroize(info, sizeof(info));
+        mbedtls_platform_zeroize(hash, sizeof(hash));
+        return ret == 0 ? 0 : -EIO;
+}
+
+/* ==================== Authentication ==================== */
+
+static int bac_get_challenge(struct mrtd_session *mrtd, uint8_t rnd_ic[BAC_RND_LEN])
+{
+        uint8_t *apdu = pn532_exchange_buffer();
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t sw;
+        int ret;
+
+        apdu[0] = 0x00;
+        apdu[1] = 0x84; // GET CHALLENGE
+        apdu[2] = 0x00;
+        apdu[3] = 0x00;
+        apdu[4] = BAC_RND_LEN;
+
+        ret = mrtd_transceive(mrtd, 5, &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                return ret;
+        }
+        if (sw != MRTD_SW_OK || data_len != BAC_RND_LEN)
+        {
+                LOG_ERR("GET CHALLENGE failed: SW %04X", sw);
+                return sw != MRTD_SW_OK ? mrtd_sw_error(sw) : -EBADMSG;
+        }
+
+        memcpy(rnd_ic, data, BAC_RND_LEN);
+        return 0;
+}
+
+int bac_authenticate(struct mrtd_session *mrtd, const struct bac_keys *keys,
+                     struct bac_session *session)
+{
+        uint8_t rnd_ic[BAC_RND_LEN];
+        uint8_t rnd_ifd[BAC_RND_LEN];
+        uint8_t k_ifd[BAC_KEY_LEN];
+        uint8_t s[BAC_CRYPTOGRAM_LEN];
+        uint8_t mac_buf[BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN];
+        uint8_t mac[BAC_MAC_LEN];
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t sw;
+        int ret;
+
+        if (!drbg_ready)
+        {
+                return -EAGAIN;
+        }
+
+        ret = bac_get_challenge(mrtd, rnd_ic);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        if (mbedtls_ctr_drbg_random(&drbg, rnd_ifd, sizeof(rnd_ifd)) != 0 ||
+            mbedtls_ctr_drbg_random(&drbg, k_ifd, sizeof(k_ifd)) != 0)
+        {
+                return -EIO;
+        }
+
+        // E.IFD = 3DES(K_enc, RND.IFD || RND.IC || K.IFD), M.IFD = MAC(K_mac, E.IFD)
+        memcpy(s, rnd_ifd, BAC_RND_LEN);
+        memcpy(&s[BAC_RND_LEN], rnd_ic, BAC_RND_LEN);
+        memcpy(&s[2 * BAC_RND_LEN], k_ifd, BAC_KEY_LEN);
+
+        uint8_t *apdu = pn532_exchange_buffer();
+
+        apdu[0] = 0x00;
+        apdu[1] = 0x82; // MUTUAL AUTHENTICATE
+        apdu[2] = 0x00;
+        apdu[3] = 0x00;
+        apdu[4] = BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN;
+
+        ret = bac_3des_cbc(keys->k_enc, MBEDTLS_DES_ENCRYPT, s, &apdu[5], BAC_CRYPTOGRAM_LEN);
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        memcpy(mac_buf, &apdu[5], BAC_CRYPTOGRAM_LEN);
+        bac_retail_mac(keys->k_mac, mac_buf, bac_pad(mac_buf, BAC_CRYPTOGRAM_LEN, 8),
+                       &apdu[5 + BAC_CRYPTOGRAM_LEN]);
+        apdu[5 + BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN] = BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN; // Le
+
+        ret = mrtd_transceive(mrtd, 6 + BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN, &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                goto out;
+        }
+        if (sw != MRTD_SW_OK || data_len != BAC_CRYPTOGRAM_LEN + BAC_MAC_LEN)
+        {
+                LOG_ERR("MUTUAL AUTHENTICATE refused: SW %04X (wrong MRZ key?)", sw);
+                ret = -EACCES;
+                goto out;
+        }
+
+        // Verify M.IC before trusting E.IC
+        memcpy(mac_buf, data, BAC_CRYPTOGRAM_LEN);
+        bac_retail_mac(keys->k_mac, mac_buf, bac_pad(mac_buf, BAC_CRYPTOGRAM_LEN, 8), mac);
+        if (memcmp(mac, &data[BAC_CRYPTOGRAM_LEN], BAC_MAC_LEN) != 0)
+        {
+                LOG_ERR("MUTUAL AUTHENTICATE MAC mismatch");
+                ret = -EBADMSG;
+                goto out;
+        }
+
+        // R = RND.IC || RND.IFD || K.IC
+        ret = bac_3des_cbc(keys->k_enc, MBEDTLS_DES_DECRYPT, data, s, BAC_CRYPTOGRAM_LEN);
+        if (ret != 0)
+        {
+                goto out;
+        }
+        if (memcmp(s, rnd_ic, BAC_RND_LEN) != 0 ||
+            memcmp(&s[BAC_RND_LEN], rnd_ifd, BAC_RND_LEN) != 0)
+        {
+                LOG_ERR("MUTUAL AUTHENTICATE nonce mismatch");
+                ret = -EBADMSG;
+                goto out;
+        }
+
+        // K_seed = K.IFD xor K.IC
+        for (int i = 0; i < BAC_KEY_LEN; i++)
+        {
+                k_ifd[i] ^= s[2 * BAC_RND_LEN + i];
+        }
+
+        ret = bac_kdf(k_ifd, BAC_KDF_ENC, session->ks_enc);
+        if (ret == 0)
+        {
+                ret = bac_kdf(k_ifd, BAC_KDF_MAC, session->ks_mac);
+        }
+
+        // SSC = RND.IC[4..7] || RND.IFD[4..7]
+        memcpy(session->ssc, &rnd_ic[4], 4);
+        memcpy(&session->ssc[4], &rnd_ifd[4], 4);
+
+        LOG_INF("BAC established");
+
+out:
+        mbedtls_platform_zeroize(rnd_ifd, sizeof(rnd_ifd));
+        mbedtls_platform_zeroize(k_ifd, sizeof(k_ifd));
+        mbedtls_platform_zeroize(s, sizeof(s));
+        mbedtls_platform_zeroize(mac_buf, sizeof(mac_buf));
+        return ret;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file bac.h
+ * @brief ICAO 9303 Basic Access Control (3DES, SHA-1 key derivation)
+ */
+
+#ifndef BAC_H_
+#define BAC_H_
+
+#include <zephyr/kernel.h>
+
+#include "mrtd.h"
+
+#define BAC_KEY_LEN 16
+#define BAC_SSC_LEN 8
+#define BAC_MRZ_HASH_LEN 20
+
+/* Document basic access keys, derived from the MRZ */
+struct bac_keys
+{
+        uint8_t k_enc[BAC_KEY_LEN];
+        uint8_t k_mac[BAC_KEY_LEN];
+        uint8_t mrz_hash[BAC_MRZ_HASH_LEN]; // SHA-1 of the MRZ info, the PACE password
+};
+
+/* Session keys and send sequence counter for secure messaging */
+struct bac_session
+{
+        uint8_t ks_enc[BAC_KEY_LEN];
+        uint8_t ks_mac[BAC_KEY_LEN];
+        uint8_t ssc[BAC_SSC_LEN];
+};
+
+/* Seed the random generator used for RND.IFD / K.IFD */
+int bac_init(void);
+
+/*
+ * Derive K_enc/K_mac from the MRZ fields used for BAC: document number
+ * (up to 9 characters, '<' padded), date of birth and date of expiry
+ * (YYMMDD). Check digits are computed here.
+ */
+int bac_derive_keys(const char *doc_number, size_t doc_len, const char *dob,
+                    const char *expiry, struct bac_keys *keys);
+
+/* GET CHALLENGE / MUTUAL AUTHENTICATE on the selected applet */
+int bac_authenticate(struct mrtd_session *mrtd, const struct bac_keys *keys,
+                     struct bac_session *session);
+
+/*
+ * ISO 9797-1 MAC algorithm 3 (retail MAC) with single DES; len must be a
+ * multiple of 8 (ISO 9797-1 padding method 2 applied by the caller).
+ */
+int bac_retail_mac(const uint8_t key[BAC_KEY_LEN], const uint8_t *data, size_t len,
+                   uint8_t mac[8]);
+
+/* ISO 9797-1 padding method 2 in place; returns the padded length */
+size_t bac_pad(uint8_t *buf, size_t len, size_t block_size);
+
+#endif /* BAC_H_ */
@@ -0,0 +1,183 @@
+/**
+ * @file ble_l2cap.c
+ * @brief LE L2CAP connection-oriented channel for bulk document transfer
+ */
+
+#include "ble_l2cap.h"
+#include "ble_passport_service.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/byteorder.h>
+
+LOG_MODULE_REGISTER(ble_l2cap, LOG_LEVEL_INF);
+
+#define L2CAP_SDU_MAX CONFIG_BT_L2CAP_TX_MTU
+#define L2CAP_RX_MTU 23 /* LE minimum, the app never sends on this channel */
+#define L2CAP_TX_TIMEOUT_MS 5000 /* Longest wait for a credit before giving up */
+
+BUILD_ASSERT(L2CAP_SDU_MAX > sizeof(passport_l2cap_hdr_t));
+
+static void sdu_destroy(struct net_buf *buf);
+
+/*
+ * The pool is the send window: a buffer only comes back once its SDU has
+ * left, and the stack holds SDUs back while the app has no credits left.
+ */
+NET_BUF_POOL_FIXED_DEFINE(sdu_pool, CONFIG_PASSPORT_L2CAP_TX_BUFS,
+                          BT_L2CAP_SDU_BUF_SIZE(L2CAP_SDU_MAX), CONFIG_BT_CONN_TX_USER_DATA_SIZE,
+                          sdu_destroy);
+
+static struct bt_l2cap_le_chan le_chan;
+static atomic_t chan_open;
+static atomic_t sdu_in_flight;
+static K_SEM_DEFINE(sdu_drained, 0, 1);
+
+static void sdu_destroy(struct net_buf *buf)
+{
+    net_buf_destroy(buf);
+
+    if (atomic_dec(&sdu_in_flight) == 1)
+    {
+        k_sem_give(&sdu_drained);
+    }
+}
+
+/* ==================== Channel Callbacks ==================== */
+
+static void chan_connected(struct bt_l2cap_chan *chan)
+{
+    atomic_set(&chan_open, 1);
+    LOG_INF("L2CAP channel open: tx mtu %u mps %u, %u credits", le_chan.tx.mtu, le_chan.tx.mps,
+            (uint32_t)atomic_get(&le_chan.tx.credits));
+}
+
+static void chan_disconnected(struct bt_l2cap_chan *chan)
+{
+    atomic_set(&chan_open, 0);
+    LOG_INF("L2CAP channel closed");
+}
+
+static int chan_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    LOG_DBG("Ignoring %u bytes from the app", buf->len);
+    return 0;
+}
+
+static const struct bt_l2cap_chan_ops chan_ops = {
+    .connected = chan_connected,
+    .disconnected = chan_disconnected,
+    .recv = chan_recv,
+};
+
+static int l2cap_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+                        struct bt_l2cap_chan **chan)
+{
+    /* One channel: the first central gets it, the others stay on notifications */
+    if (atomic_get(&chan_open))
+    {
+        LOG_WRN("L2CAP channel already open");
+        return -ENOMEM;
+    }
+
+    memset(&le_chan, 0, sizeof(le_chan));
+    le_chan.chan.ops = &chan_ops;
+    le_chan.rx.mtu = L2CAP_RX_MTU;
+    *chan = &le_chan.chan;
+
+    return 0;
+}
+
+/* No security beyond the link's: Android opens it with createInsecureL2capChannel() */
+static struct bt_l2cap_server l2cap_server = {
+    .psm = CONFIG_PASSPORT_L2CAP_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = l2cap_accept,
+};
+
+/* ==================== Public API ==================== */
+
+int ble_l2cap_init(void)
+{
+    int err = bt_l2cap_server_register(&l2cap_server);
+
+    if (err)
+    {
+        LOG_ERR("L2CAP server registration failed: %d", err);
+        return err;
+    }
+
+    LOG_INF("L2CAP server on PSM 0x%04X, SDUs up to %u bytes", l2cap_server.psm, L2CAP_SDU_MAX);
+    return 0;
+}
+
+uint16_t ble_l2cap_psm(void)
+{
+    return l2cap_server.psm;
+}
+
+bool ble_l2cap_connected(void)
+{
+    return atomic_get(&chan_open) != 0;
+}
+
+struct bt_conn *ble_l2cap_conn(void)
+{
+    return ble_l2cap_connected() ? le_chan.chan.conn : NULL;
+}
+
+int ble_l2cap_send(uint8_t file, uint16_t offset, const uint8_t *data, uint16_t len,
+                   uint16_t total_len)
+{
+    for (uint16_t sent = 0, n = 0; sent < len; sent += n)
+    {
+        uint16_t room = MIN(L2CAP_SDU_MAX, le_chan.tx.mtu) - sizeof(passport_l2cap_hdr_t);
+        passport_l2cap_hdr_t hdr;
+        struct net_buf *buf;
+        int err;
+
+        if (!ble_l2cap_connected())
+        {
+            return -ENOTCONN;
+        }
+
+        n = MIN(room, len - sent);
+        hdr.file = file;
+        hdr.offset = sys_cpu_to_le16(offset + sent);
+        hdr.len = sys_cpu_to_le16(n);
+        hdr.total_len = sys_cpu_to_le16(total_len);
+
+        buf = net_buf_alloc(&sdu_pool, K_MSEC(L2CAP_TX_TIMEOUT_MS));
+        if (!buf)
+        {
+            LOG_WRN("No credits for %u ms", L2CAP_TX_TIMEOUT_MS);
+            return -ETIMEDOUT;
+        }
+        atomic_inc(&sdu_in_flight);
+
+        net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+        net_buf_add_mem(buf, &hdr, sizeof(hdr));
+        net_buf_add_mem(buf, &data[sent], n);
+
+        err = bt_l2cap_chan_send(&le_chan.chan, buf);
+        if (err < 0)
+        {
+            net_buf_unref(buf);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int ble_l2cap_flush(k_timeout_t timeout)
+{
+    k_sem_reset(&sdu_drained);
+    if (atomic_get(&sdu_in_flight) == 0)
+    {
+        return 0;
+    }
+
+    return k_sem_take(&sdu_drained, timeout) == 0 ? 0 : -ETIMEDOUT;
+}
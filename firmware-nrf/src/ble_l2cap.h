@@ -0,0 +1,78 @@
+/**
+ * @file ble_l2cap.h
+ * @brief LE L2CAP connection-oriented channel for bulk document transfer
+ *
+ * GATT stays in charge of control and status; the channel only carries
+ * file bytes (see passport_l2cap_hdr_t). With CONFIG_PASSPORT_L2CAP
+ * disabled the channel never opens and everything stays on notifications.
+ * There is one channel: with several centrals connected, the first one to
+ * open it gets DG2 over L2CAP and the others stay on notifications.
+ */
+
+#ifndef BLE_L2CAP_H_
+#define BLE_L2CAP_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+
+#if defined(CONFIG_PASSPORT_L2CAP)
+
+/* Register the L2CAP server; call after bt_enable() */
+int ble_l2cap_init(void);
+
+/* PSM the app connects to, published in the L2CAP PSM characteristic */
+uint16_t ble_l2cap_psm(void);
+
+/* True while the app has the channel open */
+bool ble_l2cap_connected(void);
+
+/* Connection of the central holding the channel, NULL while closed */
+struct bt_conn *ble_l2cap_conn(void);
+
+/*
+ * Send part of a file, split into SDUs of at most CONFIG_BT_L2CAP_TX_MTU
+ * bytes. Blocks while all TX buffers are queued, i.e. while the app holds
+ * back credits. Call from one thread only (the BLE TX thread).
+ */
+int ble_l2cap_send(uint8_t file, uint16_t offset, const uint8_t *data, uint16_t len,
+                   uint16_t total_len);
+
+/* Wait until every SDU handed to the stack has been sent */
+int ble_l2cap_flush(k_timeout_t timeout);
+
+#else
+
+static inline int ble_l2cap_init(void)
+{
+    return 0;
+}
+
+static inline uint16_t ble_l2cap_psm(void)
+{
+    return 0;
+}
+
+static inline bool ble_l2cap_connected(void)
+{
+    return false;
+}
+
+static inline struct bt_conn *ble_l2cap_conn(void)
+{
+    return NULL;
+}
+
+static inline int ble_l2cap_send(uint8_t file, uint16_t offset, const uint8_t *data,
+                                 uint16_t len, uint16_t total_len)
+{
+    return -ENOTSUP;
+}
+
+static inline int ble_l2cap_flush(k_timeout_t timeout)
+{
+    return 0;
+}
+
+#endif /* CONFIG_PASSPORT_L2CAP */
+
+#endif /* BLE_L2CAP_H_ */
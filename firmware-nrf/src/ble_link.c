@@ -0,0 +1,175 @@
+/**
+ * @file ble_link.c
+ * @brief Link tuning: 2M PHY, data length extension, MTU and connection interval
+ */
+
+#include "ble_link.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/byteorder.h>
+
+LOG_MODULE_REGISTER(ble_link, LOG_LEVEL_INF);
+
+/* Connection intervals in 1.25 ms units, supervision timeouts in 10 ms units */
+#define LINK_BULK_INTERVAL_MIN 6  /* 7.5 ms, the shortest allowed */
+#define LINK_BULK_INTERVAL_MAX 12 /* 15 ms, what iOS and most Android stacks grant */
+#define LINK_BULK_LATENCY 0
+#define LINK_BULK_TIMEOUT 400
+#define LINK_IDLE_INTERVAL_MIN 80  /* 100 ms */
+#define LINK_IDLE_INTERVAL_MAX 120 /* 150 ms */
+#define LINK_IDLE_LATENCY 4
+#define LINK_IDLE_TIMEOUT 600
+
+/*
+ * Leave the central's fast interval alone until service discovery is done,
+ * and hold BULK a moment after a document in case the next one follows.
+ */
+#define LINK_IDLE_DELAY_MS 5000
+
+static void profile_work_handler(struct k_work *work);
+
+static atomic_t link_profile = ATOMIC_INIT(PASSPORT_LINK_IDLE); /* Last one requested */
+static K_WORK_DELAYABLE_DEFINE(profile_work, profile_work_handler);
+static struct bt_gatt_exchange_params mtu_params[CONFIG_BT_MAX_CONN];
+
+static struct
+{
+    uint32_t bytes;
+    uint32_t ms;
+} last_bulk;
+
+static void profile_apply(struct bt_conn *conn, void *data)
+{
+    bool bulk = atomic_get(&link_profile) == PASSPORT_LINK_BULK;
+    struct bt_le_conn_param *param =
+        bulk ? BT_LE_CONN_PARAM(LINK_BULK_INTERVAL_MIN, LINK_BULK_INTERVAL_MAX,
+                                LINK_BULK_LATENCY, LINK_BULK_TIMEOUT) :
+               BT_LE_CONN_PARAM(LINK_IDLE_INTERVAL_MIN, LINK_IDLE_INTERVAL_MAX,
+                                LINK_IDLE_LATENCY, LINK_IDLE_TIMEOUT);
+    int err;
+
+    err = bt_conn_le_param_update(conn, param);
+    if (err && err != -EALREADY)
+    {
+        LOG_WRN("%s connection parameters rejected: %d", bulk ? "Bulk" : "Idle", err);
+    }
+}
+
+/* Every connected central gets the result, so all of them follow the reader */
+static void profile_work_handler(struct k_work *work)
+{
+    bt_conn_foreach(BT_CONN_TYPE_LE, profile_apply, NULL);
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+                          struct bt_gatt_exchange_params *params)
+{
+    LOG_INF("MTU %u%s", bt_gatt_get_mtu(conn), err ? " (exchange failed)" : "");
+}
+
+/* ==================== Connection Callbacks ==================== */
+
+static void link_connected(struct bt_conn *conn, uint8_t err)
+{
+    int ret;
+
+    if (err)
+    {
+        return;
+    }
+
+    /* The controller runs these one after the other; each ends in a callback below */
+    ret = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (ret)
+    {
+        LOG_WRN("2M PHY request failed: %d", ret);
+    }
+
+    ret = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (ret)
+    {
+        LOG_WRN("Data length request failed: %d", ret);
+    }
+
+    /* The app usually asks first; then this one is turned down and that is fine */
+    mtu_params[bt_conn_index(conn)].func = mtu_exchanged;
+    ret = bt_gatt_exchange_mtu(conn, &mtu_params[bt_conn_index(conn)]);
+    if (ret && ret != -EALREADY)
+    {
+        LOG_DBG("MTU exchange not started: %d", ret);
+    }
+
+    /* A reader already in BULK stays there; the newcomer follows with the others */
+    k_work_reschedule(&profile_work, K_MSEC(LINK_IDLE_DELAY_MS));
+}
+
+static void link_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency,
+                               uint16_t timeout)
+{
+    LOG_INF("Connection interval %u.%02u ms, latency %u, timeout %u ms", interval * 125 / 100,
+            interval * 125 % 100, latency, timeout * 10);
+}
+
+static void link_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    LOG_INF("PHY tx %u rx %u", param->tx_phy, param->rx_phy);
+}
+
+static void link_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    LOG_INF("Data length tx %u rx %u bytes", info->tx_max_len, info->rx_max_len);
+}
+
+BT_CONN_CB_DEFINE(link_callbacks) = {
+    .connected = link_connected,
+    .le_param_updated = link_param_updated,
+    .le_phy_updated = link_phy_updated,
+    .le_data_len_updated = link_data_len_updated,
+};
+
+/* ==================== Public API ==================== */
+
+void ble_link_set_profile(passport_link_profile_t profile)
+{
+    if (atomic_set(&link_profile, profile) == profile)
+    {
+        return;
+    }
+
+    k_work_reschedule(&profile_work,
+                      profile == PASSPORT_LINK_BULK ? K_NO_WAIT : K_MSEC(LINK_IDLE_DELAY_MS));
+}
+
+void ble_link_record_bulk(uint32_t bytes, uint32_t ms)
+{
+    last_bulk.bytes = bytes;
+    last_bulk.ms = ms;
+}
+
+void ble_link_get_info(struct bt_conn *conn, passport_link_info_t *info)
+{
+    struct bt_conn_info conn_info;
+    uint32_t ms = MAX(last_bulk.ms, 1);
+
+    memset(info, 0, sizeof(*info));
+    info->bulk_bytes = sys_cpu_to_le32(last_bulk.bytes);
+    info->bulk_ms = sys_cpu_to_le32(last_bulk.ms);
+    info->bulk_kbps = sys_cpu_to_le32(last_bulk.bytes * 8 / ms);
+
+    if (!conn || bt_conn_get_info(conn, &conn_info))
+    {
+        return;
+    }
+
+    info->profile = atomic_get(&link_profile);
+    info->tx_phy = conn_info.le.phy->tx_phy;
+    info->rx_phy = conn_info.le.phy->rx_phy;
+    info->tx_max_len = sys_cpu_to_le16(conn_info.le.data_len->tx_max_len);
+    info->rx_max_len = sys_cpu_to_le16(conn_info.le.data_len->rx_max_len);
+    info->mtu = sys_cpu_to_le16(bt_gatt_get_mtu(conn));
+    info->interval = sys_cpu_to_le16(conn_info.le.interval);
+    info->latency = sys_cpu_to_le16(conn_info.le.latency);
+    info->timeout = sys_cpu_to_le16(conn_info.le.timeout);
+}
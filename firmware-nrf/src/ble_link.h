@@ -0,0 +1,32 @@
+/**
+ * @file ble_link.h
+ * @brief Link tuning: 2M PHY, data length extension, MTU and connection interval
+ *
+ * On connect the reader asks for the 2M PHY, the longest link layer
+ * payload and the largest ATT MTU. The connection interval follows the
+ * reader: short while a document is read, long while it waits. With
+ * several centrals connected, all of them follow the same profile.
+ */
+
+#ifndef BLE_LINK_H_
+#define BLE_LINK_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "ble_passport_service.h"
+
+/*
+ * Switch the connection interval. BULK applies at once; IDLE only after a
+ * short delay, so back to back documents do not flap between the two.
+ * Applies to every connection. Callable from any thread.
+ */
+void ble_link_set_profile(passport_link_profile_t profile);
+
+/* Throughput of the last bulk transfer, reported in the link value */
+void ble_link_record_bulk(uint32_t bytes, uint32_t ms);
+
+/* Parameters of one connection right now; zeroed link fields for NULL */
+void ble_link_get_info(struct bt_conn *conn, passport_link_info_t *info);
+
+#endif /* BLE_LINK_H_ */
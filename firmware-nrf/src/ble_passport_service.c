@@ -4,19 +4,212 @@
  */
 
 #include "ble_passport_service.h"
+#include "ble_l2cap.h"
+#include "ble_link.h"
+#include "metrics.h"
 #include <zephyr/logging/log.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/random/random.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
 
 LOG_MODULE_REGISTER(ble_passport_svc, LOG_LEVEL_DBG);
 
+/* BLE TX thread and the ring feeding it */
+#define BLE_TX_RING_SIZE CONFIG_PASSPORT_BLE_TX_RING_SIZE
+#define BLE_TX_STACK_SIZE 1024
+#define BLE_TX_PRIORITY 5
+#define BLE_TX_TIMEOUT_MS 5000 /* Longest the reader is held up by a full ring */
+#define BLE_TX_IN_FLIGHT CONFIG_BT_L2CAP_TX_BUF_COUNT /* Notifications in the stack, all centrals */
+
+/* Every connection is a central subscribing to results */
+#define BLE_MAX_PEERS CONFIG_BT_MAX_CONN
+
+BUILD_ASSERT((BLE_TX_RING_SIZE & (BLE_TX_RING_SIZE - 1)) == 0,
+             "BLE TX ring size must be a power of two");
+
+/*
+ * What one more central costs this service: its slot plus a config entry
+ * in each CCC. The stack's share (connection object, ATT and ACL buffers)
+ * follows from Kconfig and shows up in the build's RAM report.
+ */
+#define BLE_CCC_COUNT 6
+#define BLE_PEER_MEM (sizeof(struct ble_peer) + BLE_CCC_COUNT * sizeof(struct bt_gatt_ccc_cfg))
+
+/* Framed transfers on the data characteristic */
+#define BLE_XFER_MAX CONFIG_PASSPORT_BLE_XFER_MAX
+#define BLE_XFER_WINDOW CONFIG_PASSPORT_BLE_XFER_WINDOW
+#define BLE_XFER_FRAME_MAX (CONFIG_BT_L2CAP_TX_MTU - 3 - sizeof(passport_frame_hdr_t))
+#define BLE_XFER_ACK_TIMEOUT_MS 2000 /* No ack for this long: suspend until the app resumes */
+
+typedef enum
+{
+    BLE_TX_STATUS,
+    BLE_TX_KIOSK_STATS,
+    BLE_TX_METRICS,
+    BLE_TX_LINK, /* Filled per central when sent, the parameters differ per connection */
+    BLE_TX_XFER, /* Payload in xfer, the record only orders it */
+    BLE_TX_PHOTO
+} ble_tx_type_t;
+
+typedef enum
+{
+    XFER_IDLE,
+    XFER_ACTIVE,
+    XFER_SUSPENDED /* Stalled or disconnected, resumable until the next payload */
+} ble_xfer_state_t;
+
+/* Where one central is in the current framed transfer */
+typedef enum
+{
+    PEER_XFER_NONE,    /* Not subscribed when it started, or connected later */
+    PEER_XFER_ACTIVE,
+    PEER_XFER_DONE,    /* Acked all of it */
+    PEER_XFER_STALLED  /* Went quiet or disconnected; a resend ack brings it back */
+} ble_peer_xfer_t;
+
+/* One queued notification, encoded once for every central */
+typedef struct
+{
+    uint8_t type;
+    uint16_t len;
+    uint16_t offset;    /* Photo only */
+    uint16_t total_len; /* Photo only */
+    uint8_t buf[PASSPORT_PHOTO_CHUNK_MAX];
+} ble_tx_record_t;
+
+BUILD_ASSERT(PASSPORT_METRICS_MAX * sizeof(passport_metrics_entry_t) <=
+             sizeof(((ble_tx_record_t *)0)->buf));
+
+/*
+ * One slot per connected central. CCC state and the ATT MTU are already
+ * kept per connection by the stack; a slot adds the central's share of
+ * the notification credits, its place in the ring and its progress
+ * through the current framed transfer.
+ */
+struct ble_peer
+{
+    struct bt_conn *conn; /* NULL: free slot */
+    atomic_t in_flight;   /* Notifications of this central held by the stack */
+    atomic_t tx_fresh;    /* Connected, the TX thread has not placed its cursor yet */
+    uint32_t tx_next;     /* TX thread: next ring record for this central */
+    bool photo_skip;      /* TX thread: missed a chunk of the current photo */
+    uint16_t xfer_seq;    /* TX thread */
+    uint16_t xfer_next;   /* TX thread: next byte to send */
+    atomic_t xfer_state;  /* ble_peer_xfer_t */
+    atomic_t xfer_acked;  /* Bytes this central holds in order */
+    atomic_t xfer_resend;
+    int64_t connected_at; /* Reconnect timing: connection to first notification */
+    bool notified;        /* TX thread */
+    /*
+     * Cycle count of each notification in flight, for METRICS_BLE_TX. One
+     * connection completes them in the order they were sent.
+     */
+    uint32_t tx_started[BLE_TX_IN_FLIGHT];
+    uint32_t tx_start_next; /* TX thread */
+    uint32_t tx_done_next;  /* Completion callback */
+};
+
 /* ==================== Global Variables ==================== */
-static struct bt_conn *current_conn = NULL;
 static void (*command_callback)(passport_command_t cmd) = NULL;
+static void (*mrz_key_callback)(const passport_mrz_key_t *key) = NULL;
 static passport_status_t current_status = PASSPORT_STATUS_IDLE;
-static passport_data_t current_data = {0};
+static passport_kiosk_stats_t current_kiosk_stats = {0};
+
+/*
+ * Written by the connection callbacks on the BT RX thread; everyone else
+ * takes a reference under the lock before using a slot's connection.
+ */
+static struct ble_peer peers[BLE_MAX_PEERS];
+static struct k_spinlock peers_lock;
+static atomic_t peer_count;
+
+/*
+ * Single producer (the reader thread), single consumer (the BLE TX thread).
+ * Each index is only written by its owner; the semaphores are just for
+ * sleeping on an empty or full ring.
+ */
+static ble_tx_record_t tx_ring[BLE_TX_RING_SIZE];
+static atomic_t tx_head; /* Next record to fill */
+static atomic_t tx_tail; /* Next record to send */
+static K_SEM_DEFINE(tx_items, 0, 1); /* New record, completion or disconnect */
+static K_SEM_DEFINE(tx_space, 0, 1);
+
+/*
+ * One credit per buffer the stack has for notifications, shared by all
+ * centrals; each central is held to its share of them (peer_share()).
+ */
+static K_SEM_DEFINE(tx_credits, BLE_TX_IN_FLIGHT, BLE_TX_IN_FLIGHT);
+static K_SEM_DEFINE(tx_sent, 0, 1); /* A notification completed */
+static struct k_thread ble_tx_thread;
+static K_THREAD_STACK_DEFINE(ble_tx_stack, BLE_TX_STACK_SIZE);
+
+static int photo_err;
+
+/*
+ * Framed transfer in progress, encoded once and sent to every central
+ * subscribed when it starts. The reader thread fills it while holding
+ * xfer_idle and hands it to the TX thread with a BLE_TX_XFER record; the
+ * TX thread gives xfer_idle back once every central acked it all or
+ * stalled. Acks arrive on the BT RX thread.
+ */
+static struct
+{
+    uint8_t buf[BLE_XFER_MAX];
+    uint16_t len;
+    uint8_t id;
+    uint8_t type;
+    uint32_t crc;
+    int64_t started;
+    atomic_t state;
+} xfer;
+static struct k_spinlock xfer_lock; /* id check and ack update vs a new payload */
+static K_SEM_DEFINE(xfer_idle, 1, 1);
+static K_SEM_DEFINE(xfer_acked, 0, 1);
+static K_SEM_DEFINE(xfer_resume, 0, 1);
+
+/* The TX thread sleeps on new records and on resume requests */
+static struct k_poll_event tx_events[] = {
+    K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+                                    &tx_items, 0),
+    K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+                                    &xfer_resume, 0),
+};
+
+/* ==================== Peers ==================== */
+
+/* A reference to the slot's connection, NULL for a free slot */
+static struct bt_conn *peer_conn(struct ble_peer *peer)
+{
+    k_spinlock_key_t key = k_spin_lock(&peers_lock);
+    struct bt_conn *conn = peer->conn ? bt_conn_ref(peer->conn) : NULL;
+
+    k_spin_unlock(&peers_lock, key);
+    return conn;
+}
+
+static struct ble_peer *peer_find(struct bt_conn *conn)
+{
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        if (peers[i].conn == conn)
+        {
+            return &peers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool peer_subscribed(struct bt_conn *conn, const struct bt_gatt_attr *attr)
+{
+    return bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY);
+}
 
 /* ==================== GATT Characteristics ==================== */
 
@@ -32,6 +225,102 @@ static void data_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value
     LOG_INF("Data notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
 }
 
+/* Photo Characteristic - Notify */
+static void photo_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("Photo notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+/* Kiosk Stats Characteristic - Notify */
+static void kiosk_stats_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("Kiosk stats notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+/* Metrics Characteristic - Read + Notify */
+static void metrics_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("Metrics notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+static ssize_t metrics_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                            uint16_t len, uint16_t offset)
+{
+    passport_metrics_entry_t entries[PASSPORT_METRICS_MAX];
+    size_t n = metrics_snapshot(entries, ARRAY_SIZE(entries));
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, entries, n * sizeof(entries[0]));
+}
+
+/* L2CAP PSM Characteristic - Read, 0 when the channel is compiled out */
+static ssize_t l2cap_psm_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                              uint16_t len, uint16_t offset)
+{
+    uint16_t psm = sys_cpu_to_le16(ble_l2cap_psm());
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &psm, sizeof(psm));
+}
+
+/* Link Characteristic - Read + Notify */
+static void link_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("Link notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+static ssize_t link_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                         uint16_t len, uint16_t offset)
+{
+    passport_link_info_t info;
+
+    ble_link_get_info(conn, &info);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &info, sizeof(info));
+}
+
+/*
+ * Transfer ack from one central: moves its window, or rewinds it with
+ * RESEND. A RESEND also takes back a central that stalled or connected
+ * again, so it catches up while the others carry on.
+ */
+static void xfer_ack(struct bt_conn *conn, const passport_xfer_ack_t *ack)
+{
+    uint16_t offset = sys_le16_to_cpu(ack->offset);
+    struct ble_peer *peer = peer_find(conn);
+    k_spinlock_key_t key;
+
+    if (!peer)
+    {
+        return;
+    }
+
+    key = k_spin_lock(&xfer_lock);
+    if (ack->xfer_id != xfer.id || offset > xfer.len)
+    {
+        k_spin_unlock(&xfer_lock, key);
+        LOG_DBG("Stale transfer ack %u@%u", ack->xfer_id, offset);
+        return;
+    }
+
+    atomic_set(&peer->xfer_acked, offset);
+    if (ack->flags & PASSPORT_XFER_ACK_RESEND)
+    {
+        atomic_set(&peer->xfer_resend, 1);
+        if (!atomic_cas(&peer->xfer_state, PEER_XFER_STALLED, PEER_XFER_ACTIVE))
+        {
+            atomic_cas(&peer->xfer_state, PEER_XFER_NONE, PEER_XFER_ACTIVE);
+        }
+    }
+    k_spin_unlock(&xfer_lock, key);
+
+    if (atomic_get(&xfer.state) == XFER_SUSPENDED)
+    {
+        k_sem_give(&xfer_resume);
+    }
+    else
+    {
+        k_sem_give(&xfer_acked);
+    }
+}
+
 /* Control Characteristic - Write */
 static ssize_t control_write(struct bt_conn *conn,
                              const struct bt_gatt_attr *attr,
@@ -40,6 +329,24 @@ static ssize_t control_write(struct bt_conn *conn,
 {
     const uint8_t *data = buf;
 
+    if (len == 1 + sizeof(passport_mrz_key_t) && data[0] == PASSPORT_CMD_SET_MRZ_KEY)
+    {
+        LOG_INF("Control write: MRZ key");
+
+        if (mrz_key_callback)
+        {
+            mrz_key_callback((const passport_mrz_key_t *)&data[1]);
+        }
+
+        return len;
+    }
+
+    if (len == 1 + sizeof(passport_xfer_ack_t) && data[0] == PASSPORT_CMD_XFER_ACK)
+    {
+        xfer_ack(conn, (const passport_xfer_ack_t *)&data[1]);
+        return len;
+    }
+
     if (len != 1)
     {
         LOG_WRN("Invalid command length: %d", len);
@@ -73,7 +380,7 @@ BT_GATT_SERVICE_DEFINE(passport_svc,
                        BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_DATA,
                                               BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
                                               BT_GATT_PERM_READ,
-                                              NULL, NULL, &current_data),
+                                              NULL, NULL, NULL),
                        BT_GATT_CCC(data_ccc_cfg_changed,
                                    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 
@@ -81,55 +388,208 @@ BT_GATT_SERVICE_DEFINE(passport_svc,
                        BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_CONTROL,
                                               BT_GATT_CHRC_WRITE,
                                               BT_GATT_PERM_WRITE,
-                                              NULL, control_write, NULL), );
+                                              NULL, control_write, NULL),
+
+                       /* Photo Characteristic (Notify) */
+                       BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_PHOTO,
+                                              BT_GATT_CHRC_NOTIFY,
+                                              BT_GATT_PERM_NONE,
+                                              NULL, NULL, NULL),
+                       BT_GATT_CCC(photo_ccc_cfg_changed,
+                                   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+                       /* Kiosk Stats Characteristic (Read + Notify) */
+                       BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_KIOSK_STATS,
+                                              BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                                              BT_GATT_PERM_READ,
+                                              NULL, NULL, &current_kiosk_stats),
+                       BT_GATT_CCC(kiosk_stats_ccc_cfg_changed,
+                                   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+                       /* Metrics Characteristic (Read + Notify) */
+                       BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_METRICS,
+                                              BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                                              BT_GATT_PERM_READ,
+                                              metrics_read, NULL, NULL),
+                       BT_GATT_CCC(metrics_ccc_cfg_changed,
+                                   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+                       /* L2CAP PSM Characteristic (Read) */
+                       BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_L2CAP_PSM,
+                                              BT_GATT_CHRC_READ,
+                                              BT_GATT_PERM_READ,
+                                              l2cap_psm_read, NULL, NULL),
+
+                       /* Link Characteristic (Read + Notify) */
+                       BT_GATT_CHARACTERISTIC(BT_UUID_PASSPORT_LINK,
+                                              BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                                              BT_GATT_PERM_READ,
+                                              link_read, NULL, NULL),
+                       BT_GATT_CCC(link_ccc_cfg_changed,
+                                   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE), );
 
 /* ==================== Connection Callbacks ==================== */
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
+    struct ble_peer *peer;
+    k_spinlock_key_t key;
+
     if (err)
     {
         LOG_ERR("Connection failed (err %u)", err);
         return;
     }
 
-    current_conn = bt_conn_ref(conn);
-
     char addr[BT_ADDR_LE_STR_LEN];
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-    LOG_INF("Connected: %s", addr);
+
+    /* The stack allows no more than CONFIG_BT_MAX_CONN, so a slot is always free */
+    peer = peer_find(NULL);
+    if (!peer)
+    {
+        LOG_ERR("No slot for %s", addr);
+        return;
+    }
+
+    /* Credits of the previous connection came back on its disconnect */
+    atomic_set(&peer->in_flight, 0);
+    atomic_set(&peer->tx_fresh, 1);
+    peer->photo_skip = true; /* Joins at the next photo */
+    peer->xfer_seq = 0;
+    peer->xfer_next = 0;
+    atomic_set(&peer->xfer_state, PEER_XFER_NONE);
+    atomic_set(&peer->xfer_acked, 0);
+    atomic_set(&peer->xfer_resend, 0);
+    peer->connected_at = k_uptime_get();
+    peer->notified = false;
+    peer->tx_start_next = 0;
+    peer->tx_done_next = 0;
+
+    key = k_spin_lock(&peers_lock);
+    peer->conn = bt_conn_ref(conn);
+    k_spin_unlock(&peers_lock, key);
+
+    LOG_INF("Connected: %s (%u of %u)", addr, (uint32_t)atomic_inc(&peer_count) + 1,
+            BLE_MAX_PEERS);
+
+    /* A bonded central gets its stored CCCs back once the link is encrypted */
+    if (bt_addr_le_is_bonded(BT_ID_DEFAULT, bt_conn_get_dst(conn)))
+    {
+        int ret = bt_conn_set_security(conn, BT_SECURITY_L2);
+
+        if (ret)
+        {
+            LOG_WRN("Encryption request failed: %d", ret);
+        }
+    }
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
+    struct ble_peer *peer = peer_find(conn);
+    k_spinlock_key_t key;
+    atomic_val_t in_flight;
+
     char addr[BT_ADDR_LE_STR_LEN];
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
     LOG_INF("Disconnected: %s (reason %u)", addr, reason);
 
-    if (current_conn)
+    if (!peer)
+    {
+        return;
+    }
+
+    /* Completions of notifications still queued may never come: pay them back now */
+    key = k_spin_lock(&peers_lock);
+    peer->conn = NULL;
+    in_flight = atomic_set(&peer->in_flight, 0);
+    k_spin_unlock(&peers_lock, key);
+
+    while (in_flight-- > 0)
+    {
+        k_sem_give(&tx_credits);
+    }
+    k_sem_give(&tx_sent);
+    k_sem_give(&tx_items);
+
+    bt_conn_unref(conn);
+    atomic_dec(&peer_count);
+
+    /* A transfer still sending to it carries on with the others */
+    atomic_cas(&peer->xfer_state, PEER_XFER_ACTIVE, PEER_XFER_STALLED);
+    k_sem_give(&xfer_acked);
+}
+
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+                             enum bt_security_err err)
+{
+    struct ble_peer *peer = peer_find(conn);
+
+    if (err)
     {
-        bt_conn_unref(current_conn);
-        current_conn = NULL;
+        LOG_WRN("Security level %u failed: %d", level, err);
+        return;
     }
+
+    LOG_INF("Security level %u, %u ms after connect", level,
+            peer ? (uint32_t)(k_uptime_get() - peer->connected_at) : 0);
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
     .connected = connected,
     .disconnected = disconnected,
+    .security_changed = security_changed,
+};
+
+static void pairing_complete(struct bt_conn *conn, bool bonded)
+{
+    LOG_INF("Pairing complete%s", bonded ? ", bond stored" : "");
+}
+
+static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
+{
+    LOG_WRN("Pairing failed: %d", reason);
+}
+
+static struct bt_conn_auth_info_cb auth_info_callbacks = {
+    .pairing_complete = pairing_complete,
+    .pairing_failed = pairing_failed,
 };
 
 /* ==================== Advertising ==================== */
 
-/* Simple advertising without UUID (still discoverable by name) */
+static passport_adv_t adv_state = {
+    .company_id = sys_cpu_to_le16(PASSPORT_ADV_COMPANY_ID),
+};
+
+/*
+ * Service UUID for scan filters in the controller, then the reader state.
+ * The stack puts the name in the scan response (BT_LE_ADV_OPT_USE_NAME).
+ */
 static const struct bt_data ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_PASSPORT_SERVICE_VAL),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, &adv_state, sizeof(adv_state)),
 };
 
-/* Scan response data with device name */
-static const struct bt_data sd[] = {
-    BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1)};
+/*
+ * Called from the reader thread only. While every connection is taken the
+ * stack is not advertising and the update fails; the next status change
+ * after a central leaves brings the packet up to date again.
+ */
+static void adv_update(passport_status_t status)
+{
+    int err;
+
+    adv_state.status = status;
 
-/* ==================== Advertising ==================== */
+    err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad), NULL, 0);
+    if (err && err != -EAGAIN)
+    {
+        LOG_DBG("Advertising data not updated: %d", err);
+    }
+}
 
 static int start_advertising(void)
 {
@@ -155,88 +615,1193 @@ static int start_advertising(void)
     LOG_INF("✓✓✓ Advertising started ✓✓✓");
     LOG_INF("Waiting for Android connection...");
     LOG_INF("Android can discover by name: %s", CONFIG_BT_DEVICE_NAME);
-    LOG_INF("Service UUID will be discovered after connection");
+    LOG_INF("Service UUID and reader state are in the advertising data");
 
     return 0;
 }
 
-/* ==================== Public API ==================== */
+/* ==================== BLE TX Thread ==================== */
 
-int ble_passport_service_init(void)
+/* Producer side: wait for a free record, so a slow link throttles the reader */
+static ble_tx_record_t *tx_reserve(void)
 {
-    int err;
+    while ((uint32_t)atomic_get(&tx_head) - (uint32_t)atomic_get(&tx_tail) == BLE_TX_RING_SIZE)
+    {
+        /* Lets the TX thread see a full ring and drop for a congested central */
+        k_sem_give(&tx_items);
 
-    LOG_INF("BLE init");
+        if (k_sem_take(&tx_space, K_MSEC(BLE_TX_TIMEOUT_MS)) != 0)
+        {
+            return NULL;
+        }
+    }
 
-    err = bt_enable(NULL);
-    if (err)
+    return &tx_ring[atomic_get(&tx_head) & (BLE_TX_RING_SIZE - 1)];
+}
+
+static void tx_commit(void)
+{
+    atomic_inc(&tx_head);
+    k_sem_give(&tx_items);
+}
+
+/* Transfer and photo records go to every central at once, from the TX thread */
+static bool tx_is_shared(const ble_tx_record_t *rec)
+{
+    return rec->type == BLE_TX_XFER || rec->type == BLE_TX_PHOTO;
+}
+
+/* A fair share of the stack's buffers, so one slow central cannot take them all */
+static int peer_share(void)
+{
+    return MAX(BLE_TX_IN_FLIGHT / MAX((int)atomic_get(&peer_count), 1), 1);
+}
+
+/* BT TX thread: a notification left the stack */
+static void tx_notify_done(struct bt_conn *conn, void *user_data)
+{
+    struct ble_peer *peer = user_data;
+    k_spinlock_key_t key = k_spin_lock(&peers_lock);
+
+    /* Late completions for a connection already gone were paid back on disconnect */
+    if (peer->conn == conn)
     {
-        LOG_ERR("BT failed: %d", err);
-        return err;
+        metrics_end(METRICS_BLE_TX,
+                    peer->tx_started[peer->tx_done_next++ % BLE_TX_IN_FLIGHT]);
+        atomic_dec(&peer->in_flight);
+        k_sem_give(&tx_credits);
     }
+    k_spin_unlock(&peers_lock, key);
 
-    LOG_INF("BT ready");
+    k_sem_give(&tx_sent);
+    k_sem_give(&tx_items);
+}
 
-    /* Start advertising */
-    err = start_advertising();
+/*
+ * Hand one notification to the stack if the pool and the central's share
+ * allow it, else -EAGAIN. The data is copied into an ATT buffer there, so
+ * the caller's copy is free again on return.
+ */
+static int tx_try_notify(struct ble_peer *peer, struct bt_conn *conn,
+                         const struct bt_gatt_attr *attr, const void *data, uint16_t len)
+{
+    struct bt_gatt_notify_params params = {
+        .attr = attr,
+        .data = data,
+        .len = len,
+        .func = tx_notify_done,
+        .user_data = peer,
+    };
+    int err;
+
+    if (atomic_get(&peer->in_flight) >= peer_share() || k_sem_take(&tx_credits, K_NO_WAIT) != 0)
+    {
+        return -EAGAIN;
+    }
+
+    /* Stamped before the call: the completion can run before it returns */
+    peer->tx_started[peer->tx_start_next++ % BLE_TX_IN_FLIGHT] = metrics_begin();
+    atomic_inc(&peer->in_flight);
+    err = bt_gatt_notify_cb(conn, &params);
     if (err)
     {
-        LOG_ERR("Failed to start advertising");
+        /* Not queued, no completion to wait for */
+        peer->tx_start_next--;
+        atomic_dec(&peer->in_flight);
+        k_sem_give(&tx_credits);
         return err;
     }
 
+    if (!peer->notified)
+    {
+        peer->notified = true;
+        LOG_INF("First notification %u ms after connect",
+                (uint32_t)(k_uptime_get() - peer->connected_at));
+    }
+
     return 0;
 }
 
-int ble_passport_send_status(passport_status_t status)
+/*
+ * Same, but waits for completions while there is no credit. For the
+ * photo and bench paths, which stay with one central until it is served.
+ * Any other error, -ENOMEM included, goes back to the caller: the credits
+ * already match the stack's buffers, so waiting longer would not help.
+ */
+static int tx_notify(struct ble_peer *peer, struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                     const void *data, uint16_t len)
 {
-    LOG_DBG("Status: 0x%02X", status);
+    int64_t deadline = k_uptime_get() + BLE_TX_TIMEOUT_MS;
+    int err;
 
-    current_status = status;
+    while ((err = tx_try_notify(peer, conn, attr, data, len)) == -EAGAIN)
+    {
+        int64_t left = deadline - k_uptime_get();
+
+        if (left <= 0 || k_sem_take(&tx_sent, K_MSEC(left)) != 0)
+        {
+            return -ETIMEDOUT; /* Nothing completed for seconds: the link is gone */
+        }
+    }
+
+    return err;
+}
+
+/* Wait until the stack sent every notification of one central, or of all of them for NULL */
+static int tx_notify_drain(struct ble_peer *peer, uint32_t timeout_ms)
+{
+    int64_t deadline = k_uptime_get() + timeout_ms;
 
-    if (current_conn)
+    while (peer ? atomic_get(&peer->in_flight) > 0 :
+                  k_sem_count_get(&tx_credits) < BLE_TX_IN_FLIGHT)
     {
-        int err = bt_gatt_notify(current_conn, &passport_svc.attrs[2],
-                                 &current_status, sizeof(current_status));
-        if (err)
+        int64_t left = deadline - k_uptime_get();
+
+        if (left <= 0 || k_sem_take(&tx_sent, K_MSEC(left)) != 0)
         {
-            LOG_WRN("Notify failed: %d", err);
-            return err;
+            return -ETIMEDOUT;
         }
-        LOG_DBG("Status notification sent");
     }
 
     return 0;
 }
 
-int ble_passport_send_data(const passport_data_t *data)
+static const struct bt_gatt_attr *tx_attr(uint8_t type)
 {
-    LOG_INF("Send data");
+    switch (type)
+    {
+    case BLE_TX_STATUS:
+        return &passport_svc.attrs[2];
+    case BLE_TX_KIOSK_STATS:
+        return &passport_svc.attrs[13];
+    case BLE_TX_METRICS:
+        return &passport_svc.attrs[16];
+    default:
+        return &passport_svc.attrs[21];
+    }
+}
 
-    if (!data)
+/* One record to one central: 0 once it is done with it, -EAGAIN to try again later */
+static int tx_send_peer(struct ble_peer *peer, struct bt_conn *conn, const ble_tx_record_t *rec)
+{
+    const struct bt_gatt_attr *attr = tx_attr(rec->type);
+    passport_link_info_t info;
+    const void *data = rec->buf;
+    uint16_t len = rec->len;
+    int err;
+
+    if (!peer_subscribed(conn, attr))
     {
-        return -EINVAL;
+        return 0;
     }
 
-    memcpy(&current_data, data, sizeof(passport_data_t));
+    if (rec->type == BLE_TX_LINK)
+    {
+        /* The only value that differs per connection */
+        ble_link_get_info(conn, &info);
+        data = &info;
+        len = sizeof(info);
+    }
 
-    if (current_conn)
+    /*
+     * A notification longer than the ATT MTU allows would be cut by the
+     * stack. Until the MTU exchange grows it (metrics run to 231 bytes),
+     * the central reads the value instead, which a long read serves whole.
+     */
+    if (len > bt_gatt_get_mtu(conn) - 3)
     {
-        int err = bt_gatt_notify(current_conn, &passport_svc.attrs[5],
-                                 &current_data, sizeof(current_data));
-        if (err)
-        {
-            LOG_WRN("Notify failed: %d", err);
-            return err;
-        }
-        LOG_INF("Data notification sent");
+        LOG_DBG("Notify %u (%u bytes) to central %u skipped, MTU %u", rec->type, len,
+                (uint32_t)(peer - peers), bt_gatt_get_mtu(conn));
+        return 0;
     }
 
-    return 0;
+    /*
+     * Only a link that is going away loses the record. Anything else,
+     * -ENOMEM from a stack short of buffers included, leaves it at this
+     * central's cursor for the next pass.
+     */
+    err = tx_try_notify(peer, conn, attr, data, len);
+    if (err == -ENOTCONN)
+    {
+        LOG_DBG("Notify %u to central %u: not connected", rec->type, (uint32_t)(peer - peers));
+        return 0;
+    }
+    if (err && err != -EAGAIN)
+    {
+        LOG_DBG("Notify %u to central %u failed: %d, retrying", rec->type,
+                (uint32_t)(peer - peers), err);
+        return -EAGAIN;
+    }
+
+    return err;
 }
 
-void ble_passport_set_data_callback(void (*callback)(passport_command_t cmd))
+/*
+ * Each central walks the ring with its own cursor, so one that is out of
+ * credits only holds back itself. A cursor stops in front of a shared
+ * record until the thread has sent it, which keeps every central's
+ * notifications in order. Returns true if any cursor moved.
+ */
+static bool tx_pump_peers(uint32_t head)
 {
-    command_callback = callback;
-    LOG_INF("Callback set");
-}
\ No newline at end of file
+    uint32_t tail = atomic_get(&tx_tail);
+    bool moved = false;
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        struct ble_peer *peer = &peers[i];
+        struct bt_conn *conn = peer_conn(peer);
+
+        if (!conn)
+        {
+            continue;
+        }
+
+        /* Connected since the last pass: start at the oldest record still queued */
+        if (atomic_clear(&peer->tx_fresh))
+        {
+            peer->tx_next = tail;
+        }
+
+        while (peer->tx_next != head)
+        {
+            ble_tx_record_t *rec = &tx_ring[peer->tx_next & (BLE_TX_RING_SIZE - 1)];
+
+            if (tx_is_shared(rec) || tx_send_peer(peer, conn, rec) == -EAGAIN)
+            {
+                break;
+            }
+
+            peer->tx_next++;
+            moved = true;
+        }
+
+        bt_conn_unref(conn);
+    }
+
+    return moved;
+}
+
+/* Oldest record a connected central still has to pass, head if none */
+static uint32_t tx_slowest(uint32_t head)
+{
+    uint32_t slowest = head;
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        if (peers[i].conn && !atomic_get(&peers[i].tx_fresh) &&
+            (int32_t)(peers[i].tx_next - slowest) < 0)
+        {
+            slowest = peers[i].tx_next;
+        }
+    }
+
+    return slowest;
+}
+
+static void tx_start_xfer(void);
+static void tx_send_photo(ble_tx_record_t *rec);
+
+/*
+ * Free records every central is done with. A shared record is sent here
+ * once all cursors stand in front of it. Returns true if the tail moved.
+ */
+static bool tx_pump_tail(uint32_t head)
+{
+    bool moved = false;
+
+    while (atomic_get(&tx_tail) != head)
+    {
+        uint32_t tail = atomic_get(&tx_tail);
+        ble_tx_record_t *rec = &tx_ring[tail & (BLE_TX_RING_SIZE - 1)];
+        int32_t ahead = tx_slowest(head) - tail;
+
+        if (tx_is_shared(rec) ? ahead < 0 : ahead <= 0)
+        {
+            break;
+        }
+
+        if (rec->type == BLE_TX_XFER)
+        {
+            tx_start_xfer();
+        }
+        else if (rec->type == BLE_TX_PHOTO)
+        {
+            tx_send_photo(rec);
+        }
+
+        /* Every central is past it now, before the producer reuses the slot */
+        for (int i = 0; i < BLE_MAX_PEERS; i++)
+        {
+            if (peers[i].tx_next == tail)
+            {
+                peers[i].tx_next++;
+            }
+        }
+
+        atomic_inc(&tx_tail);
+        k_sem_give(&tx_space);
+        moved = true;
+    }
+
+    return moved;
+}
+
+/*
+ * The ring is full and a central out of credits holds its oldest record.
+ * With others connected the reader comes first: that central loses the
+ * record. Alone, it keeps throttling the reader as it always did.
+ */
+static bool tx_drop_congested(uint32_t head)
+{
+    uint32_t tail = atomic_get(&tx_tail);
+    ble_tx_record_t *rec = &tx_ring[tail & (BLE_TX_RING_SIZE - 1)];
+    bool dropped = false;
+
+    if (head - tail != BLE_TX_RING_SIZE || atomic_get(&peer_count) < 2 || tx_is_shared(rec))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        if (peers[i].conn && !atomic_get(&peers[i].tx_fresh) && peers[i].tx_next == tail)
+        {
+            LOG_WRN("Central %d congested, notification %u dropped", i, rec->type);
+            peers[i].tx_next++;
+            dropped = true;
+        }
+    }
+
+    return dropped;
+}
+
+/* ==================== Framed Transfers ==================== */
+
+/* One frame from the central's next byte, as large as its MTU allows; -EAGAIN without credit */
+static int tx_xfer_frame(struct ble_peer *peer, struct bt_conn *conn)
+{
+    static uint8_t frame[sizeof(passport_frame_hdr_t) + BLE_XFER_FRAME_MAX];
+    passport_frame_hdr_t *hdr = (passport_frame_hdr_t *)frame;
+    uint16_t room = MIN(bt_gatt_get_mtu(conn) - 3 - sizeof(*hdr), BLE_XFER_FRAME_MAX);
+    uint16_t n = MIN(room, xfer.len - peer->xfer_next);
+    int err;
+
+    hdr->xfer_id = xfer.id;
+    hdr->type = xfer.type;
+    hdr->seq = sys_cpu_to_le16(peer->xfer_seq);
+    hdr->offset = sys_cpu_to_le16(peer->xfer_next);
+    hdr->total_len = sys_cpu_to_le16(xfer.len);
+    hdr->crc = sys_cpu_to_le32(xfer.crc);
+    memcpy(&frame[sizeof(*hdr)], &xfer.buf[peer->xfer_next], n);
+
+    err = tx_try_notify(peer, conn, &passport_svc.attrs[5], frame, sizeof(*hdr) + n);
+    if (!err)
+    {
+        peer->xfer_seq++;
+        peer->xfer_next += n;
+    }
+
+    return err;
+}
+
+/*
+ * One step for one central: a frame if its window and its credits allow.
+ * Returns true if a frame went out, false if it waits on an ack, on a
+ * completion, or is done.
+ */
+static bool tx_xfer_step(struct ble_peer *peer)
+{
+    uint16_t acked = atomic_get(&peer->xfer_acked);
+    struct bt_conn *conn;
+    int err;
+
+    if (acked >= xfer.len)
+    {
+        atomic_cas(&peer->xfer_state, PEER_XFER_ACTIVE, PEER_XFER_DONE);
+        return false;
+    }
+
+    if (atomic_clear(&peer->xfer_resend))
+    {
+        LOG_DBG("Transfer %u: central %u resends from %u", xfer.id, (uint32_t)(peer - peers),
+                acked);
+        peer->xfer_next = acked;
+    }
+
+    if (peer->xfer_next >= xfer.len || peer->xfer_next - acked >= BLE_XFER_WINDOW)
+    {
+        return false;
+    }
+
+    conn = peer_conn(peer);
+    err = conn ? tx_xfer_frame(peer, conn) : -ENOTCONN;
+    if (conn)
+    {
+        bt_conn_unref(conn);
+    }
+
+    if (err == -EAGAIN)
+    {
+        return false;
+    }
+
+    if (err)
+    {
+        LOG_WRN("Transfer %u: central %u stalled at %u/%u bytes (%d)", xfer.id,
+                (uint32_t)(peer - peers), acked, xfer.len, err);
+        atomic_cas(&peer->xfer_state, PEER_XFER_ACTIVE, PEER_XFER_STALLED);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Frames go round robin, one per central per pass, each central held to
+ * its own window and its share of the buffers. Runs until every central
+ * acked everything or stalled.
+ */
+static void tx_run_xfer(void)
+{
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+                                 &xfer_acked),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY, &tx_sent),
+    };
+    bool stalled = false;
+
+    while (true)
+    {
+        bool active = false;
+        bool sent = false;
+
+        for (int i = 0; i < BLE_MAX_PEERS; i++)
+        {
+            if (atomic_get(&peers[i].xfer_state) != PEER_XFER_ACTIVE)
+            {
+                continue;
+            }
+
+            sent |= tx_xfer_step(&peers[i]);
+            active |= atomic_get(&peers[i].xfer_state) == PEER_XFER_ACTIVE;
+        }
+
+        if (!active)
+        {
+            break;
+        }
+        if (sent)
+        {
+            continue;
+        }
+
+        /* Every window full or out of credits: wait for an ack or a completion */
+        if (k_poll(events, ARRAY_SIZE(events), K_MSEC(BLE_XFER_ACK_TIMEOUT_MS)) != 0)
+        {
+            for (int i = 0; i < BLE_MAX_PEERS; i++)
+            {
+                if (atomic_cas(&peers[i].xfer_state, PEER_XFER_ACTIVE, PEER_XFER_STALLED))
+                {
+                    LOG_WRN("Transfer %u: central %u stopped acking at %u/%u bytes", xfer.id,
+                            i, (uint16_t)atomic_get(&peers[i].xfer_acked), xfer.len);
+                }
+            }
+            break;
+        }
+
+        for (int i = 0; i < ARRAY_SIZE(events); i++)
+        {
+            events[i].state = K_POLL_STATE_NOT_READY;
+        }
+        k_sem_take(&xfer_acked, K_NO_WAIT);
+        k_sem_take(&tx_sent, K_NO_WAIT);
+    }
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        stalled |= atomic_get(&peers[i].xfer_state) == PEER_XFER_STALLED;
+    }
+
+    if (stalled)
+    {
+        LOG_WRN("Transfer %u incomplete, resumable", xfer.id);
+        atomic_set(&xfer.state, XFER_SUSPENDED);
+    }
+    else
+    {
+        LOG_INF("Transfer %u: %u bytes in %u ms", xfer.id, xfer.len,
+                (uint32_t)(k_uptime_get() - xfer.started));
+        atomic_set(&xfer.state, XFER_IDLE);
+    }
+
+    k_sem_give(&xfer_idle);
+}
+
+static void tx_start_xfer(void)
+{
+    int targets = 0;
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        struct bt_conn *conn = peer_conn(&peers[i]);
+
+        peers[i].xfer_seq = 0;
+        peers[i].xfer_next = 0;
+        if (conn && peer_subscribed(conn, &passport_svc.attrs[5]))
+        {
+            atomic_set(&peers[i].xfer_state, PEER_XFER_ACTIVE);
+            targets++;
+        }
+        if (conn)
+        {
+            bt_conn_unref(conn);
+        }
+    }
+
+    LOG_DBG("Transfer %u to %d central(s)", xfer.id, targets);
+    xfer.started = k_uptime_get();
+    atomic_set(&xfer.state, XFER_ACTIVE);
+    tx_run_xfer();
+}
+
+/* A central asked to continue a stalled transfer, unless a new payload took its place */
+static void tx_resume_xfer(void)
+{
+    if (k_sem_take(&xfer_idle, K_NO_WAIT) != 0)
+    {
+        return;
+    }
+
+    if (!atomic_cas(&xfer.state, XFER_SUSPENDED, XFER_ACTIVE))
+    {
+        k_sem_give(&xfer_idle);
+        return;
+    }
+
+    LOG_INF("Transfer %u resumed", xfer.id);
+    tx_run_xfer();
+}
+
+/*
+ * Photo chunk: over the L2CAP channel to the central that opened it, and
+ * as notifications split to the ATT MTU to every other central that
+ * subscribed. A central that misses a chunk sits out the rest of this
+ * photo, so it holds up the others once at most. Only a failure towards
+ * all of them stops the photo.
+ */
+static void tx_send_photo(ble_tx_record_t *rec)
+{
+    static uint8_t frame[sizeof(passport_photo_hdr_t) + PASSPORT_PHOTO_CHUNK_MAX];
+    const struct bt_gatt_attr *attr = &passport_svc.attrs[10];
+    struct bt_conn *l2cap_conn = ble_l2cap_conn();
+    int delivered = 0;
+    int err = -ENOTCONN;
+
+    if (l2cap_conn)
+    {
+        err = ble_l2cap_send(PASSPORT_FILE_DG2, rec->offset, rec->buf, rec->len, rec->total_len);
+        delivered += !err;
+    }
+
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        struct bt_conn *conn = peer_conn(&peers[i]);
+        int ret = 0;
+
+        if (rec->offset == 0)
+        {
+            peers[i].photo_skip = false;
+        }
+
+        if (!conn)
+        {
+            continue;
+        }
+
+        if (conn == l2cap_conn || peers[i].photo_skip || !peer_subscribed(conn, attr))
+        {
+            bt_conn_unref(conn);
+            continue;
+        }
+
+        for (uint16_t sent = 0, n = 0; !ret && sent < rec->len; sent += n)
+        {
+            uint16_t room = bt_gatt_get_mtu(conn) - 3 - sizeof(passport_photo_hdr_t);
+            passport_photo_hdr_t hdr = {
+                .offset = sys_cpu_to_le16(rec->offset + sent),
+                .total_len = sys_cpu_to_le16(rec->total_len),
+            };
+
+            n = MIN(room, rec->len - sent);
+            memcpy(frame, &hdr, sizeof(hdr));
+            memcpy(&frame[sizeof(hdr)], &rec->buf[sent], n);
+
+            ret = tx_notify(&peers[i], conn, attr, frame, sizeof(hdr) + n);
+        }
+        bt_conn_unref(conn);
+
+        if (ret)
+        {
+            LOG_WRN("Photo to central %d failed at offset %u: %d", i, rec->offset, ret);
+            peers[i].photo_skip = true;
+            err = ret;
+        }
+        else
+        {
+            delivered++;
+        }
+    }
+
+    if (!delivered && !photo_err)
+    {
+        LOG_WRN("Photo send failed at offset %u: %d", rec->offset, err);
+        photo_err = err;
+    }
+}
+
+/* Consumer side: the only place notifications are sent from */
+static void ble_tx_thread_fn(void *p1, void *p2, void *p3)
+{
+    while (true)
+    {
+        k_poll(tx_events, ARRAY_SIZE(tx_events), K_FOREVER);
+        for (int i = 0; i < ARRAY_SIZE(tx_events); i++)
+        {
+            tx_events[i].state = K_POLL_STATE_NOT_READY;
+        }
+
+        if (k_sem_take(&xfer_resume, K_NO_WAIT) == 0)
+        {
+            tx_resume_xfer();
+        }
+
+        if (k_sem_take(&tx_items, K_NO_WAIT) != 0)
+        {
+            continue;
+        }
+
+        /* Until no central can take more and no record can be freed */
+        while (true)
+        {
+            uint32_t head = atomic_get(&tx_head);
+            bool moved = tx_pump_peers(head);
+
+            moved |= tx_pump_tail(head);
+
+            if (!moved && !tx_drop_congested(head))
+            {
+                break;
+            }
+        }
+    }
+}
+
+/* Queue a small notification; dropped only when nobody is connected */
+static int tx_queue(uint8_t type, const void *data, uint16_t len)
+{
+    ble_tx_record_t *rec;
+
+    if (atomic_get(&peer_count) == 0)
+    {
+        return 0;
+    }
+
+    rec = tx_reserve();
+    if (!rec)
+    {
+        LOG_WRN("BLE TX ring stalled, notification %u not queued", type);
+        return -ETIMEDOUT;
+    }
+
+    rec->type = type;
+    rec->len = len;
+    if (len)
+    {
+        memcpy(rec->buf, data, len);
+    }
+    tx_commit();
+    return 0;
+}
+
+/* ==================== Photo Streaming ==================== */
+
+bool ble_passport_photo_enabled(void)
+{
+    bool enabled = ble_l2cap_connected();
+
+    for (int i = 0; !enabled && i < BLE_MAX_PEERS; i++)
+    {
+        struct bt_conn *conn = peer_conn(&peers[i]);
+
+        if (conn)
+        {
+            enabled = peer_subscribed(conn, &passport_svc.attrs[10]);
+            bt_conn_unref(conn);
+        }
+    }
+
+    return enabled;
+}
+
+int ble_passport_send_photo_chunk(uint16_t offset, const uint8_t *data, uint16_t len,
+                                  uint16_t total_len)
+{
+    ble_tx_record_t *rec;
+
+    if (len > PASSPORT_PHOTO_CHUNK_MAX)
+    {
+        return -EINVAL;
+    }
+    if (photo_err)
+    {
+        return photo_err;
+    }
+    if (!ble_passport_photo_enabled())
+    {
+        return -ENOTCONN;
+    }
+
+    /* Only waits if the app is slower than the card */
+    rec = tx_reserve();
+    if (!rec)
+    {
+        return -ETIMEDOUT;
+    }
+
+    rec->type = BLE_TX_PHOTO;
+    rec->offset = offset;
+    rec->total_len = total_len;
+    rec->len = len;
+    memcpy(rec->buf, data, len);
+    tx_commit();
+
+    return 0;
+}
+
+int ble_passport_photo_flush(void)
+{
+    int err = 0;
+
+    while (atomic_get(&tx_tail) != atomic_get(&tx_head))
+    {
+        if (k_sem_take(&tx_space, K_MSEC(BLE_TX_TIMEOUT_MS)) != 0)
+        {
+            err = -ETIMEDOUT;
+            break;
+        }
+    }
+
+    /* Notifications or SDUs can still be queued in the stack */
+    if (!err && ble_l2cap_connected())
+    {
+        err = ble_l2cap_flush(K_MSEC(BLE_TX_TIMEOUT_MS));
+    }
+    if (!err)
+    {
+        err = tx_notify_drain(NULL, BLE_TX_TIMEOUT_MS);
+    }
+
+    if (photo_err)
+    {
+        err = photo_err;
+    }
+    photo_err = 0;
+
+    return err;
+}
+
+/* ==================== Public API ==================== */
+
+int ble_passport_service_init(void)
+{
+    int err;
+
+    LOG_INF("BLE init");
+
+    err = bt_enable(NULL);
+    if (err)
+    {
+        LOG_ERR("BT failed: %d", err);
+        return err;
+    }
+
+    LOG_INF("BT ready");
+
+#if defined(CONFIG_BT_SETTINGS)
+    /* Identity, bonds and their CCCs; before advertising so the stored identity is used */
+    err = settings_load_subtree("bt");
+    if (err)
+    {
+        LOG_WRN("Bonds not loaded: %d", err);
+    }
+#endif
+
+    bt_conn_auth_info_cb_register(&auth_info_callbacks);
+
+    /* Random first id: after a reboot the app must not mistake a new payload for an old one */
+    xfer.id = (uint8_t)sys_rand32_get();
+
+    /* Without the channel DG2 simply stays on notifications */
+    ble_l2cap_init();
+
+    LOG_INF("Up to %u centrals, %u bytes of service state each", BLE_MAX_PEERS,
+            (uint32_t)BLE_PEER_MEM);
+
+    k_thread_create(&ble_tx_thread, ble_tx_stack, K_THREAD_STACK_SIZEOF(ble_tx_stack),
+                    ble_tx_thread_fn, NULL, NULL, NULL, BLE_TX_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&ble_tx_thread, "ble_tx");
+
+    /* Start advertising */
+    err = start_advertising();
+    if (err)
+    {
+        LOG_ERR("Failed to start advertising");
+        return err;
+    }
+
+    return 0;
+}
+
+int ble_passport_send_status(passport_status_t status)
+{
+    LOG_DBG("Status: 0x%02X", status);
+
+    current_status = status;
+    adv_update(status);
+
+    return tx_queue(BLE_TX_STATUS, &current_status, sizeof(current_status));
+}
+
+void ble_passport_record_result(bool ok)
+{
+    uint16_t documents = sys_le16_to_cpu(adv_state.documents);
+    uint16_t errors = sys_le16_to_cpu(adv_state.errors);
+
+    adv_state.result_seq++;
+    if (ok && documents < UINT16_MAX)
+    {
+        adv_state.documents = sys_cpu_to_le16(documents + 1);
+    }
+    else if (!ok && errors < UINT16_MAX)
+    {
+        adv_state.errors = sys_cpu_to_le16(errors + 1);
+    }
+}
+
+int ble_passport_send_data(const passport_data_t *data)
+{
+    LOG_INF("Send data");
+
+    if (!data)
+    {
+        return -EINVAL;
+    }
+
+    /* Copied once, into the transfer buffer it is sent and resent from */
+    return ble_passport_send_xfer(PASSPORT_XFER_DATA, data, sizeof(*data));
+}
+
+int ble_passport_send_xfer(passport_xfer_type_t type, const void *data, uint16_t len)
+{
+    ble_tx_record_t *rec;
+
+    if (len == 0 || len > BLE_XFER_MAX)
+    {
+        return -EMSGSIZE;
+    }
+    if (atomic_get(&peer_count) == 0)
+    {
+        return 0;
+    }
+
+    /* The previous payload is kept until it was acked or stalled */
+    if (k_sem_take(&xfer_idle, K_MSEC(BLE_TX_TIMEOUT_MS)) != 0)
+    {
+        LOG_WRN("Transfer %u still running, payload not queued", xfer.id);
+        return -ETIMEDOUT;
+    }
+
+    rec = tx_reserve();
+    if (!rec)
+    {
+        k_sem_give(&xfer_idle);
+        return -ETIMEDOUT;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&xfer_lock);
+    atomic_set(&xfer.state, XFER_IDLE); /* A late resume must not pick this up half written */
+    xfer.id++;
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        atomic_set(&peers[i].xfer_state, PEER_XFER_NONE);
+        atomic_set(&peers[i].xfer_acked, 0);
+        atomic_set(&peers[i].xfer_resend, 0);
+    }
+    k_spin_unlock(&xfer_lock, key);
+
+    memcpy(xfer.buf, data, len);
+    xfer.len = len;
+    xfer.type = type;
+    xfer.crc = crc32_ieee(xfer.buf, len);
+
+    rec->type = BLE_TX_XFER;
+    rec->len = 0;
+    tx_commit();
+
+    return 0;
+}
+
+int ble_passport_send_kiosk_stats(const passport_kiosk_stats_t *stats)
+{
+    current_kiosk_stats.documents = sys_cpu_to_le32(stats->documents);
+    current_kiosk_stats.errors = sys_cpu_to_le32(stats->errors);
+    current_kiosk_stats.docs_per_min = sys_cpu_to_le16(stats->docs_per_min);
+    current_kiosk_stats.last_ms = sys_cpu_to_le16(stats->last_ms);
+    current_kiosk_stats.avg_ms = sys_cpu_to_le16(stats->avg_ms);
+    current_kiosk_stats.max_ms = sys_cpu_to_le16(stats->max_ms);
+
+    return tx_queue(BLE_TX_KIOSK_STATS, &current_kiosk_stats, sizeof(current_kiosk_stats));
+}
+
+int ble_passport_send_metrics(void)
+{
+    passport_metrics_entry_t entries[PASSPORT_METRICS_MAX];
+    size_t n = metrics_snapshot(entries, ARRAY_SIZE(entries));
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    return tx_queue(BLE_TX_METRICS, entries, n * sizeof(entries[0]));
+}
+
+int ble_passport_send_link(void)
+{
+    /* Filled in per central by the TX thread */
+    return tx_queue(BLE_TX_LINK, NULL, 0);
+}
+
+void ble_passport_set_data_callback(void (*callback)(passport_command_t cmd))
+{
+    command_callback = callback;
+    LOG_INF("Callback set");
+}
+
+void ble_passport_set_mrz_key_callback(void (*callback)(const passport_mrz_key_t *key))
+{
+    mrz_key_callback = callback;
+}
+
+/* ==================== Throughput Test ==================== */
+
+#if defined(CONFIG_SHELL)
+#define BLE_BENCH_DEFAULT_KIB 32 /* About one DG2 */
+#define BLE_BENCH_DEFAULT_RECORDS 100
+#define BLE_BENCH_TIMEOUT_MS 10000
+
+/* Photo notifications with total_len 0, which the app discards */
+static int bench_gatt(struct ble_peer *peer, struct bt_conn *conn, uint8_t *fill, uint32_t bytes)
+{
+    uint16_t room = bt_gatt_get_mtu(conn) - 3 - sizeof(passport_photo_hdr_t);
+    int err = 0;
+
+    for (uint32_t sent = 0, n = 0; !err && sent < bytes; sent += n)
+    {
+        passport_photo_hdr_t hdr = {
+            .offset = sys_cpu_to_le16((uint16_t)sent),
+            .total_len = 0,
+        };
+
+        n = MIN(room, bytes - sent);
+        memcpy(fill, &hdr, sizeof(hdr));
+        err = tx_notify(peer, conn, &passport_svc.attrs[10], fill, sizeof(hdr) + n);
+    }
+
+    return err ? err : tx_notify_drain(peer, BLE_BENCH_TIMEOUT_MS);
+}
+
+static int bench_l2cap(uint8_t *fill, uint32_t bytes)
+{
+    int err = 0;
+
+    if (!ble_l2cap_connected())
+    {
+        return -ENOTCONN;
+    }
+
+    for (uint32_t sent = 0, n = 0; !err && sent < bytes; sent += n)
+    {
+        n = MIN(PASSPORT_PHOTO_CHUNK_MAX, bytes - sent);
+        err = ble_l2cap_send(PASSPORT_FILE_BENCH, (uint16_t)sent, fill, n, 0);
+    }
+
+    return err ? err : ble_l2cap_flush(K_MSEC(BLE_BENCH_TIMEOUT_MS));
+}
+
+static bool bench_idle(const struct shell *sh)
+{
+    if (atomic_get(&tx_tail) != atomic_get(&tx_head))
+    {
+        shell_error(sh, "BLE TX busy, try again when no document is being read");
+        return false;
+    }
+
+    return true;
+}
+
+/* Push the same amount of fill over both paths to compare them on one link */
+static int cmd_ble_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    static uint8_t fill[sizeof(passport_photo_hdr_t) + PASSPORT_PHOTO_CHUNK_MAX];
+    bool gatt = strcmp(argv[0], "gatt") == 0;
+    uint32_t bytes = (argc > 1 ? strtoul(argv[1], NULL, 0) : BLE_BENCH_DEFAULT_KIB) * 1024;
+    struct ble_peer *peer = NULL;
+    struct bt_conn *conn = NULL;
+    int64_t start;
+    uint32_t ms;
+    int err;
+
+    if (!bench_idle(sh))
+    {
+        return -EBUSY;
+    }
+
+    /* GATT: the first central subscribed to photo notifications */
+    for (int i = 0; gatt && !conn && i < BLE_MAX_PEERS; i++)
+    {
+        conn = peer_conn(&peers[i]);
+        if (conn && !peer_subscribed(conn, &passport_svc.attrs[10]))
+        {
+            bt_conn_unref(conn);
+            conn = NULL;
+        }
+        peer = &peers[i];
+    }
+
+    if (gatt && !conn)
+    {
+        shell_error(sh, "No central subscribed to photo notifications");
+        return -ENOTCONN;
+    }
+
+    memset(fill, 0xA5, sizeof(fill));
+    start = k_uptime_get();
+    err = gatt ? bench_gatt(peer, conn, fill, bytes) : bench_l2cap(fill, bytes);
+    ms = MAX((uint32_t)(k_uptime_get() - start), 1);
+    if (conn)
+    {
+        bt_conn_unref(conn);
+    }
+
+    if (err)
+    {
+        shell_error(sh, "%s: failed (%d)", gatt ? "GATT" : "L2CAP", err);
+        return err;
+    }
+
+    shell_print(sh, "%s: %u bytes in %u ms, %u kbit/s", gatt ? "GATT notify" : "L2CAP CoC",
+                bytes, ms, bytes * 8 / ms);
+    return 0;
+}
+
+/*
+ * The status value fanned out to every subscribed central, the way a
+ * result is: run it with one, two, three tablets connected to see what
+ * each extra central costs.
+ */
+static int cmd_ble_bench_fanout(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 0) : BLE_BENCH_DEFAULT_RECORDS;
+    uint8_t status = current_status;
+    uint32_t start;
+    uint32_t us;
+    int err = 0;
+
+    if (!bench_idle(sh))
+    {
+        return -EBUSY;
+    }
+    if (records == 0 || atomic_get(&peer_count) == 0)
+    {
+        shell_error(sh, "Nothing to send");
+        return -EINVAL;
+    }
+
+    start = k_cycle_get_32();
+    for (uint32_t i = 0; !err && i < records; i++)
+    {
+        for (int p = 0; !err && p < BLE_MAX_PEERS; p++)
+        {
+            struct bt_conn *conn = peer_conn(&peers[p]);
+
+            if (conn && peer_subscribed(conn, &passport_svc.attrs[2]))
+            {
+                err = tx_notify(&peers[p], conn, &passport_svc.attrs[2], &status,
+                                sizeof(status));
+            }
+            if (conn)
+            {
+                bt_conn_unref(conn);
+            }
+        }
+    }
+    err = err ? err : tx_notify_drain(NULL, BLE_BENCH_TIMEOUT_MS);
+    us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    if (err)
+    {
+        shell_error(sh, "Fan-out: failed (%d)", err);
+        return err;
+    }
+
+    shell_print(sh, "Fan-out to %u central(s): %u records in %u ms, %u us per record",
+                (uint32_t)atomic_get(&peer_count), records, us / 1000, us / records);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(ble_bench_cmds,
+                               SHELL_CMD_ARG(gatt, NULL, "[KiB] Photo characteristic notifications",
+                                             cmd_ble_bench, 1, 1),
+                               SHELL_CMD_ARG(l2cap, NULL, "[KiB] L2CAP channel (app must have it open)",
+                                             cmd_ble_bench, 1, 1),
+                               SHELL_CMD_ARG(fanout, NULL, "[records] Status to every subscribed central",
+                                             cmd_ble_bench_fanout, 1, 1),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(ble_bench, &ble_bench_cmds, "Bulk throughput: GATT notifications vs L2CAP",
+                   NULL);
+
+static const char *const peer_xfer_names[] = {"-", "sending", "done", "stalled"};
+
+/* Connected centrals and what each one costs the service */
+static int cmd_ble_peers(const struct shell *sh, size_t argc, char **argv)
+{
+    for (int i = 0; i < BLE_MAX_PEERS; i++)
+    {
+        struct bt_conn *conn = peer_conn(&peers[i]);
+        char addr[BT_ADDR_LE_STR_LEN];
+
+        if (!conn)
+        {
+            shell_print(sh, "%d: free", i);
+            continue;
+        }
+
+        bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+        shell_print(sh, "%d: %s mtu %u, %u notifications in flight, transfer %s%s", i, addr,
+                    bt_gatt_get_mtu(conn),
+                    (uint32_t)atomic_get(&peers[i].in_flight),
+                    peer_xfer_names[atomic_get(&peers[i].xfer_state)],
+                    conn == ble_l2cap_conn() ? ", L2CAP" : "");
+        bt_conn_unref(conn);
+    }
+
+    shell_print(sh, "%u bytes of service state per central (slot %u, CCCs %u)",
+                (uint32_t)BLE_PEER_MEM, (uint32_t)sizeof(struct ble_peer),
+                (uint32_t)(BLE_PEER_MEM - sizeof(struct ble_peer)));
+    return 0;
+}
+
+SHELL_CMD_REGISTER(ble_peers, NULL, "Connected centrals", cmd_ble_peers);
+#endif /* CONFIG_SHELL */
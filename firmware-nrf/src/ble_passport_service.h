@@ -28,10 +28,35 @@
 #define BT_UUID_PASSPORT_CONTROL_VAL \
     BT_UUID_128_ENCODE(0x6e400004, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
 
+/* Photo Characteristic UUID: 6E400005-B5A3-F393-E0A9-E50E24DCCA9E */
+#define BT_UUID_PASSPORT_PHOTO_VAL \
+    BT_UUID_128_ENCODE(0x6e400005, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/* Kiosk Stats Characteristic UUID: 6E400006-B5A3-F393-E0A9-E50E24DCCA9E */
+#define BT_UUID_PASSPORT_KIOSK_STATS_VAL \
+    BT_UUID_128_ENCODE(0x6e400006, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/* Metrics Characteristic UUID: 6E400007-B5A3-F393-E0A9-E50E24DCCA9E */
+#define BT_UUID_PASSPORT_METRICS_VAL \
+    BT_UUID_128_ENCODE(0x6e400007, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/* L2CAP PSM Characteristic UUID: 6E400008-B5A3-F393-E0A9-E50E24DCCA9E */
+#define BT_UUID_PASSPORT_L2CAP_PSM_VAL \
+    BT_UUID_128_ENCODE(0x6e400008, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/* Link Characteristic UUID: 6E400009-B5A3-F393-E0A9-E50E24DCCA9E */
+#define BT_UUID_PASSPORT_LINK_VAL \
+    BT_UUID_128_ENCODE(0x6e400009, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
 #define BT_UUID_PASSPORT_SERVICE BT_UUID_DECLARE_128(BT_UUID_PASSPORT_SERVICE_VAL)
 #define BT_UUID_PASSPORT_STATUS BT_UUID_DECLARE_128(BT_UUID_PASSPORT_STATUS_VAL)
 #define BT_UUID_PASSPORT_DATA BT_UUID_DECLARE_128(BT_UUID_PASSPORT_DATA_VAL)
 #define BT_UUID_PASSPORT_CONTROL BT_UUID_DECLARE_128(BT_UUID_PASSPORT_CONTROL_VAL)
+#define BT_UUID_PASSPORT_PHOTO BT_UUID_DECLARE_128(BT_UUID_PASSPORT_PHOTO_VAL)
+#define BT_UUID_PASSPORT_KIOSK_STATS BT_UUID_DECLARE_128(BT_UUID_PASSPORT_KIOSK_STATS_VAL)
+#define BT_UUID_PASSPORT_METRICS BT_UUID_DECLARE_128(BT_UUID_PASSPORT_METRICS_VAL)
+#define BT_UUID_PASSPORT_L2CAP_PSM BT_UUID_DECLARE_128(BT_UUID_PASSPORT_L2CAP_PSM_VAL)
+#define BT_UUID_PASSPORT_LINK BT_UUID_DECLARE_128(BT_UUID_PASSPORT_LINK_VAL)
 
 /* Status Values */
 typedef enum
@@ -50,9 +75,157 @@ typedef enum
     PASSPORT_CMD_START_SCAN = 0x01,
     PASSPORT_CMD_STOP_SCAN = 0x02,
     PASSPORT_CMD_GET_DATA = 0x03,
-    PASSPORT_CMD_RESET = 0x04
+    PASSPORT_CMD_RESET = 0x04,
+    PASSPORT_CMD_SET_MRZ_KEY = 0x05, /* Followed by passport_mrz_key_t */
+    PASSPORT_CMD_START_KIOSK = 0x06, /* Scan continuously until STOP_SCAN */
+    PASSPORT_CMD_XFER_ACK = 0x07     /* Followed by passport_xfer_ack_t */
 } passport_command_t;
 
+/* BAC key material written with PASSPORT_CMD_SET_MRZ_KEY (ASCII, no check digits) */
+typedef struct __packed
+{
+    char document_number[9]; /* '<' padded */
+    char date_of_birth[6];   /* YYMMDD */
+    char expiry_date[6];     /* YYMMDD */
+} passport_mrz_key_t;
+
+/*
+ * Data characteristic framing. A payload goes out as a run of notifications
+ * sized to the ATT MTU, each starting with this header (little endian).
+ * Frames are sent back to back, up to CONFIG_PASSPORT_BLE_XFER_WINDOW bytes
+ * past the last ack, so the link is not idle waiting for the app.
+ */
+typedef struct __packed
+{
+    uint8_t xfer_id;    /* Changes with every payload, random after boot */
+    uint8_t type;       /* passport_xfer_type_t */
+    uint16_t seq;       /* Frame counter, keeps counting across resends */
+    uint16_t offset;    /* Position of the fragment in the payload */
+    uint16_t total_len; /* Payload size */
+    uint32_t crc;       /* CRC-32 (IEEE 802.3) of the whole payload */
+} passport_frame_hdr_t;
+
+typedef enum
+{
+    PASSPORT_XFER_DATA = 0x01 /* passport_data_t */
+} passport_xfer_type_t;
+
+/*
+ * Written with PASSPORT_CMD_XFER_ACK: offset is how much of the payload the
+ * app holds in order. With PASSPORT_XFER_ACK_RESEND the reader goes back and
+ * sends everything from offset again (a lost frame, or a reconnect).
+ */
+#define PASSPORT_XFER_ACK_RESEND 0x01
+
+typedef struct __packed
+{
+    uint8_t xfer_id;
+    uint8_t flags;
+    uint16_t offset;
+} passport_xfer_ack_t;
+
+/* Largest DG2 chunk handed over at once (one READ BINARY response) */
+#define PASSPORT_PHOTO_CHUNK_MAX 256
+
+/* Photo notification header, followed by raw EF.DG2 bytes */
+typedef struct __packed
+{
+    uint16_t offset;    /* Position of the payload in EF.DG2, little endian */
+    uint16_t total_len; /* Size of EF.DG2 including its BER header */
+} passport_photo_hdr_t;
+
+/* Files on the L2CAP channel: EF short file identifiers */
+typedef enum
+{
+    PASSPORT_FILE_DG2 = 0x02,
+    PASSPORT_FILE_DG11 = 0x0B,
+    PASSPORT_FILE_DG12 = 0x0C,
+    PASSPORT_FILE_SOD = 0x1D,
+    PASSPORT_FILE_BENCH = 0xFF /* Throughput test fill, discarded by the app */
+} passport_file_t;
+
+/*
+ * L2CAP SDU header, followed by len file bytes (little endian). The
+ * length is repeated so the app can parse the channel as a plain stream.
+ */
+typedef struct __packed
+{
+    uint8_t file;       /* passport_file_t */
+    uint16_t offset;    /* Position of the payload in the file */
+    uint16_t len;       /* Payload bytes in this SDU */
+    uint16_t total_len; /* Size of the file including its BER header */
+} passport_l2cap_hdr_t;
+
+/* Kiosk counters, notified after every document (little endian) */
+typedef struct __packed
+{
+    uint32_t documents;    /* Documents read since kiosk mode was entered */
+    uint32_t errors;       /* Documents that failed */
+    uint16_t docs_per_min; /* Throughput over the last few documents */
+    uint16_t last_ms;      /* Card detected to result pushed, last document */
+    uint16_t avg_ms;
+    uint16_t max_ms;
+} passport_kiosk_stats_t;
+
+/*
+ * Metrics value: one entry per phase with samples (little endian, at most
+ * PASSPORT_METRICS_MAX entries). Empty when metrics are compiled out.
+ * Only notified while it fits the connection's ATT MTU; read it otherwise.
+ */
+typedef struct __packed
+{
+    uint8_t phase;   /* enum metrics_phase */
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} passport_metrics_entry_t;
+
+#define PASSPORT_METRICS_MAX 11
+
+/* Link profile (see ble_link.h) */
+typedef enum
+{
+    PASSPORT_LINK_IDLE = 0x00, /* Long connection interval, slave latency */
+    PASSPORT_LINK_BULK = 0x01  /* Shortest interval while a document is read */
+} passport_link_profile_t;
+
+/* Link value: negotiated parameters and the last bulk transfer (little endian) */
+typedef struct __packed
+{
+    uint8_t profile;     /* passport_link_profile_t last requested */
+    uint8_t tx_phy;      /* BT_GAP_LE_PHY_1M / _2M / _CODED */
+    uint8_t rx_phy;
+    uint16_t tx_max_len; /* Data length extension: link layer payload bytes */
+    uint16_t rx_max_len;
+    uint16_t mtu;        /* ATT MTU */
+    uint16_t interval;   /* Connection interval, 1.25 ms units */
+    uint16_t latency;    /* Peripheral latency, connection events */
+    uint16_t timeout;    /* Supervision timeout, 10 ms units */
+    uint32_t bulk_bytes; /* Last DG2 stream */
+    uint32_t bulk_ms;
+    uint32_t bulk_kbps;
+} passport_link_info_t;
+
+/* Company ID 0xFFFF: reserved by the Bluetooth SIG for testing and internal use */
+#define PASSPORT_ADV_COMPANY_ID 0xFFFF
+
+/*
+ * Manufacturer data in the advertising packet (little endian), updated on
+ * every status change so readers can be watched without connecting. It
+ * fills what legacy advertising leaves next to the flags and the 128-bit
+ * service UUID; the name goes in the scan response.
+ */
+typedef struct __packed
+{
+    uint16_t company_id; /* PASSPORT_ADV_COMPANY_ID */
+    uint8_t status;      /* passport_status_t */
+    uint8_t result_seq;  /* Bumped once per finished document, wraps */
+    uint16_t documents;  /* Read since boot, saturating */
+    uint16_t errors;     /* Failed since boot, saturating */
+} passport_adv_t;
+
 /* Passport Data Structure */
 typedef struct
 {
@@ -68,10 +241,50 @@ typedef struct
     uint8_t photo_available;
 } passport_data_t;
 
-/* Function declarations */
+/*
+ * Function declarations. The send functions only queue the notification
+ * for the BLE TX thread and must all be called from one thread (the
+ * reader). They block only while the TX ring is full, which happens once
+ * the stack holds CONFIG_BT_L2CAP_TX_BUF_COUNT unsent notifications in
+ * total and the ring has filled up behind them; with more than one
+ * central connected, one that falls behind loses its oldest notification
+ * instead. Each value is encoded once and sent to every central
+ * subscribed to it (CONFIG_BT_MAX_CONN).
+ */
 int ble_passport_service_init(void);
 int ble_passport_send_status(passport_status_t status);
+/*
+ * Count one finished document in the advertised counters. Call once per
+ * document, before the SUCCESS or ERROR status that advertises it.
+ */
+void ble_passport_record_result(bool ok);
 int ble_passport_send_data(const passport_data_t *data);
+/*
+ * Framed transfer on the data characteristic (see passport_frame_hdr_t).
+ * The payload is copied; waits while the previous one is still in flight.
+ */
+int ble_passport_send_xfer(passport_xfer_type_t type, const void *data, uint16_t len);
 void ble_passport_set_data_callback(void (*callback)(passport_command_t cmd));
+void ble_passport_set_mrz_key_callback(void (*callback)(const passport_mrz_key_t *key));
+int ble_passport_send_kiosk_stats(const passport_kiosk_stats_t *stats);
+/* Notify the current latency percentiles (see metrics.h) */
+int ble_passport_send_metrics(void);
+/* Notify the negotiated link parameters and last throughput (see ble_link.h) */
+int ble_passport_send_link(void);
+
+/*
+ * Photo streaming: true once the app subscribed to photo notifications
+ * or opened the L2CAP channel.
+ */
+bool ble_passport_photo_enabled(void);
+/*
+ * Queue one DG2 chunk. The data is copied into the TX ring and sent from
+ * the BLE TX thread, so the caller can start the next RF read at once.
+ * It goes over the L2CAP channel when one is open, else as notifications.
+ */
+int ble_passport_send_photo_chunk(uint16_t offset, const uint8_t *data, uint16_t len,
+                                  uint16_t total_len);
+/* Wait until the TX ring is drained; returns the first photo send error */
+int ble_passport_photo_flush(void);
 
 #endif /* BLE_PASSPORT_SERVICE_H_ */
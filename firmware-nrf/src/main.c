@@ -9,49 +9,64 @@
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/i2c.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
 #include <string.h>
 
+#include "bac.h"
+#include "ble_l2cap.h"
+#include "ble_link.h"
 #include "ble_passport_service.h"
+#include "metrics.h"
+#include "mrtd.h"
+#include "pace.h"
+#include "pn532.h"
+#include "session_mem.h"
+#include "sm.h"
 
 LOG_MODULE_REGISTER(nfc_passport, LOG_LEVEL_DBG);
 
-/* ==================== PN532 Configuration ==================== */
-static uint8_t pn532_i2c_address = 0x24; // Will auto-detect 0x24 or 0x48
-#define PN532_PREAMBLE 0x00
-#define PN532_STARTCODE1 0x00
-#define PN532_STARTCODE2 0xFF
-#define PN532_POSTAMBLE 0x00
-
-#define PN532_HOSTTOPN532 0xD4
-#define PN532_PN532TOHOST 0xD5
-
-/* PN532 Commands */
-#define PN532_CMD_GETFIRMWAREVERSION 0x02
-#define PN532_CMD_SAMCONFIGURATION 0x14
-#define PN532_CMD_INLISTPASSIVETARGET 0x4A
-#define PN532_CMD_INDATAEXCHANGE 0x40
-
-/* ISO14443A Types */
-#define PN532_MIFARE_ISO14443A 0x00
-
 /* GPIO Pins */
-#define PN532_IRQ_NODE DT_ALIAS(pn532irq)
-#define PN532_RST_NODE DT_ALIAS(pn532rst)
-
 #define LED0_NODE DT_ALIAS(led0)
 #define LED1_NODE DT_ALIAS(led1)
 #define LED2_NODE DT_ALIAS(led2)
 #define LED3_NODE DT_ALIAS(led3)
 
-/* ==================== Type Definitions ==================== */
-#define APDU_MAX_LEN 261
+/* RF bit rate ceiling for ISO14443-4 sessions */
+#if defined(CONFIG_PN532_RF_MAX_BITRATE_424)
+#define RF_MAX_BITRATE PN532_BR_424
+#elif defined(CONFIG_PN532_RF_MAX_BITRATE_212)
+#define RF_MAX_BITRATE PN532_BR_212
+#else
+#define RF_MAX_BITRATE PN532_BR_106
+#endif
+
+/* Card detection */
+#define AUTOPOLL_POLL_MS 150 // No IRQ line: check for an InAutoPoll result this often
+#define DETECT_RETRY_MS 500  // Pause after an InListPassiveTarget miss
+#define RESULT_HOLD_MS 2000  // Result LEDs stay on before the next scan
+
+#if defined(CONFIG_PN532_LOW_POWER)
+/*
+ * One InAutoPoll pass (150 ms per type) plus the PowerDown wake-up. The
+ * PN532 sleeps for the rest of the latency budget between passes.
+ */
+#define LP_SNIFF_MS (150 * (IS_ENABLED(CONFIG_PN532_AUTOPOLL_ISO14443A) + \
+                            IS_ENABLED(CONFIG_PN532_AUTOPOLL_ISO14443B)) + 50)
+#define LP_SLEEP_MS (CONFIG_PN532_LOW_POWER_LATENCY_MS - LP_SNIFF_MS)
+BUILD_ASSERT(CONFIG_PN532_LOW_POWER_LATENCY_MS > LP_SNIFF_MS,
+             "Latency budget shorter than one poll pass");
+#endif
 
-typedef struct
-{
-        uint8_t data[APDU_MAX_LEN];
-        uint16_t len;
-} apdu_t;
+/* Kiosk mode */
+#define KIOSK_REMOVAL_POLL_MS 100 // Presence check period once a document is done
+#define KIOSK_REMOVAL_CONFIRM 2   // Consecutive failed checks before re-arming
+#define KIOSK_RATE_WINDOW 8       // Documents behind the docs/min figure
+
+/* Reader events, queued by the BT thread, the PN532 IRQ and the reader timer */
+#define READER_EVENT_QUEUE_LEN 8
 
+/* ==================== Type Definitions ==================== */
 typedef enum
 {
         STATE_IDLE,
@@ -60,27 +75,48 @@ typedef enum
         STATE_DETECTING,
         STATE_CARD_DETECTED,
         STATE_SELECTING_APP,
+        STATE_AUTHENTICATING,
         STATE_READING_DG1,
+        STATE_READING_DG2,
         STATE_SUCCESS,
-        STATE_ERROR
+        STATE_ERROR,
+        STATE_WAIT_REMOVAL
 } passport_state_t;
 
+typedef enum
+{
+        EVT_COMMAND,  // BLE command, arg is the passport_command_t
+        EVT_MRZ_KEY,  // New MRZ key waiting in pending_mrz_key
+        EVT_CARD_IRQ, // PN532 IRQ while InAutoPoll was running
+        EVT_TIMER     // Reader timer expired, arg is its generation
+} reader_event_type_t;
+
+struct reader_event
+{
+        uint8_t type;
+        uint32_t arg;
+};
+
 typedef struct
 {
         passport_state_t state;
-        uint8_t uid[10];
-        uint8_t uid_len;
-        uint8_t target_number;
+        struct pn532_target target;
+        struct mrtd_session mrtd;
+        struct bac_session bac;
+        struct pace_params pace_params;
+        struct pace_session pace;
+        struct sm_ctx *sm; // From the crypto pool while a session is up
+        bool use_pace; // EF.CardAccess offers a PACE variant we implement
         bool card_present;
         bool scan_requested;
+        bool rf_fallback; // Card failed at a higher rate, stay at 106 kbps
+        bool holding;     // SUCCESS/ERROR shown, waiting for the hold to end
+        uint8_t removal_misses;
+        int64_t detected_at; // Uptime when the document was found, for latency
         passport_data_t passport_data;
 } passport_reader_t;
 
 /* ==================== Global Variables ==================== */
-static const struct device *i2c_dev;
-static const struct gpio_dt_spec pn532_irq = GPIO_DT_SPEC_GET(PN532_IRQ_NODE, gpios);
-static const struct gpio_dt_spec pn532_rst = GPIO_DT_SPEC_GET(PN532_RST_NODE, gpios);
-
 static const struct gpio_dt_spec led0 = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
 static const struct gpio_dt_spec led1 = GPIO_DT_SPEC_GET(LED1_NODE, gpios);
 static const struct gpio_dt_spec led2 = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
@@ -88,366 +124,658 @@ static const struct gpio_dt_spec led3 = GPIO_DT_SPEC_GET(LED3_NODE, gpios);
 
 static passport_reader_t reader = {0};
 
-/* ==================== PN532 Functions - Arduino Style ==================== */
-
-static int pn532_wakeup(void)
+#if defined(CONFIG_PN532_DETECT_AUTOPOLL)
+static const struct pn532_autopoll_cfg autopoll_cfg = {
+    .period = CONFIG_PN532_AUTOPOLL_PERIOD,
+    .num_types = IS_ENABLED(CONFIG_PN532_AUTOPOLL_ISO14443A) +
+                 IS_ENABLED(CONFIG_PN532_AUTOPOLL_ISO14443B),
+    .types = {
+#if defined(CONFIG_PN532_AUTOPOLL_ISO14443A)
+        PN532_TARGET_ISO14443A,
+#endif
+#if defined(CONFIG_PN532_AUTOPOLL_ISO14443B)
+        PN532_TARGET_ISO14443B,
+#endif
+    },
+};
+#endif
+
+/* Kept outside reader: a RESET must not forget a poll still running on the PN532 */
+static bool autopoll_supported = IS_ENABLED(CONFIG_PN532_DETECT_AUTOPOLL);
+static bool autopoll_armed;
+static bool lp_sleeping; // PN532 in PowerDown between poll passes
+
+/* Kiosk mode survives the per-document reset of reader */
+static bool kiosk_mode;
+static struct
 {
-        LOG_DBG("Waking up PN532...");
+        passport_kiosk_stats_t stats;
+        uint64_t total_ms;
+        int64_t done_at[KIOSK_RATE_WINDOW]; // Completion times, oldest overwritten
+        uint8_t done_next;
+        uint8_t done_count;
+} kiosk;
+
+/* MRZ key from the app: handed over from the BT thread, derived in the reader loop */
+static struct k_spinlock mrz_key_lock;
+static passport_mrz_key_t pending_mrz_key;
+static bool mrz_key_pending;
+static struct bac_keys bac_keys;
+static bool bac_keys_valid;
+
+/*
+ * Everything that moves the state machine arrives here and is handled by
+ * the main thread alone, which sleeps in k_msgq_get() while nothing happens.
+ */
+K_MSGQ_DEFINE(reader_evq, sizeof(struct reader_event), READER_EVENT_QUEUE_LEN, 4);
 
-        // Send wakeup sequence (like Arduino library)
-        uint8_t wake_cmd[] = {0x55, 0x55, 0x00, 0x00, 0x00};
-        int ret = i2c_write(i2c_dev, wake_cmd, sizeof(wake_cmd), pn532_i2c_address);
+/* One-shot timer for retries and holds; a generation filters stale expiries */
+static void reader_timer_expired(struct k_timer *timer);
+K_TIMER_DEFINE(reader_timer, reader_timer_expired, NULL);
+static uint32_t reader_timer_gen;
+static bool reader_timer_pending;
 
-        if (ret != 0)
+/* ==================== Reader Events ==================== */
+
+/* Called from the BT thread, the GPIO ISR and the system timer */
+static void post_event(uint8_t type, uint32_t arg)
+{
+        struct reader_event evt = {.type = type, .arg = arg};
+
+        if (k_msgq_put(&reader_evq, &evt, K_NO_WAIT) != 0)
         {
-                LOG_WRN("Wakeup write failed: %d", ret);
+                LOG_WRN("Reader event queue full, event %u dropped", type);
         }
+}
+
+static void reader_timer_expired(struct k_timer *timer)
+{
+        post_event(EVT_TIMER, reader_timer_gen);
+}
 
-        k_sleep(K_MSEC(20));
+static void reader_timer_cancel(void)
+{
+        k_timer_stop(&reader_timer);
+        reader_timer_gen++;
+        reader_timer_pending = false;
+}
 
-        return 0;
+static void reader_timer_start(uint32_t ms)
+{
+        reader_timer_cancel();
+        reader_timer_pending = true;
+        k_timer_start(&reader_timer, K_MSEC(ms), K_NO_WAIT);
 }
 
-static int pn532_read_ack(void)
+#if defined(CONFIG_PN532_DETECT_AUTOPOLL)
+static void card_irq(void)
 {
-        uint8_t ack[7];
+        post_event(EVT_CARD_IRQ, 0);
+}
+#endif
 
-        int ret = i2c_read(i2c_dev, ack, sizeof(ack), pn532_i2c_address);
-        if (ret != 0)
-        {
-                return ret;
-        }
+/* ==================== Passport Functions ==================== */
 
-        // Log ACK frame for debugging
-        LOG_HEXDUMP_DBG(ack, sizeof(ack), "ACK frame:");
+static void store_target(const struct pn532_target *target)
+{
+        reader.target = *target;
 
-        // Skip ready byte if present
-        uint8_t offset = (ack[0] == 0x01) ? 1 : 0;
+        LOG_INF("Card detected! (type 0x%02X)", target->type);
+        LOG_HEXDUMP_INF(target->uid, target->uid_len, "UID:");
 
-        if (offset == 1)
-        {
-                LOG_DBG("ACK has I2C ready byte (0x01)");
-        }
+        /* Store UID in passport data */
+        memcpy(reader.passport_data.uid, target->uid, target->uid_len);
+        reader.passport_data.uid_len = target->uid_len;
 
-        // ACK is optional in I2C mode
-        LOG_DBG("ACK skipped (optional in I2C mode)");
-        return 0;
+        reader.card_present = true;
 }
 
-static int pn532_write_command(const uint8_t *cmd, uint8_t cmd_len)
+static int pn532_detect_card(void)
 {
-        uint8_t frame[64];
-        uint8_t idx = 0;
+        uint8_t *cmd = pn532_command_buffer();
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
 
-        frame[idx++] = PN532_PREAMBLE;
-        frame[idx++] = PN532_STARTCODE1;
-        frame[idx++] = PN532_STARTCODE2;
-        frame[idx++] = cmd_len + 1;
-        frame[idx++] = ~(cmd_len + 1) + 1;
-        frame[idx++] = PN532_HOSTTOPN532;
+        cmd[0] = PN532_CMD_INLISTPASSIVETARGET;
+        cmd[1] = 0x01;
+        cmd[2] = PN532_MIFARE_ISO14443A;
+
+        ret = pn532_write_command(3);
+        if (ret != 0)
+                return ret;
+
+        ret = pn532_read_response(&resp, &resp_len, 2000);
+        if (ret != 0)
+                return ret;
 
-        memcpy(&frame[idx], cmd, cmd_len);
-        idx += cmd_len;
+        if (resp_len < 7 || resp[0] != (PN532_CMD_INLISTPASSIVETARGET + 1))
+        {
+                return -EINVAL;
+        }
 
-        uint8_t dcs = PN532_HOSTTOPN532;
-        for (uint8_t i = 0; i < cmd_len; i++)
+        uint8_t num_targets = resp[1];
+        if (num_targets == 0)
         {
-                dcs += cmd[i];
+                return -ENODEV;
         }
-        frame[idx++] = ~dcs + 1;
-        frame[idx++] = PN532_POSTAMBLE;
 
-        LOG_HEXDUMP_DBG(frame, idx, "TX frame:");
+        struct pn532_target target;
 
-        return i2c_write(i2c_dev, frame, idx, pn532_i2c_address);
+        ret = pn532_decode_target(PN532_TARGET_ISO14443A, &resp[2], resp_len - 2, &target);
+        if (ret != 0)
+                return ret;
+
+        store_target(&target);
+        return 0;
 }
 
-static int pn532_read_response(uint8_t *resp, uint8_t *resp_len, uint16_t timeout_ms)
+#if defined(CONFIG_PN532_DETECT_AUTOPOLL)
+/*
+ * Arm InAutoPoll once, then only collect a result that is already there.
+ * Returns -EAGAIN while the PN532 is still polling; the IRQ edge (or the
+ * poll timer on boards without one) brings the state machine back.
+ */
+static int detect_card_autopoll(void)
 {
-        uint8_t frame[64];
+        struct pn532_target target;
         int ret;
 
-        // Wait for response ready
-        k_sleep(K_MSEC(50));
+        if (!autopoll_armed)
+        {
+                ret = pn532_autopoll_start(&autopoll_cfg);
+                if (ret != 0)
+                {
+                        LOG_WRN("InAutoPoll rejected (%d), using InListPassiveTarget", ret);
+                        autopoll_supported = false;
+                        return -ENOTSUP;
+                }
+
+                autopoll_armed = true;
+                LOG_DBG("InAutoPoll armed, period %u x 150 ms", autopoll_cfg.period);
+        }
 
-        // Read ACK first (Arduino style)
-        ret = pn532_read_ack();
+        ret = pn532_autopoll_wait(&target, 0);
+        if (ret == -ETIMEDOUT)
+        {
+                if (pn532_notify_ready(card_irq) != 0)
+                {
+                        reader_timer_start(AUTOPOLL_POLL_MS);
+                }
+                return -EAGAIN;
+        }
+
+        autopoll_armed = false;
         if (ret != 0)
         {
-                LOG_DBG("ACK read failed or invalid");
+                LOG_WRN("InAutoPoll failed: %d", ret);
+                pn532_abort();
+                return ret;
         }
 
-        // Small delay between ACK and response
-        k_sleep(K_MSEC(20));
+        store_target(&target);
+        return 0;
+}
+#endif
+
+#if defined(CONFIG_PN532_LOW_POWER)
+/*
+ * Duty-cycled detection: one InAutoPoll pass, then PowerDown until the
+ * next pass. Passive documents cannot wake the PN532, so the sleep timer
+ * bounds the latency; an external field (phone, another reader) wakes it
+ * early through the RF level detector and IRQ.
+ */
+static int detect_card_low_power(void)
+{
+        struct pn532_autopoll_cfg cfg = autopoll_cfg;
+        struct pn532_target target;
+        int ret;
 
-        // Read response frame
-        ret = i2c_read(i2c_dev, frame, sizeof(frame), pn532_i2c_address);
+        lp_sleeping = false;
+        ret = pn532_wake_up();
         if (ret != 0)
         {
-                LOG_ERR("Failed to read response frame: %d", ret);
                 return ret;
         }
 
-        // Log raw frame for debugging
-        LOG_HEXDUMP_DBG(frame, 16, "RX frame:");
-
-        // Check for "not ready" pattern (0x00 0x80 0x80...)
-        if (frame[0] == 0x00 && frame[1] == 0x80)
+        cfg.polls = 1;
+        cfg.period = 1;
+        ret = pn532_autopoll_start(&cfg);
+        if (ret != 0)
         {
-                LOG_DBG("PN532 not ready or no card present");
-                return -EAGAIN; // Try again
+                LOG_WRN("InAutoPoll rejected (%d), using InListPassiveTarget", ret);
+                autopoll_supported = false;
+                return -ENOTSUP;
         }
 
-        // Skip the I2C ready status byte (0x01) if present
-        uint8_t offset = 0;
-        if (frame[0] == 0x01)
+        ret = pn532_autopoll_wait(&target, LP_SNIFF_MS);
+        if (ret == 0)
+        {
+                store_target(&target);
+                return 0;
+        }
+        if (ret == -ETIMEDOUT)
         {
-                offset = 1;
-                LOG_DBG("Skipped I2C ready byte");
+                pn532_abort();
         }
 
-        // Validate frame header (after offset)
-        if (frame[offset] != PN532_PREAMBLE ||
-            frame[offset + 1] != PN532_STARTCODE1 ||
-            frame[offset + 2] != PN532_STARTCODE2)
+        ret = pn532_power_down(PN532_WAKE_RF);
+        if (ret != 0)
         {
-                LOG_ERR("Invalid response frame header");
-                LOG_ERR("Expected: 00 00 FF, Got: %02X %02X %02X",
-                        frame[offset], frame[offset + 1], frame[offset + 2]);
-                LOG_HEXDUMP_ERR(frame, 16, "Full frame:");
-                return -EINVAL;
+                LOG_WRN("PowerDown failed (%d), staying awake", ret);
+        }
+        else
+        {
+                lp_sleeping = true;
+                pn532_notify_ready(card_irq);
         }
 
-        uint8_t len = frame[offset + 3];
-        uint8_t lcs = frame[offset + 4];
+        reader_timer_start(LP_SLEEP_MS);
+        return -EAGAIN;
+}
+#endif
 
-        // Validate length checksum
-        if ((uint8_t)(len + lcs) != 0)
+static void stop_autopoll(void)
+{
+        if (autopoll_armed)
         {
-                LOG_WRN("Length checksum mismatch: LEN=0x%02X, LCS=0x%02X", len, lcs);
+                pn532_notify_ready(NULL);
+                pn532_abort();
+                autopoll_armed = false;
         }
 
-        LOG_DBG("Frame header OK - Preamble: %02X %02X %02X, LEN: %02X, LCS: %02X",
-                frame[offset], frame[offset + 1], frame[offset + 2], len, lcs);
+        if (lp_sleeping)
+        {
+                pn532_notify_ready(NULL);
+                lp_sleeping = false;
+        }
+}
 
-        *resp_len = len - 2; // Subtract TFI and checksum
-        memcpy(resp, &frame[offset + 6], *resp_len);
+static int detect_card(void)
+{
+#if defined(CONFIG_PN532_DETECT_AUTOPOLL)
+        if (autopoll_supported)
+        {
+#if defined(CONFIG_PN532_LOW_POWER)
+                int ret = detect_card_low_power();
+#else
+                int ret = detect_card_autopoll();
+#endif
 
-        LOG_HEXDUMP_DBG(resp, *resp_len, "Response data:");
+                if (ret != -ENOTSUP)
+                {
+                        return ret;
+                }
+        }
+#endif
 
-        return 0;
+        return pn532_detect_card();
 }
 
-static int pn532_reset(void)
+/* EF.CardAccess sits in the MF; documents without it only do BAC */
+static int probe_pace(void)
 {
-        LOG_INF("Resetting PN532...");
-        gpio_pin_set_dt(&pn532_rst, 0);
-        k_sleep(K_MSEC(100));
-        gpio_pin_set_dt(&pn532_rst, 1);
-        k_sleep(K_MSEC(500));
+        uint8_t *card_access = session_pool_alloc(SESSION_POOL_EF);
+        size_t len;
+        int ret;
+
+        if (!card_access)
+        {
+                return -ENOMEM;
+        }
+
+        ret = mrtd_read_file(&reader.mrtd, MRTD_FID_CARD_ACCESS, card_access, MRTD_SMALL_EF_MAX,
+                             &len);
+        if (ret == 0)
+        {
+                ret = pace_parse_card_access(card_access, len, &reader.pace_params);
+        }
+        session_pool_free(SESSION_POOL_EF, card_access);
+
+        reader.use_pace = (ret == 0);
+        if (ret == -ECOMM)
+        {
+                return ret; // RF trouble, not a missing file
+        }
+
         return 0;
 }
 
-static int pn532_init(void)
+static int select_passport_application(void)
 {
         int ret;
-        uint8_t cmd[16];
-        uint8_t resp[32];
-        uint8_t resp_len;
 
-        LOG_INF("Initializing PN532 (Arduino style)...");
+        mrtd_session_init(&reader.mrtd, reader.target.tg);
+        reader.use_pace = false;
 
-        // Hardware reset
-        ret = pn532_reset();
-        if (ret != 0)
+        if (bac_keys_valid)
         {
-                LOG_ERR("Reset failed");
-                return ret;
+                ret = probe_pace();
+                if (ret != 0)
+                {
+                        return ret;
+                }
+                if (reader.use_pace)
+                {
+                        /* PACE runs at MF level, the applet is selected afterwards under SM */
+                        return 0;
+                }
         }
 
-        // Try both addresses with retries (like Arduino library)
-        uint8_t addresses[] = {0x24, 0x48};
-        bool found = false;
-
-        for (int addr_idx = 0; addr_idx < 2 && !found; addr_idx++)
+        ret = mrtd_select_applet(&reader.mrtd);
+        if (ret == 0)
         {
-                pn532_i2c_address = addresses[addr_idx];
-                LOG_INF("Trying PN532 at address 0x%02X...", pn532_i2c_address);
-
-                // Wakeup sequence
-                pn532_wakeup();
-
-                // Try to get firmware version with retries
-                for (int retry = 0; retry < 3; retry++)
-                {
-                        LOG_INF("  Attempt %d/3", retry + 1);
+                LOG_INF("ePassport application selected");
+                return 0;
+        }
 
-                        cmd[0] = PN532_CMD_GETFIRMWAREVERSION;
-                        ret = pn532_write_command(cmd, 1);
-                        if (ret != 0)
-                        {
-                                LOG_WRN("  Write failed: %d", ret);
-                                k_sleep(K_MSEC(100));
-                                continue;
-                        }
+        LOG_ERR("SELECT failed");
+        return ret;
+}
 
-                        ret = pn532_read_response(resp, &resp_len, 1000);
-                        if (ret == 0 && resp[0] == (PN532_CMD_GETFIRMWAREVERSION + 1))
-                        {
-                                LOG_INF("✓✓✓ PN532 FOUND at 0x%02X! ✓✓✓", pn532_i2c_address);
-                                LOG_INF("Firmware: v%d.%d", resp[1], resp[2]);
-                                found = true;
-                                break;
-                        }
-                        else
-                        {
-                                LOG_WRN("  Read failed: %d", ret);
-                                k_sleep(K_MSEC(200));
-                        }
-                }
+static int establish_bac(void)
+{
+        int ret;
 
-                if (found)
-                        break;
+        reader.sm = session_pool_alloc(SESSION_POOL_CRYPTO);
+        if (!reader.sm)
+        {
+                return -ENOMEM;
         }
 
-        if (!found)
+        ret = bac_authenticate(&reader.mrtd, &bac_keys, &reader.bac);
+        if (ret == 0)
         {
-                LOG_ERR("PN532 not found at 0x24 or 0x48");
-                LOG_ERR("Check:");
-                LOG_ERR("  1. PN532 power (VCC = 3.3V)");
-                LOG_ERR("  2. PN532 mode switches (I2C mode: SEL0=OFF, SEL1=ON)");
-                LOG_ERR("  3. Wiring (SDA, SCL connections)");
-                return -ENODEV;
+                ret = sm_init_3des(reader.sm, reader.bac.ks_enc, reader.bac.ks_mac,
+                                   reader.bac.ssc);
+        }
+        if (ret == 0)
+        {
+                mrtd_session_set_sm(&reader.mrtd, reader.sm);
         }
 
-        // Configure SAM (like Arduino)
-        LOG_INF("Configuring SAM...");
-        cmd[0] = PN532_CMD_SAMCONFIGURATION;
-        cmd[1] = 0x01; // Normal mode
-        cmd[2] = 0x14; // Timeout 50ms * 20 = 1 second
-        cmd[3] = 0x01; // Use IRQ pin
+        return ret;
+}
 
-        ret = pn532_write_command(cmd, 4);
-        if (ret != 0)
+static int establish_pace(void)
+{
+        int ret;
+
+        reader.sm = session_pool_alloc(SESSION_POOL_CRYPTO);
+        if (!reader.sm)
         {
-                LOG_ERR("SAM config write failed");
-                return ret;
+                return -ENOMEM;
         }
 
-        ret = pn532_read_response(resp, &resp_len, 1000);
+        ret = pace_authenticate(&reader.mrtd, &reader.pace_params, PACE_PASSWORD_MRZ,
+                                bac_keys.mrz_hash, sizeof(bac_keys.mrz_hash), &reader.pace);
+        if (ret == 0)
+        {
+                ret = sm_init_aes(reader.sm, reader.pace.ks_enc, reader.pace.ks_mac,
+                                  reader.pace.key_len);
+        }
         if (ret != 0)
         {
-                LOG_ERR("SAM config response failed");
                 return ret;
         }
 
-        LOG_INF("✓ PN532 initialized successfully!");
-        return 0;
+        mrtd_session_set_sm(&reader.mrtd, reader.sm);
+
+        ret = mrtd_select_applet(&reader.mrtd);
+        if (ret == 0)
+        {
+                LOG_INF("ePassport application selected");
+        }
+
+        return ret;
 }
 
-static int pn532_detect_card(void)
+static int read_passport_mrz(void)
 {
-        uint8_t cmd[16];
-        uint8_t resp[32];
-        uint8_t resp_len;
+        uint8_t *ef_buf = session_pool_alloc(SESSION_POOL_EF);
+        uint32_t dg_mask = 0;
+        size_t len;
         int ret;
 
-        cmd[0] = PN532_CMD_INLISTPASSIVETARGET;
-        cmd[1] = 0x01;
-        cmd[2] = PN532_MIFARE_ISO14443A;
+        if (!ef_buf)
+        {
+                return -ENOMEM;
+        }
+
+        /* EF.COM tells which data groups exist; a missing one is not fatal */
+        ret = mrtd_read_file(&reader.mrtd, MRTD_FID_COM, ef_buf, MRTD_SMALL_EF_MAX, &len);
+        if (ret == 0)
+        {
+                mrtd_parse_com(ef_buf, len, &dg_mask);
+        }
+        else if (ret != -ENOENT)
+        {
+                goto out;
+        }
 
-        ret = pn532_write_command(cmd, 3);
+        ret = mrtd_read_file(&reader.mrtd, MRTD_FID_DG1, ef_buf, MRTD_SMALL_EF_MAX, &len);
         if (ret != 0)
-                return ret;
+        {
+                LOG_ERR("DG1 read failed: %d", ret);
+                goto out;
+        }
 
-        ret = pn532_read_response(resp, &resp_len, 2000);
+        ret = mrtd_parse_dg1(ef_buf, len, &reader.passport_data);
         if (ret != 0)
-                return ret;
+        {
+                LOG_ERR("DG1 parse failed: %d", ret);
+                goto out;
+        }
+
+        reader.passport_data.photo_available = (dg_mask & MRTD_DG(2)) ? 1 : 0;
+
+        LOG_INF("Passport MRZ read (%u APDUs)", reader.mrtd.apdus);
+        LOG_INF("  Doc: %s", reader.passport_data.document_number);
+        LOG_INF("  Name: %s, %s", reader.passport_data.surname,
+                reader.passport_data.given_names);
+
+out:
+        session_pool_free(SESSION_POOL_EF, ef_buf);
+        return ret;
+}
 
-        if (resp[0] != (PN532_CMD_INLISTPASSIVETARGET + 1))
+static int photo_chunk(size_t offset, const uint8_t *data, size_t len, size_t total,
+                       void *user_data)
+{
+        if (total > UINT16_MAX)
         {
-                return -EINVAL;
+                return -EFBIG;
         }
 
-        uint8_t num_targets = resp[1];
-        if (num_targets == 0)
+        return ble_passport_send_photo_chunk(offset, data, len, total);
+}
+
+/* DG2 goes chunk by chunk from the PN532 frame to BLE, never held whole */
+static int stream_passport_photo(void)
+{
+        int64_t start = k_uptime_get();
+        size_t len = 0;
+        int ret;
+        int err;
+
+        ret = mrtd_stream_file(&reader.mrtd, MRTD_FID_DG2, photo_chunk, NULL, &len);
+        err = ble_passport_photo_flush();
+        if (ret == 0)
         {
-                return -ENODEV;
+                ret = err;
         }
 
-        reader.target_number = resp[2];
-        reader.uid_len = resp[6];
-        memcpy(reader.uid, &resp[7], reader.uid_len);
+        if (ret == 0)
+        {
+                uint32_t ms = k_uptime_get() - start;
 
-        LOG_INF("Card detected!");
-        LOG_HEXDUMP_INF(reader.uid, reader.uid_len, "UID:");
+                LOG_INF("Photo streamed over %s: %zu bytes in %u ms",
+                        ble_l2cap_connected() ? "L2CAP" : "GATT", len, ms);
+                ble_link_record_bulk(len, ms);
+        }
 
-        /* Store UID in passport data */
-        memcpy(reader.passport_data.uid, reader.uid, reader.uid_len);
-        reader.passport_data.uid_len = reader.uid_len;
+        return ret;
+}
 
-        reader.card_present = true;
-        return 0;
+/*
+ * Drop the secure messaging keys once the card is gone or the session
+ * failed, and hand the session memory back in one go.
+ */
+static void end_secure_session(void)
+{
+        if (reader.mrtd.sm)
+        {
+                reader.mrtd.sm = NULL;
+                sm_free(reader.sm);
+        }
+        if (reader.sm)
+        {
+                session_pool_free(SESSION_POOL_CRYPTO, reader.sm);
+                reader.sm = NULL;
+        }
+        memset(&reader.bac, 0, sizeof(reader.bac));
+        memset(&reader.pace, 0, sizeof(reader.pace));
+        session_reset();
 }
 
-/* Select ePassport Application */
-static const uint8_t SELECT_EPASSPORT_APP[] = {
-    0x00, 0xA4, 0x04, 0x0C, 0x07, 0xA0, 0x00, 0x00, 0x02, 0x47, 0x10, 0x01};
+/*
+ * An RF timeout/CRC error above 106 kbps gets the card one more try at
+ * 106 kbps: the field is cycled and the card re-detected without PSL.
+ * Only -ECOMM (the PN532's own status byte) counts: a MAC mismatch or a
+ * corrupt file would fail the same way at any rate.
+ */
+static bool rf_fallback(int err)
+{
+        if (err != -ECOMM || pn532_bitrate() == PN532_BR_106 || reader.rf_fallback)
+        {
+                return false;
+        }
 
-static int select_passport_application(void)
+        end_secure_session();
+        pn532_bitrate_fallback();
+        reader.rf_fallback = true;
+        reader.card_present = false;
+        reader.state = STATE_DETECTING;
+        return true;
+}
+
+/* Derive BAC keys for a newly received MRZ key, off the RF critical path */
+static void update_bac_keys(void)
 {
-        uint8_t cmd[256];
-        uint8_t resp[256];
-        uint8_t resp_len;
+        passport_mrz_key_t key;
+        size_t doc_len;
+        bool pending;
         int ret;
 
-        cmd[0] = PN532_CMD_INDATAEXCHANGE;
-        cmd[1] = reader.target_number;
-        memcpy(&cmd[2], SELECT_EPASSPORT_APP, sizeof(SELECT_EPASSPORT_APP));
+        k_spinlock_key_t lock = k_spin_lock(&mrz_key_lock);
+        pending = mrz_key_pending;
+        if (pending)
+        {
+                key = pending_mrz_key;
+                mrz_key_pending = false;
+                memset(&pending_mrz_key, 0, sizeof(pending_mrz_key));
+        }
+        k_spin_unlock(&mrz_key_lock, lock);
 
-        ret = pn532_write_command(cmd, sizeof(SELECT_EPASSPORT_APP) + 2);
-        if (ret != 0)
-                return ret;
+        if (!pending)
+        {
+                return;
+        }
 
-        ret = pn532_read_response(resp, &resp_len, 3000);
-        if (ret != 0)
-                return ret;
+        doc_len = sizeof(key.document_number);
+        while (doc_len > 0 && key.document_number[doc_len - 1] == '<')
+        {
+                doc_len--;
+        }
+
+        ret = bac_derive_keys(key.document_number, doc_len, key.date_of_birth,
+                              key.expiry_date, &bac_keys);
+        bac_keys_valid = (ret == 0);
+        memset(&key, 0, sizeof(key));
 
-        /* Check for success (SW1=0x90, SW2=0x00) */
-        if (resp_len >= 4 && resp[resp_len - 2] == 0x90 && resp[resp_len - 1] == 0x00)
+        if (ret == 0)
         {
-                LOG_INF("ePassport application selected");
-                return 0;
+                LOG_INF("BAC keys derived");
         }
+        else
+        {
+                LOG_ERR("BAC key derivation failed: %d", ret);
+        }
+}
 
-        LOG_ERR("SELECT failed");
-        return -EIO;
+static void log_rf_stats(void)
+{
+        struct pn532_rf_stats stats;
+
+        pn532_rf_stats_get(&stats);
+        for (uint8_t br = 0; br < PN532_BR_COUNT; br++)
+        {
+                LOG_INF("  %u kbps: %u sessions, %u exchanges, %u errors",
+                        pn532_bitrate_kbps(br), stats.sessions[br], stats.exchanges[br],
+                        stats.errors[br]);
+        }
+        LOG_INF("  Fallbacks to 106 kbps: %u", stats.fallbacks);
 }
 
-static int read_passport_mrz(void)
+/* ==================== Kiosk Mode ==================== */
+
+static void kiosk_start(void)
 {
-        /* Mock data for demonstration */
-        /* In production, this would read DG1 and parse MRZ */
+        memset(&kiosk, 0, sizeof(kiosk));
+        kiosk_mode = true;
+        ble_passport_send_kiosk_stats(&kiosk.stats);
+}
 
-        strncpy(reader.passport_data.document_number, "A12345678", 10);
-        strncpy(reader.passport_data.surname, "DOE", 40);
-        strncpy(reader.passport_data.given_names, "JOHN", 40);
-        strncpy(reader.passport_data.nationality, "USA", 4);
-        strncpy(reader.passport_data.date_of_birth, "19900101", 9);
-        strncpy(reader.passport_data.sex, "M", 2);
-        strncpy(reader.passport_data.expiry_date, "20301231", 9);
-        reader.passport_data.photo_available = 0;
+/* Count a finished document and push the counters with the result */
+static void kiosk_record(bool ok)
+{
+        passport_kiosk_stats_t *stats = &kiosk.stats;
+        int64_t now = k_uptime_get();
 
-        LOG_INF("Passport MRZ read (mock data)");
-        LOG_INF("  Doc: %s", reader.passport_data.document_number);
-        LOG_INF("  Name: %s, %s", reader.passport_data.surname,
-                reader.passport_data.given_names);
+        if (ok)
+        {
+                uint32_t ms = (uint32_t)(now - reader.detected_at);
 
-        return 0;
+                stats->documents++;
+                kiosk.total_ms += ms;
+                stats->last_ms = MIN(ms, UINT16_MAX);
+                stats->avg_ms = MIN(kiosk.total_ms / stats->documents, UINT16_MAX);
+                stats->max_ms = MAX(stats->max_ms, stats->last_ms);
+
+                kiosk.done_at[kiosk.done_next] = now;
+                kiosk.done_next = (kiosk.done_next + 1) % KIOSK_RATE_WINDOW;
+                if (kiosk.done_count < KIOSK_RATE_WINDOW)
+                {
+                        kiosk.done_count++;
+                }
+        }
+        else
+        {
+                stats->errors++;
+        }
+
+        if (kiosk.done_count >= 2)
+        {
+                uint8_t oldest = (kiosk.done_next + KIOSK_RATE_WINDOW - kiosk.done_count) %
+                                 KIOSK_RATE_WINDOW;
+                int64_t span = now - kiosk.done_at[oldest];
+
+                if (span > 0)
+                {
+                        stats->docs_per_min =
+                            MIN((kiosk.done_count - 1) * 60000LL / span, UINT16_MAX);
+                }
+        }
+
+        LOG_INF("Kiosk: %u docs, %u errors, %u docs/min, %u ms (avg %u, max %u)",
+                stats->documents, stats->errors, stats->docs_per_min, stats->last_ms,
+                stats->avg_ms, stats->max_ms);
+        ble_passport_send_kiosk_stats(stats);
 }
 
 /* ==================== BLE Command Handler ==================== */
 
+/* Runs in the reader thread, between states */
 static void handle_ble_command(passport_command_t cmd)
 {
         LOG_INF("BLE Command received: 0x%02X", cmd);
@@ -456,6 +784,7 @@ static void handle_ble_command(passport_command_t cmd)
         {
         case PASSPORT_CMD_START_SCAN:
                 LOG_INF("Start scan requested");
+                kiosk_mode = false;
                 reader.scan_requested = true;
                 ble_passport_send_status(PASSPORT_STATUS_SCANNING);
                 gpio_pin_set_dt(&led0, 1);
@@ -463,8 +792,8 @@ static void handle_ble_command(passport_command_t cmd)
 
         case PASSPORT_CMD_STOP_SCAN:
                 LOG_INF("Stop scan requested");
-                reader.scan_requested = false;
-                reader.state = STATE_WAIT_COMMAND;
+                kiosk_mode = false;
+                reader.scan_requested = false; // DETECTING drops back to WAIT_COMMAND
                 ble_passport_send_status(PASSPORT_STATUS_IDLE);
                 gpio_pin_set_dt(&led0, 0);
                 break;
@@ -479,20 +808,85 @@ static void handle_ble_command(passport_command_t cmd)
 
         case PASSPORT_CMD_RESET:
                 LOG_INF("Reset requested");
+                kiosk_mode = false;
+                end_secure_session();
+                reader_timer_cancel();
                 memset(&reader, 0, sizeof(reader));
                 reader.state = STATE_WAIT_COMMAND;
                 ble_passport_send_status(PASSPORT_STATUS_IDLE);
                 break;
 
+        case PASSPORT_CMD_START_KIOSK:
+                LOG_INF("Kiosk mode requested");
+                kiosk_start();
+                reader.scan_requested = true;
+                ble_passport_send_status(PASSPORT_STATUS_SCANNING);
+                gpio_pin_set_dt(&led0, 1);
+                break;
+
         default:
                 LOG_WRN("Unknown command: 0x%02X", cmd);
                 break;
         }
 }
 
+static void post_ble_command(passport_command_t cmd)
+{
+        post_event(EVT_COMMAND, cmd);
+}
+
+static void handle_mrz_key(const passport_mrz_key_t *key)
+{
+        k_spinlock_key_t lock = k_spin_lock(&mrz_key_lock);
+
+        pending_mrz_key = *key;
+        mrz_key_pending = true;
+        k_spin_unlock(&mrz_key_lock, lock);
+
+        LOG_INF("MRZ key received");
+        post_event(EVT_MRZ_KEY, 0);
+}
+
+static void handle_reader_event(const struct reader_event *evt)
+{
+        switch (evt->type)
+        {
+        case EVT_COMMAND:
+                handle_ble_command((passport_command_t)evt->arg);
+                break;
+
+        case EVT_MRZ_KEY:
+                update_bac_keys();
+                break;
+
+        case EVT_TIMER:
+                if (evt->arg == reader_timer_gen)
+                {
+                        reader_timer_pending = false;
+                }
+                break;
+
+        case EVT_CARD_IRQ:
+                /* An RF field woke the PN532: poll now rather than when the sleep ends */
+                if (lp_sleeping)
+                {
+                        reader_timer_cancel();
+                }
+                break;
+
+        default:
+                /* Nothing to record: DETECTING collects the InAutoPoll result */
+                break;
+        }
+}
+
 /* ==================== State Machine ==================== */
 
-static void passport_state_machine(void)
+/*
+ * Run one state. Returns false when the state has to wait for an event,
+ * true when it moved on and the next state can run right away.
+ */
+static bool passport_state_step(void)
 {
         int ret;
 
@@ -510,6 +904,11 @@ static void passport_state_machine(void)
                 ret = pn532_init();
                 if (ret == 0)
                 {
+                        /* Kernel uptime, the bootloader runs before it starts */
+                        LOG_INF("Ready %u ms after boot", (uint32_t)k_uptime_get());
+#if defined(CONFIG_PN532_POWER_BENCHMARK)
+                        pn532_power_benchmark();
+#endif
                         reader.state = STATE_WAIT_COMMAND;
                         ble_passport_send_status(PASSPORT_STATUS_IDLE);
                         gpio_pin_set_dt(&led0, 0);
@@ -523,12 +922,19 @@ static void passport_state_machine(void)
                 break;
 
         case STATE_WAIT_COMMAND:
+                stop_autopoll();
+                reader_timer_cancel();
+
                 /* Wait for BLE command to start scanning */
-                if (reader.scan_requested)
+                if (!reader.scan_requested)
                 {
-                        reader.state = STATE_DETECTING;
+#if defined(CONFIG_PN532_LOW_POWER)
+                        /* Idle: nothing but the next scan wakes the PN532 */
+                        pn532_power_down(0);
+#endif
+                        return false;
                 }
-                k_sleep(K_MSEC(100));
+                reader.state = STATE_DETECTING;
                 break;
 
         case STATE_DETECTING:
@@ -538,8 +944,17 @@ static void passport_state_machine(void)
                         break;
                 }
 
-                ble_passport_send_status(PASSPORT_STATUS_SCANNING);
-                ret = pn532_detect_card();
+                if (reader_timer_pending)
+                {
+                        return false;
+                }
+
+                if (!autopoll_armed && !lp_sleeping)
+                {
+                        ble_passport_send_status(PASSPORT_STATUS_SCANNING);
+                }
+
+                ret = detect_card();
                 if (ret == 0)
                 {
                         reader.state = STATE_CARD_DETECTED;
@@ -547,14 +962,29 @@ static void passport_state_machine(void)
                 }
                 else
                 {
-                        k_sleep(K_MSEC(500));
+                        if (ret != -EAGAIN)
+                        {
+                                /* InListPassiveTarget miss: retry after a pause */
+                                reader_timer_start(DETECT_RETRY_MS);
+                        }
+                        return false;
                 }
                 break;
 
         case STATE_CARD_DETECTED:
                 LOG_INF("State: CARD_DETECTED");
+                if (!reader.rf_fallback)
+                {
+                        reader.detected_at = k_uptime_get();
+                }
                 gpio_pin_set_dt(&led2, 1);
                 ble_passport_send_status(PASSPORT_STATUS_READING);
+
+                /* Short connection interval by the time DG2 goes out */
+                ble_link_set_profile(PASSPORT_LINK_BULK);
+
+                pn532_negotiate_bitrate(&reader.target,
+                                        reader.rf_fallback ? PN532_BR_106 : RF_MAX_BITRATE);
                 reader.state = STATE_SELECTING_APP;
                 break;
 
@@ -564,9 +994,26 @@ static void passport_state_machine(void)
                 ret = select_passport_application();
                 if (ret == 0)
                 {
+                        /* Without an MRZ key only unprotected documents can be read */
+                        reader.state = bac_keys_valid ? STATE_AUTHENTICATING : STATE_READING_DG1;
+                }
+                else if (!rf_fallback(ret))
+                {
+                        reader.state = STATE_ERROR;
+                        ble_passport_send_status(PASSPORT_STATUS_ERROR);
+                }
+                break;
+
+        case STATE_AUTHENTICATING:
+                LOG_INF("State: AUTHENTICATING");
+
+                ret = reader.use_pace ? establish_pace() : establish_bac();
+                if (ret == 0)
+                {
+                        /* Every APDU from here on is wrapped and MAC-checked */
                         reader.state = STATE_READING_DG1;
                 }
-                else
+                else if (!rf_fallback(ret))
                 {
                         reader.state = STATE_ERROR;
                         ble_passport_send_status(PASSPORT_STATUS_ERROR);
@@ -579,41 +1026,106 @@ static void passport_state_machine(void)
                 ret = read_passport_mrz();
                 if (ret == 0)
                 {
-                        reader.state = STATE_SUCCESS;
+                        /* The photo is only read if someone is there to receive it */
+                        reader.state = (reader.passport_data.photo_available &&
+                                        ble_passport_photo_enabled()) ?
+                                           STATE_READING_DG2 :
+                                           STATE_SUCCESS;
                 }
-                else
+                else if (!rf_fallback(ret))
                 {
                         reader.state = STATE_ERROR;
                 }
                 break;
 
-        case STATE_SUCCESS:
-                LOG_INF("State: SUCCESS");
-                gpio_pin_set_dt(&led2, 1);
-                gpio_pin_set_dt(&led3, 0);
+        case STATE_READING_DG2:
+                LOG_INF("State: READING_DG2");
+
+                /* The MRZ is already read; a failed photo does not fail the scan */
+                ret = stream_passport_photo();
+                if (ret != 0)
+                {
+                        LOG_WRN("Photo streaming failed: %d", ret);
+                        reader.passport_data.photo_available = 0;
+                }
+                reader.state = STATE_SUCCESS;
+                break;
 
-                LOG_INF("=== Passport Read Complete ===");
+        case STATE_SUCCESS:
+                if (!reader.holding)
+                {
+                        LOG_INF("State: SUCCESS");
+                        gpio_pin_set_dt(&led2, 1);
+                        gpio_pin_set_dt(&led3, 0);
+
+                        LOG_INF("=== Passport Read Complete ===");
+                        log_rf_stats();
+                        end_secure_session();
+                        session_finished();
+                        session_mem_log();
+
+                        /* Send success status and data via BLE, notifications keep their order */
+                        ble_passport_record_result(true);
+                        ble_passport_send_status(PASSPORT_STATUS_SUCCESS);
+                        ble_passport_send_data(&reader.passport_data);
+                        ble_passport_send_metrics();
+                        ble_passport_send_link();
+                        ble_link_set_profile(PASSPORT_LINK_IDLE);
 
-                /* Send success status and data via BLE */
-                ble_passport_send_status(PASSPORT_STATUS_SUCCESS);
-                k_sleep(K_MSEC(100));
-                ble_passport_send_data(&reader.passport_data);
+                        /* Kiosk: no hold, the next document can come as soon as this one leaves */
+                        if (kiosk_mode)
+                        {
+                                kiosk_record(true);
+                                reader.state = STATE_WAIT_REMOVAL;
+                                break;
+                        }
 
-                k_sleep(K_SECONDS(2));
+                        reader.holding = true;
+                        reader_timer_start(RESULT_HOLD_MS);
+                }
+                if (reader_timer_pending)
+                {
+                        return false;
+                }
 
                 /* Reset for next scan */
+                reader.holding = false;
                 reader.card_present = false;
+                reader.rf_fallback = false;
                 reader.state = STATE_WAIT_COMMAND;
                 gpio_pin_set_dt(&led1, 0);
                 gpio_pin_set_dt(&led2, 0);
                 break;
 
         case STATE_ERROR:
-                LOG_ERR("State: ERROR");
-                gpio_pin_set_dt(&led3, 1);
-                ble_passport_send_status(PASSPORT_STATUS_ERROR);
+                if (!reader.holding)
+                {
+                        LOG_ERR("State: ERROR");
+                        log_rf_stats();
+                        end_secure_session();
+                        session_finished();
+                        session_mem_log();
+                        gpio_pin_set_dt(&led3, 1);
+                        ble_passport_record_result(false);
+                        ble_passport_send_status(PASSPORT_STATUS_ERROR);
+                        ble_passport_send_metrics();
+                        ble_passport_send_link();
+                        ble_link_set_profile(PASSPORT_LINK_IDLE);
+
+                        if (kiosk_mode)
+                        {
+                                kiosk_record(false);
+                                reader.state = STATE_WAIT_REMOVAL;
+                                break;
+                        }
 
-                k_sleep(K_SECONDS(2));
+                        reader.holding = true;
+                        reader_timer_start(RESULT_HOLD_MS);
+                }
+                if (reader_timer_pending)
+                {
+                        return false;
+                }
 
                 memset(&reader, 0, sizeof(reader));
                 reader.state = STATE_WAIT_COMMAND;
@@ -622,15 +1134,93 @@ static void passport_state_machine(void)
                 gpio_pin_set_dt(&led2, 0);
                 gpio_pin_set_dt(&led3, 0);
                 break;
+
+        case STATE_WAIT_REMOVAL:
+                if (reader.scan_requested)
+                {
+                        if (reader_timer_pending)
+                        {
+                                return false;
+                        }
+
+                        /* Any failed check counts, a card that stopped answering is as good as gone */
+                        if (pn532_target_present() == 1)
+                        {
+                                reader.removal_misses = 0;
+                        }
+                        else
+                        {
+                                reader.removal_misses++;
+                        }
+
+                        if (reader.removal_misses < KIOSK_REMOVAL_CONFIRM)
+                        {
+                                reader_timer_start(KIOSK_REMOVAL_POLL_MS);
+                                return false;
+                        }
+
+                        LOG_INF("Card removed");
+                }
+
+                /* Next document: keep scanning unless STOP_SCAN came in meanwhile */
+                bool scan = reader.scan_requested;
+
+                memset(&reader, 0, sizeof(reader));
+                reader.scan_requested = scan;
+                reader.state = scan ? STATE_DETECTING : STATE_WAIT_COMMAND;
+                gpio_pin_set_dt(&led1, 0);
+                gpio_pin_set_dt(&led2, 0);
+                gpio_pin_set_dt(&led3, 0);
+                break;
         }
+
+        return true;
+}
+
+/* Latency phase each state is accounted to; idle and result states are not timed */
+static const uint8_t state_phase[] = {
+    [STATE_IDLE] = METRICS_NONE,
+    [STATE_INIT_PN532] = METRICS_INIT,
+    [STATE_WAIT_COMMAND] = METRICS_NONE,
+    [STATE_DETECTING] = METRICS_DETECT,
+    [STATE_CARD_DETECTED] = METRICS_ACTIVATE,
+    [STATE_SELECTING_APP] = METRICS_SELECT,
+    [STATE_AUTHENTICATING] = METRICS_AUTH,
+    [STATE_READING_DG1] = METRICS_DG1,
+    [STATE_READING_DG2] = METRICS_DG2,
+    [STATE_SUCCESS] = METRICS_NONE,
+    [STATE_ERROR] = METRICS_NONE,
+    [STATE_WAIT_REMOVAL] = METRICS_REMOVAL,
+};
+
+static bool passport_state_machine(void)
+{
+        enum metrics_phase phase = state_phase[reader.state];
+        uint32_t start = metrics_begin();
+        bool more = passport_state_step();
+
+        metrics_end(phase, start);
+        return more;
 }
 
 /* ==================== Main ==================== */
 
-static void i2c_scan_detailed(void)
+/*
+ * Diagnostic scan of the PN532 bus, on demand only: probing all 117
+ * addresses costs too much at boot, where the cached address is tried first.
+ */
+#if defined(CONFIG_PN532_TRANSPORT_I2C) && defined(CONFIG_SHELL)
+static int cmd_i2c_scan(const struct shell *sh, size_t argc, char **argv)
 {
-        LOG_INF("=== Detailed I2C Bus Scan ===");
-        bool found = false;
+        const struct device *i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+
+        if (!device_is_ready(i2c_dev))
+        {
+                shell_error(sh, "I2C device not ready");
+                return -ENODEV;
+        }
+
+        shell_print(sh, "=== Detailed I2C Bus Scan ===");
         int success_count = 0;
         int nack_count = 0;
         int other_error_count = 0;
@@ -642,8 +1232,7 @@ static void i2c_scan_detailed(void)
 
                 if (ret == 0)
                 {
-                        LOG_INF("  ✓ Device found at: 0x%02X", addr);
-                        found = true;
+                        shell_print(sh, "  ✓ Device found at: 0x%02X", addr);
                         success_count++;
                 }
                 else if (ret == -EIO || ret == -ENXIO)
@@ -652,24 +1241,22 @@ static void i2c_scan_detailed(void)
                 }
                 else
                 {
-                        LOG_WRN("  ? Address 0x%02X returned error: %d", addr, ret);
+                        shell_warn(sh, "  ? Address 0x%02X returned error: %d", addr, ret);
                         other_error_count++;
                 }
         }
 
-        LOG_INF("=== Scan Results ===");
-        LOG_INF("  Devices found: %d", success_count);
-        LOG_INF("  NACKs (normal): %d", nack_count);
-        LOG_INF("  Other errors: %d", other_error_count);
+        shell_print(sh, "=== Scan Results ===");
+        shell_print(sh, "  Devices found: %d", success_count);
+        shell_print(sh, "  NACKs (normal): %d", nack_count);
+        shell_print(sh, "  Other errors: %d", other_error_count);
 
-        if (!found)
-        {
-                LOG_WRN("No I2C devices found in scan");
-                LOG_WRN("PN532 will be detected during init with retries");
-        }
-        LOG_INF("=========================");
+        return 0;
 }
 
+SHELL_CMD_REGISTER(i2c_scan, NULL, "Probe every 7-bit address on the PN532 bus", cmd_i2c_scan);
+#endif
+
 int main(void)
 {
         int ret;
@@ -677,33 +1264,13 @@ int main(void)
         LOG_INF("=== NFC Passport Reader with BLE ===");
         LOG_INF("Build: " __DATE__ " " __TIME__);
 
-        /* Get I2C device */
-        i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c0));
-
-        if (!device_is_ready(i2c_dev))
-        {
-                LOG_ERR("I2C device not ready");
-                return -ENODEV;
-        }
-
-        LOG_INF("I2C device ready");
-        i2c_scan_detailed();
-
-        /* Initialize GPIOs */
-        if (!gpio_is_ready_dt(&pn532_irq))
-        {
-                LOG_ERR("PN532 IRQ GPIO not ready");
-                return -ENODEV;
-        }
-        if (!gpio_is_ready_dt(&pn532_rst))
+        /* Initialize PN532 GPIOs and host interface */
+        ret = pn532_hw_init();
+        if (ret)
         {
-                LOG_ERR("PN532 RST GPIO not ready");
-                return -ENODEV;
+                return ret;
         }
 
-        gpio_pin_configure_dt(&pn532_irq, GPIO_INPUT);
-        gpio_pin_configure_dt(&pn532_rst, GPIO_OUTPUT_ACTIVE);
-
         gpio_pin_configure_dt(&led0, GPIO_OUTPUT_INACTIVE);
         gpio_pin_configure_dt(&led1, GPIO_OUTPUT_INACTIVE);
         gpio_pin_configure_dt(&led2, GPIO_OUTPUT_INACTIVE);
@@ -711,6 +1278,25 @@ int main(void)
 
         LOG_INF("Hardware initialized");
 
+        ret = bac_init();
+        if (ret)
+        {
+                LOG_WRN("BAC unavailable (err %d)", ret);
+        }
+
+        ret = pace_init();
+        if (ret)
+        {
+                LOG_WRN("PACE unavailable (err %d)", ret);
+        }
+
+#if defined(CONFIG_SM_BENCHMARK)
+        sm_benchmark();
+#endif
+#if defined(CONFIG_PACE_BENCHMARK)
+        pace_benchmark();
+#endif
+
         /* Initialize BLE */
         ret = ble_passport_service_init();
         if (ret)
@@ -720,17 +1306,39 @@ int main(void)
         }
 
         /* Register BLE command callback */
-        ble_passport_set_data_callback(handle_ble_command);
+        ble_passport_set_data_callback(post_ble_command);
+        ble_passport_set_mrz_key_callback(handle_mrz_key);
+
+#if defined(CONFIG_PN532_FAST_BOOT)
+        /* PN532 address and firmware from the last boot, probed first */
+        ret = settings_subsys_init();
+        if (ret == 0)
+        {
+                ret = settings_load_subtree("pn532");
+        }
+        if (ret)
+        {
+                LOG_WRN("Settings unavailable (err %d), full PN532 probe", ret);
+        }
+#endif
 
-        LOG_INF("BLE Passport Reader ready");
+        LOG_INF("BLE Passport Reader ready, advertising %u ms after boot",
+                (uint32_t)k_uptime_get());
         LOG_INF("Connect via Android app and send START_SCAN command");
 
         reader.state = STATE_IDLE;
 
         while (1)
         {
-                passport_state_machine();
-                k_sleep(K_MSEC(100));
+                struct reader_event evt;
+
+                /* Transitions run back to back until a state waits for an event */
+                while (passport_state_machine())
+                {
+                }
+
+                k_msgq_get(&reader_evq, &evt, K_FOREVER);
+                handle_reader_event(&evt);
         }
 
         return 0;
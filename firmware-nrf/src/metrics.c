@@ -0,0 +1,213 @@
+/**
+ * @file metrics.c
+ * @brief Per-phase latency histograms (reader states, PN532 commands, BLE TX)
+ *
+ * Samples go into log-linear buckets: four per power of two, from 1 us up
+ * to about a minute, where the 32-bit cycle counter wraps anyway.
+ * Percentiles are read back as the upper edge of the bucket they fall in,
+ * so they are at most 25% high.
+ */
+
+#include "metrics.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "pn532.h"
+
+LOG_MODULE_REGISTER(metrics, LOG_LEVEL_INF);
+
+#define METRICS_SUB_BITS 2 // 4 buckets per power of two
+#define METRICS_SUB_COUNT BIT(METRICS_SUB_BITS)
+#define METRICS_BUCKETS (25 * METRICS_SUB_COUNT) // Up to 2^26 us
+
+struct metrics_hist
+{
+        uint32_t count;
+        uint32_t max_us;
+        uint32_t buckets[METRICS_BUCKETS];
+};
+
+BUILD_ASSERT(METRICS_PHASE_COUNT <= PASSPORT_METRICS_MAX);
+
+static struct metrics_hist hists[METRICS_PHASE_COUNT];
+static struct k_spinlock metrics_lock;
+
+/* PN532 command in flight; only the reader thread talks to the PN532 */
+static uint32_t pn532_begin;
+static uint8_t pn532_cmd;
+
+static const char *const phase_names[METRICS_PHASE_COUNT] = {
+    [METRICS_INIT] = "init",
+    [METRICS_DETECT] = "detect",
+    [METRICS_ACTIVATE] = "activate",
+    [METRICS_SELECT] = "select",
+    [METRICS_AUTH] = "auth",
+    [METRICS_DG1] = "dg1",
+    [METRICS_DG2] = "dg2",
+    [METRICS_REMOVAL] = "removal",
+    [METRICS_PN532_CMD] = "pn532_cmd",
+    [METRICS_PN532_EXCHANGE] = "pn532_xchg",
+    [METRICS_BLE_TX] = "ble_tx",
+};
+
+const char *metrics_phase_name(enum metrics_phase phase)
+{
+        return phase < METRICS_PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+/* ==================== Buckets ==================== */
+
+static uint32_t metrics_bucket(uint32_t us)
+{
+        uint32_t msb;
+        uint32_t sub;
+
+        if (us < METRICS_SUB_COUNT)
+        {
+                return us;
+        }
+
+        msb = 31 - __builtin_clz(us);
+        sub = (us >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_COUNT - 1);
+
+        return MIN((msb - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT + sub, METRICS_BUCKETS - 1);
+}
+
+/* Largest value that lands in the bucket */
+static uint32_t metrics_bucket_max(uint32_t bucket)
+{
+        uint32_t msb;
+        uint32_t sub;
+
+        if (bucket < METRICS_SUB_COUNT)
+        {
+                return bucket;
+        }
+
+        msb = bucket / METRICS_SUB_COUNT + METRICS_SUB_BITS - 1;
+        sub = bucket % METRICS_SUB_COUNT;
+
+        return BIT(msb) + ((sub + 1) << (msb - METRICS_SUB_BITS)) - 1;
+}
+
+static uint32_t metrics_percentile(const struct metrics_hist *hist, uint32_t pct)
+{
+        uint32_t rank = DIV_ROUND_UP(hist->count * (uint64_t)pct, 100);
+        uint32_t seen = 0;
+
+        for (uint32_t i = 0; i < METRICS_BUCKETS; i++)
+        {
+                seen += hist->buckets[i];
+                if (seen >= rank)
+                {
+                        return MIN(metrics_bucket_max(i), hist->max_us);
+                }
+        }
+
+        return hist->max_us;
+}
+
+/* ==================== Recording ==================== */
+
+void metrics_record(enum metrics_phase phase, uint32_t cycles)
+{
+        uint32_t us = k_cyc_to_us_floor32(cycles);
+        struct metrics_hist *hist;
+
+        if (phase >= METRICS_PHASE_COUNT)
+        {
+                return;
+        }
+
+        hist = &hists[phase];
+
+        k_spinlock_key_t key = k_spin_lock(&metrics_lock);
+        hist->count++;
+        hist->max_us = MAX(hist->max_us, us);
+        hist->buckets[metrics_bucket(us)]++;
+        k_spin_unlock(&metrics_lock, key);
+}
+
+void metrics_pn532_begin(uint8_t cmd)
+{
+        pn532_cmd = cmd;
+        pn532_begin = k_cycle_get_32();
+}
+
+void metrics_pn532_end(void)
+{
+        metrics_end(pn532_cmd == PN532_CMD_INDATAEXCHANGE ? METRICS_PN532_EXCHANGE :
+                                                            METRICS_PN532_CMD,
+                    pn532_begin);
+}
+
+size_t metrics_snapshot(passport_metrics_entry_t *entries, size_t max)
+{
+        size_t n = 0;
+
+        k_spinlock_key_t key = k_spin_lock(&metrics_lock);
+        for (int phase = 0; phase < METRICS_PHASE_COUNT && n < max; phase++)
+        {
+                const struct metrics_hist *hist = &hists[phase];
+
+                if (hist->count == 0)
+                {
+                        continue;
+                }
+
+                entries[n].phase = phase;
+                entries[n].count = sys_cpu_to_le32(hist->count);
+                entries[n].p50_us = sys_cpu_to_le32(metrics_percentile(hist, 50));
+                entries[n].p95_us = sys_cpu_to_le32(metrics_percentile(hist, 95));
+                entries[n].p99_us = sys_cpu_to_le32(metrics_percentile(hist, 99));
+                entries[n].max_us = sys_cpu_to_le32(hist->max_us);
+                n++;
+        }
+        k_spin_unlock(&metrics_lock, key);
+
+        return n;
+}
+
+void metrics_reset(void)
+{
+        k_spinlock_key_t key = k_spin_lock(&metrics_lock);
+        memset(hists, 0, sizeof(hists));
+        k_spin_unlock(&metrics_lock, key);
+}
+
+/* ==================== Shell ==================== */
+
+#if defined(CONFIG_SHELL)
+static int cmd_metrics_show(const struct shell *sh, size_t argc, char **argv)
+{
+        passport_metrics_entry_t entries[METRICS_PHASE_COUNT];
+        size_t n = metrics_snapshot(entries, ARRAY_SIZE(entries));
+
+        shell_print(sh, "%-10s %8s %9s %9s %9s %9s", "phase", "count", "p50 us", "p95 us",
+                    "p99 us", "max us");
+        for (size_t i = 0; i < n; i++)
+        {
+                shell_print(sh, "%-10s %8u %9u %9u %9u %9u", metrics_phase_name(entries[i].phase),
+                            sys_le32_to_cpu(entries[i].count), sys_le32_to_cpu(entries[i].p50_us),
+                            sys_le32_to_cpu(entries[i].p95_us), sys_le32_to_cpu(entries[i].p99_us),
+                            sys_le32_to_cpu(entries[i].max_us));
+        }
+
+        return 0;
+}
+
+static int cmd_metrics_reset(const struct shell *sh, size_t argc, char **argv)
+{
+        metrics_reset();
+        shell_print(sh, "Metrics cleared");
+        return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(metrics_cmds,
+                               SHELL_CMD(reset, NULL, "Clear all histograms", cmd_metrics_reset),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(metrics, &metrics_cmds, "Per-phase latency percentiles", cmd_metrics_show);
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file metrics.h
+ * @brief Per-phase latency histograms (reader states, PN532 commands, BLE TX)
+ *
+ * With CONFIG_PASSPORT_METRICS disabled every hook below is an empty
+ * inline function and the histograms are not built. The metrics GATT
+ * characteristic and its read handler stay and return no entries, and
+ * the BLE service still keeps its per-central notify timestamps.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <zephyr/kernel.h>
+
+#include "ble_passport_service.h"
+
+enum metrics_phase
+{
+        METRICS_INIT,           // PN532 init
+        METRICS_DETECT,         // One detection attempt / InAutoPoll collect
+        METRICS_ACTIVATE,       // Bit rate negotiation (InPSL)
+        METRICS_SELECT,         // EF.CardAccess probe and applet SELECT
+        METRICS_AUTH,           // BAC or PACE, SM set up
+        METRICS_DG1,            // EF.COM + DG1
+        METRICS_DG2,            // DG2 streamed to BLE
+        METRICS_REMOVAL,        // Kiosk presence check
+        METRICS_PN532_CMD,      // Any other PN532 command, write to response
+        METRICS_PN532_EXCHANGE, // InDataExchange, i.e. one APDU round trip
+        METRICS_BLE_TX,         // One queued notification on the air
+        METRICS_PHASE_COUNT,
+        METRICS_NONE = 0xFF
+};
+
+#if defined(CONFIG_PASSPORT_METRICS)
+
+void metrics_record(enum metrics_phase phase, uint32_t cycles);
+
+static inline uint32_t metrics_begin(void)
+{
+        return k_cycle_get_32();
+}
+
+static inline void metrics_end(enum metrics_phase phase, uint32_t begin)
+{
+        metrics_record(phase, k_cycle_get_32() - begin);
+}
+
+/* PN532 commands are timed from the frame write to the response */
+void metrics_pn532_begin(uint8_t cmd);
+void metrics_pn532_end(void);
+
+/*
+ * Fill entries with count, p50/p95/p99 and max for every phase that has
+ * samples. Returns the number of entries written.
+ */
+size_t metrics_snapshot(passport_metrics_entry_t *entries, size_t max);
+
+void metrics_reset(void);
+const char *metrics_phase_name(enum metrics_phase phase);
+
+#else
+
+static inline uint32_t metrics_begin(void)
+{
+        return 0;
+}
+
+static inline void metrics_end(enum metrics_phase phase, uint32_t begin)
+{
+}
+
+static inline void metrics_pn532_begin(uint8_t cmd)
+{
+}
+
+static inline void metrics_pn532_end(void)
+{
+}
+
+static inline size_t metrics_snapshot(passport_metrics_entry_t *entries, size_t max)
+{
+        return 0;
+}
+
+#endif /* CONFIG_PASSPORT_METRICS */
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,721 @@
+/**
+ * @file mrtd.c
+ * @brief ICAO 9303 eMRTD file access: SELECT, chunked READ BINARY, DG parsing
+ *
+ * APDUs are built in place in the PN532 exchange buffer. Files are read
+ * with as few round-trips as possible: the first READ BINARY already asks
+ * for a full chunk, so it returns the BER length and the start of the
+ * data together, and the remainder follows in chunks of the largest Le
+ * the PN532 frame and the card accept.
+ */
+
+#include "mrtd.h"
+#include "pn532.h"
+
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(mrtd, LOG_LEVEL_DBG);
+
+#define MRTD_APDU_TIMEOUT_MS 3000
+#define MRTD_SHORT_LE_MAX 256
+#define MRTD_MIN_LE 32
+#define MRTD_READ_ATTEMPTS 4
+#define MRTD_OFFSET_MAX 0x7FFF // READ BINARY B0 with 15-bit offset
+
+/* Secure messaging response overhead: DO87 header + padding indicator, DO99, DO8E */
+#define MRTD_SM_DO87_HDR 4
+#define MRTD_SM_PAD_IND 1
+#define MRTD_SM_DO99 4
+#define MRTD_SM_DO8E 10
+
+/* Expiry years are read within this many years either side of the build year */
+#define MRZ_EXPIRY_WINDOW_YEARS 50
+
+/* ==================== APDU Exchange ==================== */
+
+uint16_t mrtd_max_le(uint8_t block_size)
+{
+        uint16_t limit = MIN(MRTD_SHORT_LE_MAX, PN532_EXCHANGE_MAX - 2);
+
+        if (block_size == 0)
+        {
+                return limit;
+        }
+
+        // The protected response has to fit where the plain one would
+        uint16_t avail = limit - MRTD_SM_DO87_HDR - MRTD_SM_PAD_IND - MRTD_SM_DO99 - MRTD_SM_DO8E;
+
+        return ROUND_DOWN(avail, block_size) - 1; // Padding always adds at least one byte
+}
+
+void mrtd_session_init(struct mrtd_session *session, uint8_t tg)
+{
+        session->tg = tg;
+        session->max_le = mrtd_max_le(0);
+        session->apdus = 0;
+        session->sm = NULL;
+}
+
+void mrtd_session_set_sm(struct mrtd_session *session, struct sm_ctx *sm)
+{
+        session->sm = sm;
+        session->max_le = mrtd_max_le(sm ? sm->block_size : 0);
+}
+
+/* Largest R-APDU (SW included) a READ BINARY of le bytes can come back in */
+static uint16_t mrtd_resp_len(const struct mrtd_session *session, uint16_t le)
+{
+        if (!session->sm)
+        {
+                return le + 2;
+        }
+
+        return MRTD_SM_DO87_HDR + MRTD_SM_PAD_IND + ROUND_UP(le + 1, session->sm->block_size) +
+               MRTD_SM_DO99 + MRTD_SM_DO8E + 2;
+}
+
+/* mrtd_transceive() with the expected R-APDU length, 0 if unknown */
+static int mrtd_exchange(struct mrtd_session *session, uint16_t apdu_len, uint16_t expect_len,
+                         const uint8_t **data, uint16_t *data_len, uint16_t *sw)
+{
+        uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        if (session->sm)
+        {
+                ret = sm_wrap(session->sm, pn532_exchange_buffer(), &apdu_len, PN532_EXCHANGE_MAX);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+        }
+
+        session->apdus++;
+        ret = pn532_exchange(session->tg, apdu_len, expect_len, &resp, &resp_len,
+                             MRTD_APDU_TIMEOUT_MS);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        if (session->sm)
+        {
+                ret = sm_unwrap(session->sm, resp, &resp_len, sw);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+
+                *data = resp;
+                *data_len = resp_len;
+                return 0;
+        }
+
+        if (resp_len < 2)
+        {
+                return -EBADMSG;
+        }
+
+        *sw = ((uint16_t)resp[resp_len - 2] << 8) | resp[resp_len - 1];
+        *data = resp;
+        *data_len = resp_len - 2;
+        return 0;
+}
+
+int mrtd_transceive(struct mrtd_session *session, uint16_t apdu_len,
+                    const uint8_t **data, uint16_t *data_len, uint16_t *sw)
+{
+        return mrtd_exchange(session, apdu_len, 0, data, data_len, sw);
+}
+
+int mrtd_sw_error(uint16_t sw)
+{
+        switch (sw)
+        {
+        case MRTD_SW_OK:
+                return 0;
+        case MRTD_SW_SECURITY_STATUS:
+                return -EACCES;
+        case MRTD_SW_FILE_NOT_FOUND:
+                return -ENOENT;
+        default:
+                LOG_WRN("Card returned SW %04X", sw);
+                return -EIO;
+        }
+}
+
+/* ==================== File Access ==================== */
+
+static const uint8_t SELECT_EPASSPORT_APP[] = {
+    0x00, 0xA4, 0x04, 0x0C, 0x07, 0xA0, 0x00, 0x00, 0x02, 0x47, 0x10, 0x01};
+
+int mrtd_select_applet(struct mrtd_session *session)
+{
+        uint8_t *apdu = pn532_exchange_buffer();
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t sw;
+        int ret;
+
+        memcpy(apdu, SELECT_EPASSPORT_APP, sizeof(SELECT_EPASSPORT_APP));
+
+        ret = mrtd_transceive(session, sizeof(SELECT_EPASSPORT_APP), &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return mrtd_sw_error(sw);
+}
+
+int mrtd_select_ef(struct mrtd_session *session, uint16_t fid)
+{
+        uint8_t *apdu = pn532_exchange_buffer();
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t sw;
+        int ret;
+
+        apdu[0] = 0x00;
+        apdu[1] = 0xA4; // SELECT
+        apdu[2] = 0x02; // EF under current DF
+        apdu[3] = 0x0C; // No response data
+        apdu[4] = 0x02;
+        apdu[5] = fid >> 8;
+        apdu[6] = fid & 0xFF;
+
+        ret = mrtd_transceive(session, 7, &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return mrtd_sw_error(sw);
+}
+
+/*
+ * READ BINARY of up to le bytes at offset. The card may answer with fewer
+ * bytes (end of file), tell the exact length it has (6Cxx), or refuse the
+ * size (6700), in which case the session chunk size is halved for good.
+ */
+static int mrtd_read_binary(struct mrtd_session *session, uint16_t offset, uint16_t le,
+                            const uint8_t **data, uint16_t *data_len)
+{
+        uint16_t sw;
+        int ret;
+
+        if (offset > MRTD_OFFSET_MAX)
+        {
+                return -EFBIG;
+        }
+
+        for (int attempt = 0; attempt < MRTD_READ_ATTEMPTS; attempt++)
+        {
+                uint8_t *apdu = pn532_exchange_buffer();
+
+                apdu[0] = 0x00;
+                apdu[1] = 0xB0; // READ BINARY
+                apdu[2] = offset >> 8;
+                apdu[3] = offset & 0xFF;
+                apdu[4] = le & 0xFF; // 256 encodes as 0x00
+
+                // Sized to the chunk, so a long R-APDU still arrives in one bus read
+                ret = mrtd_exchange(session, 5, mrtd_resp_len(session, le), data, data_len, &sw);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+
+                if (sw == MRTD_SW_OK || sw == MRTD_SW_END_OF_FILE)
+                {
+                        return 0;
+                }
+
+                if ((sw & 0xFF00) == 0x6C00)
+                {
+                        le = (sw & 0xFF) ? (sw & 0xFF) : MRTD_SHORT_LE_MAX;
+                        continue;
+                }
+
+                if (sw == MRTD_SW_WRONG_LENGTH && le > MRTD_MIN_LE)
+                {
+                        le = MAX(le / 2, MRTD_MIN_LE);
+                        session->max_le = MIN(session->max_le, le);
+                        LOG_WRN("Card refused Le, chunk size now %u", session->max_le);
+                        continue;
+                }
+
+                return mrtd_sw_error(sw);
+        }
+
+        return -EIO;
+}
+
+/* Select fid and hand every chunk to cb, the first one read with first_le */
+static int mrtd_read_chunks(struct mrtd_session *session, uint16_t fid, uint16_t first_le,
+                            mrtd_chunk_cb_t cb, void *user_data, size_t *len)
+{
+        uint32_t first_apdu = session->apdus;
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t tag;
+        size_t value_len;
+        size_t total;
+        size_t got;
+        int hdr_len;
+        int ret;
+
+        ret = mrtd_select_ef(session, fid);
+        if (ret != 0)
+        {
+                LOG_ERR("SELECT EF %04X failed: %d", fid, ret);
+                return ret;
+        }
+
+        // First chunk: BER header plus as much content as fits
+        ret = mrtd_read_binary(session, 0, first_le, &data, &data_len);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        hdr_len = mrtd_ber_header(data, data_len, &tag, &value_len);
+        if (hdr_len < 0)
+        {
+                return hdr_len;
+        }
+
+        total = hdr_len + value_len;
+        got = MIN(data_len, total);
+        ret = cb(0, data, got, total, user_data);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        while (got < total)
+        {
+                uint16_t le = MIN(session->max_le, total - got);
+
+                ret = mrtd_read_binary(session, got, le, &data, &data_len);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+                if (data_len == 0)
+                {
+                        LOG_ERR("EF %04X truncated at %zu of %zu bytes", fid, got, total);
+                        return -EIO;
+                }
+
+                data_len = MIN(data_len, total - got);
+                ret = cb(got, data, data_len, total, user_data);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+                got += data_len;
+        }
+
+        *len = total;
+        LOG_INF("EF %04X: %zu bytes in %u APDUs (Le %u)", fid, total,
+                session->apdus - first_apdu, session->max_le);
+        return 0;
+}
+
+struct mrtd_copy
+{
+        uint16_t fid;
+        uint8_t *buf;
+        size_t size;
+};
+
+static int mrtd_copy_chunk(size_t offset, const uint8_t *data, size_t len, size_t total,
+                           void *user_data)
+{
+        struct mrtd_copy *copy = user_data;
+
+        if (total > copy->size)
+        {
+                LOG_ERR("EF %04X is %zu bytes, buffer holds %zu", copy->fid, total, copy->size);
+                return -ENOBUFS;
+        }
+
+        memcpy(&copy->buf[offset], data, len);
+        return 0;
+}
+
+int mrtd_read_file(struct mrtd_session *session, uint16_t fid, uint8_t *buf, size_t size,
+                   size_t *len)
+{
+        struct mrtd_copy copy = {
+            .fid = fid,
+            .buf = buf,
+            .size = size,
+        };
+
+        return mrtd_read_chunks(session, fid, MIN(session->max_le, size), mrtd_copy_chunk, &copy,
+                                len);
+}
+
+int mrtd_stream_file(struct mrtd_session *session, uint16_t fid, mrtd_chunk_cb_t cb,
+                     void *user_data, size_t *len)
+{
+        return mrtd_read_chunks(session, fid, session->max_le, cb, user_data, len);
+}
+
+/* ==================== Data Group Parsing ==================== */
+
+int mrtd_ber_header(const uint8_t *buf, size_t len, uint16_t *tag, size_t *value_len)
+{
+        size_t pos = 0;
+
+        if (len < 2)
+        {
+                return -EBADMSG;
+        }
+
+        *tag = buf[pos++];
+        if ((*tag & 0x1F) == 0x1F)
+        {
+                *tag = (*tag << 8) | buf[pos++];
+        }
+
+        if (pos >= len)
+        {
+                return -EBADMSG;
+        }
+
+        uint8_t first = buf[pos++];
+
+        if (first < 0x80)
+        {
+                *value_len = first;
+                return pos;
+        }
+
+        uint8_t num = first & 0x7F;
+
+        if (num == 0 || num > 2 || pos + num > len)
+        {
+                return -EBADMSG;
+        }
+
+        *value_len = 0;
+        while (num--)
+        {
+                *value_len = (*value_len << 8) | buf[pos++];
+        }
+
+        return pos;
+}
+
+/* Data group tags in EF.COM list order: DG1 = 0x61, DG2 = 0x75 ... DG16 = 0x70 */
+static const uint8_t dg_tags[] = {0x61, 0x75, 0x63, 0x76, 0x65, 0x66, 0x67, 0x68,
+                                  0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70};
+
+int mrtd_parse_com(const uint8_t *buf, size_t len, uint32_t *dg_mask)
+{
+        uint16_t tag;
+        size_t value_len;
+        int hdr_len;
+
+        hdr_len = mrtd_ber_header(buf, len, &tag, &value_len);
+        if (hdr_len < 0 || tag != 0x60 || hdr_len + value_len > len)
+        {
+                return -EBADMSG;
+        }
+
+        const uint8_t *p = &buf[hdr_len];
+        const uint8_t *end = p + value_len;
+
+        *dg_mask = 0;
+        while (p < end)
+        {
+                hdr_len = mrtd_ber_header(p, end - p, &tag, &value_len);
+                if (hdr_len < 0 || p + hdr_len + value_len > end)
+                {
+                        return -EBADMSG;
+                }
+
+                if (tag == 0x5C)
+                {
+                        for (size_t i = 0; i < value_len; i++)
+                        {
+                                for (size_t dg = 0; dg < ARRAY_SIZE(dg_tags); dg++)
+                                {
+                                        if (p[hdr_len + i] == dg_tags[dg])
+                                        {
+                                                *dg_mask |= MRTD_DG(dg + 1);
+                                        }
+                                }
+                        }
+                }
+
+                p += hdr_len + value_len;
+        }
+
+        return 0;
+}
+
+/* Field offsets into the concatenated MRZ lines */
+struct mrz_span
+{
+        uint8_t off;
+        uint8_t len;
+};
+
+struct mrz_layout
+{
+        uint8_t len;
+        uint8_t name;
+        uint8_t name_len;
+        uint8_t doc;
+        uint8_t nationality;
+        uint8_t dob;
+        uint8_t sex;
+        uint8_t expiry;
+        struct mrz_span overflow; // Rest of a document number longer than 9, TD1/TD2 only
+        uint8_t composite;        // Composite check digit
+        struct mrz_span parts[4]; // What the composite covers, in order
+};
+
+static const struct mrz_layout mrz_td1 = {
+    90, 60, 30, 5, 45, 30, 37, 38, {15, 15}, 59, {{5, 25}, {30, 7}, {38, 7}, {48, 11}}};
+static const struct mrz_layout mrz_td2 = {
+    72, 5, 31, 36, 46, 49, 56, 57, {64, 7}, 71, {{36, 10}, {49, 7}, {57, 14}}};
+static const struct mrz_layout mrz_td3 = {
+    88, 5, 39, 44, 54, 57, 64, 65, {0, 0}, 87, {{44, 10}, {57, 7}, {65, 22}}};
+
+static int mrz_char_value(char c)
+{
+        if (c >= '0' && c <= '9')
+        {
+                return c - '0';
+        }
+        if (c >= 'A' && c <= 'Z')
+        {
+                return c - 'A' + 10;
+        }
+
+        return 0; // '<' filler
+}
+
+/* ICAO 9303 check digit: weights 7, 3, 1, running on across the spans */
+static char mrz_check_digit_spans(const char *mrz, const struct mrz_span *spans, size_t count)
+{
+        static const uint8_t weights[] = {7, 3, 1};
+        size_t pos = 0;
+        int sum = 0;
+
+        for (size_t s = 0; s < count; s++)
+        {
+                for (size_t i = 0; i < spans[s].len; i++)
+                {
+                        sum += mrz_char_value(mrz[spans[s].off + i]) * weights[pos++ % 3];
+                }
+        }
+
+        return '0' + (sum % 10);
+}
+
+char mrtd_check_digit(const char *field, size_t len)
+{
+        const struct mrz_span span = {0, len};
+
+        return mrz_check_digit_spans(field, &span, 1);
+}
+
+static bool mrz_check(const char *field, size_t len, char check)
+{
+        return mrtd_check_digit(field, len) == check;
+}
+
+/*
+ * A document number longer than 9 characters has '<' in place of its
+ * check digit and continues in the optional data, where its check digit
+ * follows the last character. The check covers the whole number.
+ */
+static bool mrz_check_doc(const char *mrz, const struct mrz_layout *layout)
+{
+        const char *more = &mrz[layout->overflow.off];
+        struct mrz_span spans[] = {{layout->doc, 9}, {layout->overflow.off, 0}};
+
+        if (mrz[layout->doc + 9] != '<' || layout->overflow.len == 0)
+        {
+                return mrz_check(&mrz[layout->doc], 9, mrz[layout->doc + 9]);
+        }
+
+        while (spans[1].len < layout->overflow.len && more[spans[1].len] != '<')
+        {
+                spans[1].len++;
+        }
+        if (spans[1].len < 2)
+        {
+                return false;
+        }
+
+        spans[1].len--;
+        return mrz_check_digit_spans(mrz, spans, ARRAY_SIZE(spans)) == more[spans[1].len];
+}
+
+static bool mrz_check_composite(const char *mrz, const struct mrz_layout *layout)
+{
+        size_t count = 0;
+
+        while (count < ARRAY_SIZE(layout->parts) && layout->parts[count].len)
+        {
+                count++;
+        }
+
+        return mrz_check_digit_spans(mrz, layout->parts, count) == mrz[layout->composite];
+}
+
+/* Copy an MRZ field, turning fillers into spaces and trimming the tail */
+static void mrz_copy(char *dst, size_t dst_size, const char *src, size_t len)
+{
+        len = MIN(len, dst_size - 1);
+
+        for (size_t i = 0; i < len; i++)
+        {
+                dst[i] = src[i] == '<' ? ' ' : src[i];
+        }
+
+        while (len > 0 && dst[len - 1] == ' ')
+        {
+                len--;
+        }
+        dst[len] = '\0';
+}
+
+/* Two digit year of a YYMMDD date, -1 unless all six are digits */
+static int mrz_yy(const char *date)
+{
+        for (int i = 0; i < 6; i++)
+        {
+                if (date[i] < '0' || date[i] > '9')
+                {
+                        return -1;
+                }
+        }
+
+        return (date[0] - '0') * 10 + (date[1] - '0');
+}
+
+/* The latest year ending in yy that is not after latest */
+static int mrz_century(int yy, int latest)
+{
+        return latest - (latest - yy) % 100;
+}
+
+/* There is no clock: the build year is the earliest the current year can be */
+static int mrz_build_year(void)
+{
+        static const char date[] = __DATE__; // "Mmm dd yyyy"
+
+        return (date[7] - '0') * 1000 + (date[8] - '0') * 100 + (date[9] - '0') * 10 +
+               (date[10] - '0');
+}
+
+/* YYMMDD to YYYYMMDD in the given year */
+static void mrz_date(char *dst, const char *src, int year)
+{
+        dst[0] = '0' + year / 1000;
+        dst[1] = '0' + year / 100 % 10;
+        memcpy(&dst[2], src, 6);
+        dst[8] = '\0';
+}
+
+int mrtd_parse_dg1(const uint8_t *buf, size_t len, passport_data_t *data)
+{
+        const struct mrz_layout *layout;
+        uint16_t tag;
+        size_t value_len;
+        int hdr_len;
+
+        // 61 L 5F1F L <MRZ>
+        hdr_len = mrtd_ber_header(buf, len, &tag, &value_len);
+        if (hdr_len < 0 || tag != 0x61)
+        {
+                return -EBADMSG;
+        }
+        buf += hdr_len;
+        len -= hdr_len;
+
+        hdr_len = mrtd_ber_header(buf, len, &tag, &value_len);
+        if (hdr_len < 0 || tag != 0x5F1F || hdr_len + value_len > len)
+        {
+                return -EBADMSG;
+        }
+
+        const char *mrz = (const char *)&buf[hdr_len];
+
+        switch (value_len)
+        {
+        case 90:
+                layout = &mrz_td1;
+                break;
+        case 72:
+                layout = &mrz_td2;
+                break;
+        case 88:
+                layout = &mrz_td3;
+                break;
+        default:
+                LOG_ERR("Unexpected MRZ length %zu", value_len);
+                return -EBADMSG;
+        }
+
+        if (!mrz_check_doc(mrz, layout) ||
+            !mrz_check(&mrz[layout->dob], 6, mrz[layout->dob + 6]) ||
+            !mrz_check(&mrz[layout->expiry], 6, mrz[layout->expiry + 6]) ||
+            !mrz_check_composite(mrz, layout))
+        {
+                LOG_WRN("MRZ check digit mismatch");
+                return -EBADMSG;
+        }
+
+        int dob_yy = mrz_yy(&mrz[layout->dob]);
+        int expiry_yy = mrz_yy(&mrz[layout->expiry]);
+
+        if (dob_yy < 0 || expiry_yy < 0)
+        {
+                LOG_WRN("MRZ date not numeric");
+                return -EBADMSG;
+        }
+
+        // Expiry near the build year, birth the latest year not after the expiry
+        int expiry_year = mrz_century(expiry_yy, mrz_build_year() + MRZ_EXPIRY_WINDOW_YEARS - 1);
+        int dob_year = mrz_century(dob_yy, expiry_year);
+
+        mrz_copy(data->document_number, sizeof(data->document_number), &mrz[layout->doc], 9);
+        mrz_copy(data->nationality, sizeof(data->nationality), &mrz[layout->nationality], 3);
+        mrz_copy(data->sex, sizeof(data->sex), &mrz[layout->sex], 1);
+        mrz_date(data->date_of_birth, &mrz[layout->dob], dob_year);
+        mrz_date(data->expiry_date, &mrz[layout->expiry], expiry_year);
+
+        // Name: SURNAME<<GIVEN<NAMES<<<
+        const char *name = &mrz[layout->name];
+        size_t split = 0;
+
+        while (split < layout->name_len &&
+               !(split + 1 < layout->name_len && name[split] == '<' && name[split + 1] == '<'))
+        {
+                split++;
+        }
+
+        mrz_copy(data->surname, sizeof(data->surname), name, split);
+        if (split + 2 < layout->name_len)
+        {
+                mrz_copy(data->given_names, sizeof(data->given_names), &name[split + 2],
+                         layout->name_len - split - 2);
+        }
+        else
+        {
+                data->given_names[0] = '\0';
+        }
+
+        return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file mrtd.h
+ * @brief ICAO 9303 eMRTD file access: SELECT, chunked READ BINARY, DG parsing
+ */
+
+#ifndef MRTD_H_
+#define MRTD_H_
+
+#include <zephyr/kernel.h>
+
+#include "ble_passport_service.h"
+#include "sm.h"
+
+/* Elementary file identifiers (MF, then LDS1) */
+#define MRTD_FID_CARD_ACCESS 0x011C
+#define MRTD_FID_COM 0x011E
+#define MRTD_FID_DG1 0x0101
+#define MRTD_FID_DG2 0x0102
+
+/* Data group presence bits from EF.COM */
+#define MRTD_DG(n) BIT(n)
+
+/* Status words */
+#define MRTD_SW_OK 0x9000
+#define MRTD_SW_END_OF_FILE 0x6282
+#define MRTD_SW_WRONG_LENGTH 0x6700
+#define MRTD_SW_SECURITY_STATUS 0x6982
+#define MRTD_SW_FILE_NOT_FOUND 0x6A82
+
+/* Size of the largest file read into RAM (EF.COM, DG1) */
+#define MRTD_SMALL_EF_MAX 256
+
+struct mrtd_session
+{
+        uint8_t tg;      // PN532 target number
+        uint16_t max_le; // READ BINARY chunk size, shrinks if the card refuses it
+        uint32_t apdus;  // Round-trips in this session
+        struct sm_ctx *sm; // Secure messaging once BAC/PACE succeeded, else NULL
+};
+
+/*
+ * Largest Le whose response fits one short APDU response and one PN532
+ * InDataExchange frame. block_size is the secure messaging cipher block
+ * (8 for 3DES, 16 for AES) or 0 for plain APDUs.
+ */
+uint16_t mrtd_max_le(uint8_t block_size);
+
+void mrtd_session_init(struct mrtd_session *session, uint8_t tg);
+
+/* Protect every following APDU with sm; max_le shrinks to the SM limit */
+void mrtd_session_set_sm(struct mrtd_session *session, struct sm_ctx *sm);
+
+/*
+ * Send the apdu_len byte APDU built at pn532_exchange_buffer(). On success
+ * data and data_len describe the response body and sw the status word.
+ * With secure messaging active the APDU is wrapped and the response
+ * verified and decrypted in place, so callers see plain APDUs either way.
+ */
+int mrtd_transceive(struct mrtd_session *session, uint16_t apdu_len,
+                    const uint8_t **data, uint16_t *data_len, uint16_t *sw);
+
+/* Status word to errno: -EACCES for 6982, -ENOENT for 6A82, -EIO otherwise */
+int mrtd_sw_error(uint16_t sw);
+
+/* SELECT the eMRTD LDS1 application (AID A0000002471001) */
+int mrtd_select_applet(struct mrtd_session *session);
+
+int mrtd_select_ef(struct mrtd_session *session, uint16_t fid);
+
+/*
+ * Read a whole EF: the first chunk carries the BER tag/length, the rest
+ * is fetched in chunks of session->max_le. Returns -ENOBUFS if the file
+ * is larger than size, -EACCES if access control (BAC/PACE) is required.
+ */
+int mrtd_read_file(struct mrtd_session *session, uint16_t fid, uint8_t *buf, size_t size,
+                   size_t *len);
+
+/* Chunk callback for mrtd_stream_file(); data is only valid during the call */
+typedef int (*mrtd_chunk_cb_t)(size_t offset, const uint8_t *data, size_t len, size_t total,
+                               void *user_data);
+
+/*
+ * Read an EF of any size without buffering it: cb gets every chunk in
+ * order, already unwrapped, straight from the PN532 frame. A non-zero
+ * return from cb stops the read and is returned.
+ */
+int mrtd_stream_file(struct mrtd_session *session, uint16_t fid, mrtd_chunk_cb_t cb,
+                     void *user_data, size_t *len);
+
+/* Parse a BER-TLV header, returning its size and the value length */
+int mrtd_ber_header(const uint8_t *buf, size_t len, uint16_t *tag, size_t *value_len);
+
+/* EF.COM: MRTD_DG(n) set for every data group listed in tag 5C */
+int mrtd_parse_com(const uint8_t *buf, size_t len, uint32_t *dg_mask);
+
+/* ICAO 9303 check digit ('0'..'9') over an MRZ field */
+char mrtd_check_digit(const char *field, size_t len);
+
+/*
+ * DG1: decode the TD1/TD2/TD3 MRZ into passport_data_t. -EBADMSG if any
+ * check digit, the composite one included, does not match.
+ */
+int mrtd_parse_dg1(const uint8_t *buf, size_t len, passport_data_t *data);
+
+#endif /* MRTD_H_ */
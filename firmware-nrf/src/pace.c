@@ -0,0 +1,916 @@
+/**
+ * @file pace.c
+ * @brief ICAO 9303 PACE v2: Generic Mapping, ECDH, AES secure messaging
+ *
+ * Random numbers, the KDF, nonce decryption and the authentication tokens
+ * go through PSA Crypto. Generic Mapping needs the full point H and a
+ * scalar multiplication on the mapped generator, which PSA key agreement
+ * cannot express, so the curve arithmetic uses the mbedTLS ECP module on
+ * groups loaded at boot. This build links CONFIG_MBEDTLS_BUILTIN, so that
+ * is the software implementation; each curve's fixed point table is built
+ * on the first handshake that needs it.
+ */
+
+#include "pace.h"
+#include "pn532.h"
+#include "session_mem.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include <mbedtls/ecp.h>
+#include <mbedtls/platform_util.h>
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+#include <mbedtls/memory_buffer_alloc.h>
+#endif
+#include <mbedtls/psa_util.h>
+#include <psa/crypto.h>
+
+LOG_MODULE_REGISTER(pace, LOG_LEVEL_DBG);
+
+/* id-PACE-ECDH-GM-AES-CBC-CMAC-{128,192,256}: 0.4.0.127.0.7.2.2.4.2.{2,3,4} */
+static const uint8_t pace_oid_prefix[] = {0x04, 0x00, 0x7F, 0x00, 0x07, 0x02, 0x02, 0x04, 0x02};
+#define PACE_OID_LEN (sizeof(pace_oid_prefix) + 1)
+#define PACE_OID_AES_128 0x02
+#define PACE_OID_AES_256 0x04
+#define PACE_VERSION 2
+
+#define PACE_KDF_ENC 1
+#define PACE_KDF_MAC 2
+#define PACE_KDF_PI 3
+
+#define PACE_AES_BLOCK 16
+#define PACE_NONCE_MAX 32
+#define PACE_FIELD_MAX 48                        // Up to 384-bit curves
+#define PACE_POINT_MAX (1 + 2 * PACE_FIELD_MAX) // Uncompressed 04 || X || Y
+#define PACE_TOKEN_LEN 8
+
+/* Dynamic authentication data (7C) tags per GENERAL AUTHENTICATE step */
+#define PACE_DO_NONCE 0x80
+#define PACE_DO_MAP_PCD 0x81
+#define PACE_DO_MAP_PICC 0x82
+#define PACE_DO_EPH_PCD 0x83
+#define PACE_DO_EPH_PICC 0x84
+#define PACE_DO_TOKEN_PCD 0x85
+#define PACE_DO_TOKEN_PICC 0x86
+
+#define PACE_RNG mbedtls_psa_get_random, MBEDTLS_PSA_RANDOM_STATE
+
+struct pace_curve
+{
+        uint8_t param_id;
+        mbedtls_ecp_group_id id;
+        const char *name;
+};
+
+/* Standardized domain parameters this reader supports */
+static const struct pace_curve pace_curves[] = {
+    {12, MBEDTLS_ECP_DP_SECP256R1, "NIST P-256"},
+    {13, MBEDTLS_ECP_DP_BP256R1, "brainpoolP256r1"},
+    {15, MBEDTLS_ECP_DP_SECP384R1, "NIST P-384"},
+    {16, MBEDTLS_ECP_DP_BP384R1, "brainpoolP384r1"},
+};
+
+/* ==================== Global Variables ==================== */
+static mbedtls_ecp_group pace_groups[ARRAY_SIZE(pace_curves)];
+static bool pace_loaded[ARRAY_SIZE(pace_curves)];
+static bool pace_tabled[ARRAY_SIZE(pace_curves)]; // Fixed point table of G built
+static bool pace_ready;
+
+/* ==================== Curve Arithmetic ==================== */
+
+/*
+ * MBEDTLS_ECP_ALT is only set by nrf_security (nRF Connect SDK) with the
+ * CC310 driver. The standalone Zephyr build uses CONFIG_MBEDTLS_BUILTIN,
+ * so it always reports the software implementation.
+ */
+const char *pace_backend_name(void)
+{
+#if defined(MBEDTLS_ECP_ALT)
+        return "CryptoCell CC310";
+#else
+        return "mbedTLS software";
+#endif
+}
+
+/* Random private key and its public point on base */
+static int pace_keypair(mbedtls_ecp_group *grp, const mbedtls_ecp_point *base, mbedtls_mpi *sk,
+                        mbedtls_ecp_point *pk)
+{
+        if (mbedtls_ecp_gen_privkey(grp, sk, PACE_RNG) != 0 ||
+            mbedtls_ecp_mul(grp, pk, sk, base, PACE_RNG) != 0)
+        {
+                return -EIO;
+        }
+
+        return 0;
+}
+
+static int pace_write_point(mbedtls_ecp_group *grp, const mbedtls_ecp_point *p, uint8_t *buf,
+                            size_t size, size_t *len)
+{
+        return mbedtls_ecp_point_write_binary(grp, p, MBEDTLS_ECP_PF_UNCOMPRESSED, len, buf,
+                                              size) == 0 ?
+                   0 :
+                   -EIO;
+}
+
+/* Public key from the chip: must decode and lie on the curve */
+static int pace_read_point(mbedtls_ecp_group *grp, const uint8_t *buf, size_t len,
+                           mbedtls_ecp_point *p)
+{
+        if (mbedtls_ecp_point_read_binary(grp, p, buf, len) != 0 ||
+            mbedtls_ecp_check_pubkey(grp, p) != 0)
+        {
+                LOG_ERR("Invalid public key from chip");
+                return -EBADMSG;
+        }
+
+        return 0;
+}
+
+/* Generic Mapping: G~ = s * G + H with H = SK_map * PK_map(chip) */
+static int pace_map_generator(mbedtls_ecp_group *grp, const mbedtls_mpi *s,
+                              const mbedtls_mpi *sk_map, const mbedtls_ecp_point *pk_chip,
+                              mbedtls_ecp_point *g_map)
+{
+        mbedtls_ecp_point h;
+        mbedtls_mpi one;
+        int ret = 0;
+
+        mbedtls_ecp_point_init(&h);
+        mbedtls_mpi_init(&one);
+
+        // s * G uses the fixed point table built by pace_group()
+        if (mbedtls_ecp_mul(grp, &h, sk_map, pk_chip, PACE_RNG) != 0 ||
+            mbedtls_mpi_lset(&one, 1) != 0 ||
+            mbedtls_ecp_muladd(grp, g_map, s, &grp->G, &one, &h) != 0)
+        {
+                ret = -EIO;
+        }
+        else if (mbedtls_ecp_is_zero(g_map))
+        {
+                ret = -EBADMSG;
+        }
+
+        mbedtls_ecp_point_free(&h);
+        mbedtls_mpi_free(&one);
+        return ret;
+}
+
+/* Shared secret: x coordinate of SK * PK, field size bytes */
+static int pace_shared_secret(mbedtls_ecp_group *grp, const mbedtls_mpi *sk,
+                              const mbedtls_ecp_point *pk, uint8_t *x, size_t *len)
+{
+        mbedtls_ecp_point k;
+        int ret = 0;
+
+        mbedtls_ecp_point_init(&k);
+
+        *len = mbedtls_mpi_size(&grp->P);
+        if (mbedtls_ecp_mul(grp, &k, sk, pk, PACE_RNG) != 0 ||
+            mbedtls_mpi_write_binary(&k.X, x, *len) != 0)
+        {
+                ret = -EIO;
+        }
+
+        mbedtls_ecp_point_free(&k);
+        return ret;
+}
+
+/*
+ * The first multiplication of G builds the comb table kept in the group.
+ * Done once per curve on first use rather than at boot: the tables sit
+ * in the mbedTLS heap, and most documents only ever need one curve.
+ */
+static mbedtls_ecp_group *pace_group(size_t curve)
+{
+        mbedtls_ecp_group *grp = &pace_groups[curve];
+        mbedtls_ecp_point r;
+        mbedtls_mpi one;
+        int64_t start = k_uptime_get();
+        int ret;
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+        size_t heap_before;
+        size_t heap_after;
+        size_t blocks;
+#endif
+
+        if (pace_tabled[curve])
+        {
+                return grp;
+        }
+
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+        mbedtls_memory_buffer_alloc_cur_get(&heap_before, &blocks);
+#endif
+        mbedtls_ecp_point_init(&r);
+        mbedtls_mpi_init(&one);
+
+        ret = mbedtls_mpi_lset(&one, 1);
+        if (ret == 0)
+        {
+                ret = mbedtls_ecp_mul(grp, &r, &one, &grp->G, PACE_RNG);
+        }
+
+        mbedtls_ecp_point_free(&r);
+        mbedtls_mpi_free(&one);
+
+        if (ret != 0)
+        {
+                LOG_ERR("%s: fixed point table failed (%d)", pace_curves[curve].name, ret);
+                return NULL;
+        }
+
+        pace_tabled[curve] = true;
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+        mbedtls_memory_buffer_alloc_cur_get(&heap_after, &blocks);
+        LOG_INF("%s: fixed point table in %u ms, %zu bytes of mbedTLS heap",
+                pace_curves[curve].name, (uint32_t)(k_uptime_get() - start),
+                heap_after - heap_before);
+#else
+        LOG_INF("%s: fixed point table in %u ms", pace_curves[curve].name,
+                (uint32_t)(k_uptime_get() - start));
+#endif
+        return grp;
+}
+
+int pace_init(void)
+{
+        int loaded = 0;
+
+        if (psa_crypto_init() != PSA_SUCCESS)
+        {
+                LOG_ERR("PSA Crypto init failed");
+                return -EIO;
+        }
+
+        // Constant domain parameters only, nothing is allocated yet
+        for (size_t i = 0; i < ARRAY_SIZE(pace_curves); i++)
+        {
+                mbedtls_ecp_group_init(&pace_groups[i]);
+                if (mbedtls_ecp_group_load(&pace_groups[i], pace_curves[i].id) != 0)
+                {
+                        LOG_WRN("%s not enabled", pace_curves[i].name);
+                        continue;
+                }
+
+                pace_loaded[i] = true;
+                loaded++;
+        }
+
+        pace_ready = loaded > 0;
+        LOG_INF("PACE: %d curves loaded (%s)", loaded, pace_backend_name());
+        return pace_ready ? 0 : -ENOTSUP;
+}
+
+/* ==================== Symmetric Primitives ==================== */
+
+/* KDF(K, c) = H(K || c): SHA-1 for AES-128, SHA-256 otherwise */
+static int pace_kdf(const uint8_t *secret, size_t len, uint32_t c, uint8_t key_len, uint8_t *key)
+{
+        uint8_t buf[PACE_FIELD_MAX + 4];
+        uint8_t hash[PSA_HASH_LENGTH(PSA_ALG_SHA_256)];
+        psa_algorithm_t alg = key_len == 16 ? PSA_ALG_SHA_1 : PSA_ALG_SHA_256;
+        size_t hash_len;
+        psa_status_t status;
+
+        if (len > PACE_FIELD_MAX)
+        {
+                return -EINVAL;
+        }
+
+        memcpy(buf, secret, len);
+        sys_put_be32(c, &buf[len]);
+
+        status = psa_hash_compute(alg, buf, len + 4, hash, sizeof(hash), &hash_len);
+        if (status == PSA_SUCCESS)
+        {
+                memcpy(key, hash, key_len);
+        }
+
+        mbedtls_platform_zeroize(buf, sizeof(buf));
+        mbedtls_platform_zeroize(hash, sizeof(hash));
+        return status == PSA_SUCCESS ? 0 : -EIO;
+}
+
+static int pace_import_aes(const uint8_t *key, uint8_t key_len, psa_key_usage_t usage,
+                           psa_algorithm_t alg, psa_key_id_t *id)
+{
+        psa_key_attributes_t attr = PSA_KEY_ATTRIBUTES_INIT;
+
+        psa_set_key_type(&attr, PSA_KEY_TYPE_AES);
+        psa_set_key_bits(&attr, key_len * 8);
+        psa_set_key_usage_flags(&attr, usage);
+        psa_set_key_algorithm(&attr, alg);
+
+        return psa_import_key(&attr, key, key_len, id) == PSA_SUCCESS ? 0 : -EIO;
+}
+
+/* s = D(K_pi, z), AES-CBC with a zero IV */
+static int pace_decrypt_nonce(const uint8_t *k_pi, uint8_t key_len, const uint8_t *z, size_t len,
+                              uint8_t *s)
+{
+        uint8_t in[PACE_AES_BLOCK + PACE_NONCE_MAX] = {0}; // PSA expects IV || ciphertext
+        psa_key_id_t id;
+        size_t out_len;
+        psa_status_t status;
+        int ret;
+
+        if (len == 0 || len > PACE_NONCE_MAX || len % PACE_AES_BLOCK)
+        {
+                return -EBADMSG;
+        }
+
+        ret = pace_import_aes(k_pi, key_len, PSA_KEY_USAGE_DECRYPT, PSA_ALG_CBC_NO_PADDING, &id);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        memcpy(&in[PACE_AES_BLOCK], z, len);
+        status = psa_cipher_decrypt(id, PSA_ALG_CBC_NO_PADDING, in, PACE_AES_BLOCK + len, s, len,
+                                    &out_len);
+        psa_destroy_key(id);
+
+        return status == PSA_SUCCESS ? 0 : -EIO;
+}
+
+/* T = CMAC(KS_mac, 7F49 { 06 OID, 86 PK })[0..7] */
+static int pace_token(mbedtls_ecp_group *grp, const struct pace_params *params,
+                      const uint8_t *ks_mac, const mbedtls_ecp_point *pk,
+                      uint8_t token[PACE_TOKEN_LEN])
+{
+        uint8_t data[3 + 2 + PACE_OID_LEN + 2 + PACE_POINT_MAX];
+        uint8_t mac[PACE_AES_BLOCK];
+        size_t point_len;
+        size_t mac_len;
+        size_t pos = 0;
+        psa_key_id_t id;
+        psa_status_t status;
+        int ret;
+
+        // Every length fits the short form up to 384-bit curves
+        ret = pace_write_point(grp, pk, &data[3 + 2 + PACE_OID_LEN + 2], PACE_POINT_MAX,
+                               &point_len);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        data[pos++] = 0x7F;
+        data[pos++] = 0x49;
+        data[pos++] = 2 + PACE_OID_LEN + 2 + point_len;
+        data[pos++] = 0x06;
+        data[pos++] = PACE_OID_LEN;
+        memcpy(&data[pos], pace_oid_prefix, sizeof(pace_oid_prefix));
+        pos += sizeof(pace_oid_prefix);
+        data[pos++] = params->key_len / 8; // 2, 3, 4 for AES-128/192/256
+        data[pos++] = 0x86;
+        data[pos++] = point_len;
+        pos += point_len;
+
+        ret = pace_import_aes(ks_mac, params->key_len, PSA_KEY_USAGE_SIGN_MESSAGE, PSA_ALG_CMAC,
+                              &id);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        status = psa_mac_compute(id, PSA_ALG_CMAC, data, pos, mac, sizeof(mac), &mac_len);
+        psa_destroy_key(id);
+        if (status != PSA_SUCCESS)
+        {
+                return -EIO;
+        }
+
+        memcpy(token, mac, PACE_TOKEN_LEN);
+        return 0;
+}
+
+/* ==================== EF.CardAccess ==================== */
+
+/* Step over one TLV in [*p, end), returning its tag and value */
+static int pace_next_tlv(const uint8_t **p, const uint8_t *end, uint16_t *tag,
+                         const uint8_t **value, size_t *len)
+{
+        int hdr = mrtd_ber_header(*p, end - *p, tag, len);
+
+        if (hdr < 0 || hdr + *len > (size_t)(end - *p))
+        {
+                return -EBADMSG;
+        }
+
+        *value = *p + hdr;
+        *p += hdr + *len;
+        return 0;
+}
+
+/* PACEInfo ::= SEQUENCE { protocol OID, version INTEGER, parameterId INTEGER OPTIONAL } */
+static int pace_parse_info(const uint8_t *p, const uint8_t *end, struct pace_params *params)
+{
+        const uint8_t *oid;
+        const uint8_t *val;
+        size_t oid_len;
+        size_t len;
+        uint16_t tag;
+
+        if (pace_next_tlv(&p, end, &tag, &oid, &oid_len) != 0 || tag != 0x06 ||
+            oid_len != PACE_OID_LEN || memcmp(oid, pace_oid_prefix, sizeof(pace_oid_prefix)) != 0 ||
+            oid[PACE_OID_LEN - 1] < PACE_OID_AES_128 || oid[PACE_OID_LEN - 1] > PACE_OID_AES_256)
+        {
+                return -ENOTSUP;
+        }
+
+        if (pace_next_tlv(&p, end, &tag, &val, &len) != 0 || tag != 0x02 || len != 1 ||
+            val[0] != PACE_VERSION)
+        {
+                return -ENOTSUP;
+        }
+
+        // Without parameterId the domain parameters are proprietary
+        if (pace_next_tlv(&p, end, &tag, &val, &len) != 0 || tag != 0x02 || len != 1)
+        {
+                return -ENOTSUP;
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(pace_curves); i++)
+        {
+                if (pace_curves[i].param_id == val[0] && pace_loaded[i])
+                {
+                        params->key_len = oid[PACE_OID_LEN - 1] * 8;
+                        params->param_id = val[0];
+                        params->curve = i;
+                        return 0;
+                }
+        }
+
+        LOG_DBG("PACE parameter ID %u not supported", val[0]);
+        return -ENOTSUP;
+}
+
+int pace_parse_card_access(const uint8_t *buf, size_t len, struct pace_params *params)
+{
+        const uint8_t *p = buf;
+        const uint8_t *set;
+        size_t set_len;
+        uint16_t tag;
+
+        // SecurityInfos ::= SET OF SecurityInfo
+        if (pace_next_tlv(&p, buf + len, &tag, &set, &set_len) != 0 || tag != 0x31)
+        {
+                return -EBADMSG;
+        }
+
+        p = set;
+        while (p < set + set_len)
+        {
+                const uint8_t *info;
+                size_t info_len;
+
+                if (pace_next_tlv(&p, set + set_len, &tag, &info, &info_len) != 0)
+                {
+                        return -EBADMSG;
+                }
+                if (tag == 0x30 && pace_parse_info(info, info + info_len, params) == 0)
+                {
+                        LOG_INF("PACE: ECDH-GM AES-%u, %s", params->key_len * 8,
+                                pace_curves[params->curve].name);
+                        return 0;
+                }
+        }
+
+        return -ENOTSUP;
+}
+
+/* ==================== Protocol ==================== */
+
+static int pace_set_at(struct mrtd_session *mrtd, const struct pace_params *params,
+                       uint8_t password_ref)
+{
+        uint8_t *apdu = pn532_exchange_buffer();
+        const uint8_t *data;
+        uint16_t data_len;
+        uint16_t sw;
+        size_t pos = 5;
+        int ret;
+
+        apdu[0] = 0x00;
+        apdu[1] = 0x22; // MANAGE SECURITY ENVIRONMENT
+        apdu[2] = 0xC1; // Set for mutual authentication
+        apdu[3] = 0xA4; // Authentication template
+
+        apdu[pos++] = 0x80;
+        apdu[pos++] = PACE_OID_LEN;
+        memcpy(&apdu[pos], pace_oid_prefix, sizeof(pace_oid_prefix));
+        pos += sizeof(pace_oid_prefix);
+        apdu[pos++] = params->key_len / 8;
+        apdu[pos++] = 0x83;
+        apdu[pos++] = 0x01;
+        apdu[pos++] = password_ref;
+        apdu[pos++] = 0x84;
+        apdu[pos++] = 0x01;
+        apdu[pos++] = params->param_id;
+        apdu[4] = pos - 5;
+
+        ret = mrtd_transceive(mrtd, pos, &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                return ret;
+        }
+        if (sw != MRTD_SW_OK)
+        {
+                LOG_ERR("MSE:Set AT refused: SW %04X", sw);
+                return mrtd_sw_error(sw);
+        }
+
+        return 0;
+}
+
+/*
+ * One GENERAL AUTHENTICATE step: send 7C { tag in } (empty for step 1)
+ * and copy out the value of resp_tag from the 7C response.
+ */
+static int pace_general_authenticate(struct mrtd_session *mrtd, bool last, uint8_t tag,
+                                     const uint8_t *in, size_t in_len, uint8_t resp_tag,
+                                     uint8_t *out, size_t size, size_t *out_len)
+{
+        uint8_t *apdu = pn532_exchange_buffer();
+        const uint8_t *data;
+        const uint8_t *end;
+        const uint8_t *dad;
+        const uint8_t *val;
+        uint16_t data_len;
+        uint16_t sw;
+        uint16_t t;
+        size_t dad_len;
+        size_t pos = 5;
+        int ret;
+
+        apdu[0] = last ? 0x00 : 0x10; // Command chaining until the last step
+        apdu[1] = 0x86;
+        apdu[2] = 0x00;
+        apdu[3] = 0x00;
+        apdu[pos++] = 0x7C;
+        if (in_len == 0)
+        {
+                apdu[pos++] = 0x00;
+        }
+        else
+        {
+                apdu[pos++] = 2 + in_len;
+                apdu[pos++] = tag;
+                apdu[pos++] = in_len;
+                memcpy(&apdu[pos], in, in_len);
+                pos += in_len;
+        }
+        apdu[4] = pos - 5;
+        apdu[pos++] = 0x00; // Le
+
+        ret = mrtd_transceive(mrtd, pos, &data, &data_len, &sw);
+        if (ret != 0)
+        {
+                return ret;
+        }
+        if (sw != MRTD_SW_OK)
+        {
+                LOG_ERR("GENERAL AUTHENTICATE (%02X) refused: SW %04X", resp_tag, sw);
+                // 63xx: authentication failed, most likely a wrong password
+                return (sw >> 8) == 0x63 ? -EACCES : mrtd_sw_error(sw);
+        }
+
+        end = data + data_len;
+        if (pace_next_tlv(&data, end, &t, &dad, &dad_len) != 0 || t != 0x7C)
+        {
+                return -EBADMSG;
+        }
+
+        end = dad + dad_len;
+        while (dad < end)
+        {
+                if (pace_next_tlv(&dad, end, &t, &val, out_len) != 0)
+                {
+                        return -EBADMSG;
+                }
+                if (t == resp_tag)
+                {
+                        if (*out_len > size)
+                        {
+                                return -EBADMSG;
+                        }
+                        memcpy(out, val, *out_len);
+                        return 0;
+                }
+        }
+
+        return -EBADMSG;
+}
+
+/* Handshake working state, from the session arena to keep it off the stack */
+struct pace_work
+{
+        uint8_t k_pi[PACE_KEY_MAX];
+        uint8_t nonce[PACE_NONCE_MAX];
+        uint8_t buf[PACE_POINT_MAX];
+        uint8_t token[PACE_TOKEN_LEN];
+        mbedtls_mpi s, sk_map, sk_eph;
+        mbedtls_ecp_point pk_map, pk_chip, g_map, pk_eph;
+};
+
+int pace_authenticate(struct mrtd_session *mrtd, const struct pace_params *params,
+                      uint8_t password_ref, const uint8_t *pi, size_t pi_len,
+                      struct pace_session *session)
+{
+        mbedtls_ecp_group *grp;
+        struct pace_work *w;
+        int64_t start = k_uptime_get();
+        size_t len;
+        int ret;
+
+        if (!pace_ready || params->curve >= ARRAY_SIZE(pace_curves) || !pace_loaded[params->curve])
+        {
+                return -ENOTSUP;
+        }
+
+        grp = pace_group(params->curve);
+        if (!grp)
+        {
+                return -EIO;
+        }
+
+        w = session_alloc(sizeof(*w));
+        if (!w)
+        {
+                return -ENOMEM;
+        }
+
+        mbedtls_mpi_init(&w->s);
+        mbedtls_mpi_init(&w->sk_map);
+        mbedtls_mpi_init(&w->sk_eph);
+        mbedtls_ecp_point_init(&w->pk_map);
+        mbedtls_ecp_point_init(&w->pk_chip);
+        mbedtls_ecp_point_init(&w->g_map);
+        mbedtls_ecp_point_init(&w->pk_eph);
+
+        ret = pace_set_at(mrtd, params, password_ref);
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        // Step 1: encrypted nonce z, s = D(K_pi, z)
+        ret = pace_general_authenticate(mrtd, false, 0, NULL, 0, PACE_DO_NONCE, w->buf,
+                                        sizeof(w->buf), &len);
+        if (ret == 0)
+        {
+                ret = pace_kdf(pi, pi_len, PACE_KDF_PI, params->key_len, w->k_pi);
+        }
+        if (ret == 0)
+        {
+                ret = pace_decrypt_nonce(w->k_pi, params->key_len, w->buf, len, w->nonce);
+        }
+        if (ret == 0 && mbedtls_mpi_read_binary(&w->s, w->nonce, len) != 0)
+        {
+                ret = -EIO;
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        // Step 2: map the nonce onto a fresh generator
+        ret = pace_keypair(grp, &grp->G, &w->sk_map, &w->pk_map);
+        if (ret == 0)
+        {
+                ret = pace_write_point(grp, &w->pk_map, w->buf, sizeof(w->buf), &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_general_authenticate(mrtd, false, PACE_DO_MAP_PCD, w->buf, len,
+                                                PACE_DO_MAP_PICC, w->buf, sizeof(w->buf), &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_read_point(grp, w->buf, len, &w->pk_chip);
+        }
+        if (ret == 0)
+        {
+                ret = pace_map_generator(grp, &w->s, &w->sk_map, &w->pk_chip, &w->g_map);
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        // Step 3: ephemeral ECDH on the mapped generator
+        ret = pace_keypair(grp, &w->g_map, &w->sk_eph, &w->pk_eph);
+        if (ret == 0)
+        {
+                ret = pace_write_point(grp, &w->pk_eph, w->buf, sizeof(w->buf), &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_general_authenticate(mrtd, false, PACE_DO_EPH_PCD, w->buf, len,
+                                                PACE_DO_EPH_PICC, w->buf, sizeof(w->buf), &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_read_point(grp, w->buf, len, &w->pk_chip);
+        }
+        if (ret == 0 && mbedtls_ecp_point_cmp(&w->pk_chip, &w->pk_eph) == 0)
+        {
+                ret = -EBADMSG; // Reflected key
+        }
+        if (ret == 0)
+        {
+                ret = pace_shared_secret(grp, &w->sk_eph, &w->pk_chip, w->buf, &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_kdf(w->buf, len, PACE_KDF_ENC, params->key_len, session->ks_enc);
+        }
+        if (ret == 0)
+        {
+                ret = pace_kdf(w->buf, len, PACE_KDF_MAC, params->key_len, session->ks_mac);
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        // Step 4: exchange authentication tokens over each other's ephemeral key
+        ret = pace_token(grp, params, session->ks_mac, &w->pk_chip, w->token);
+        if (ret == 0)
+        {
+                ret = pace_general_authenticate(mrtd, true, PACE_DO_TOKEN_PCD, w->token,
+                                                PACE_TOKEN_LEN, PACE_DO_TOKEN_PICC, w->buf,
+                                                sizeof(w->buf), &len);
+        }
+        if (ret == 0)
+        {
+                ret = pace_token(grp, params, session->ks_mac, &w->pk_eph, w->token);
+        }
+        if (ret == 0 &&
+            (len != PACE_TOKEN_LEN || memcmp(w->buf, w->token, PACE_TOKEN_LEN) != 0))
+        {
+                LOG_ERR("Chip authentication token mismatch");
+                ret = -EBADMSG;
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        session->key_len = params->key_len;
+        LOG_INF("PACE established in %u ms", (uint32_t)(k_uptime_get() - start));
+
+out:
+        mbedtls_mpi_free(&w->s);
+        mbedtls_mpi_free(&w->sk_map);
+        mbedtls_mpi_free(&w->sk_eph);
+        mbedtls_ecp_point_free(&w->pk_map);
+        mbedtls_ecp_point_free(&w->pk_chip);
+        mbedtls_ecp_point_free(&w->g_map);
+        mbedtls_ecp_point_free(&w->pk_eph);
+        mbedtls_platform_zeroize(w->k_pi, sizeof(w->k_pi));
+        mbedtls_platform_zeroize(w->nonce, sizeof(w->nonce));
+        mbedtls_platform_zeroize(w->buf, sizeof(w->buf));
+        if (ret != 0)
+        {
+                mbedtls_platform_zeroize(session, sizeof(*session));
+        }
+        return ret;
+}
+
+/* ==================== Benchmark ==================== */
+
+#if defined(CONFIG_PACE_BENCHMARK)
+
+#define PACE_BENCH_ROUNDS 4
+
+/* One handshake against a software chip; times only the PCD side */
+static int pace_bench_round(mbedtls_ecp_group *grp, uint32_t *map_cyc, uint32_t *agree_cyc)
+{
+        uint8_t x[PACE_FIELD_MAX];
+        uint8_t x_chip[PACE_FIELD_MAX];
+        mbedtls_mpi s, sk_map, sk_map_chip, sk_eph, sk_eph_chip;
+        mbedtls_ecp_point pk_map, pk_map_chip, g_map, g_map_chip, pk_eph, pk_eph_chip;
+        size_t len;
+        uint32_t t0;
+        int ret;
+
+        mbedtls_mpi_init(&s);
+        mbedtls_mpi_init(&sk_map);
+        mbedtls_mpi_init(&sk_map_chip);
+        mbedtls_mpi_init(&sk_eph);
+        mbedtls_mpi_init(&sk_eph_chip);
+        mbedtls_ecp_point_init(&pk_map);
+        mbedtls_ecp_point_init(&pk_map_chip);
+        mbedtls_ecp_point_init(&g_map);
+        mbedtls_ecp_point_init(&g_map_chip);
+        mbedtls_ecp_point_init(&pk_eph);
+        mbedtls_ecp_point_init(&pk_eph_chip);
+
+        // Chip: nonce and mapping key
+        ret = mbedtls_ecp_gen_privkey(grp, &s, PACE_RNG) == 0 ? 0 : -EIO;
+        if (ret == 0)
+        {
+                ret = pace_keypair(grp, &grp->G, &sk_map_chip, &pk_map_chip);
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        t0 = k_cycle_get_32();
+        ret = pace_keypair(grp, &grp->G, &sk_map, &pk_map);
+        if (ret == 0)
+        {
+                ret = pace_map_generator(grp, &s, &sk_map, &pk_map_chip, &g_map);
+        }
+        *map_cyc += k_cycle_get_32() - t0;
+
+        if (ret == 0)
+        {
+                ret = pace_map_generator(grp, &s, &sk_map_chip, &pk_map, &g_map_chip);
+        }
+        if (ret == 0)
+        {
+                ret = pace_keypair(grp, &g_map_chip, &sk_eph_chip, &pk_eph_chip);
+        }
+        if (ret != 0)
+        {
+                goto out;
+        }
+
+        t0 = k_cycle_get_32();
+        ret = pace_keypair(grp, &g_map, &sk_eph, &pk_eph);
+        if (ret == 0)
+        {
+                ret = pace_shared_secret(grp, &sk_eph, &pk_eph_chip, x, &len);
+        }
+        *agree_cyc += k_cycle_get_32() - t0;
+
+        if (ret == 0)
+        {
+                ret = pace_shared_secret(grp, &sk_eph_chip, &pk_eph, x_chip, &len);
+        }
+        if (ret == 0 && memcmp(x, x_chip, len) != 0)
+        {
+                ret = -EBADMSG;
+        }
+
+out:
+        mbedtls_mpi_free(&s);
+        mbedtls_mpi_free(&sk_map);
+        mbedtls_mpi_free(&sk_map_chip);
+        mbedtls_mpi_free(&sk_eph);
+        mbedtls_mpi_free(&sk_eph_chip);
+        mbedtls_ecp_point_free(&pk_map);
+        mbedtls_ecp_point_free(&pk_map_chip);
+        mbedtls_ecp_point_free(&g_map);
+        mbedtls_ecp_point_free(&g_map_chip);
+        mbedtls_ecp_point_free(&pk_eph);
+        mbedtls_ecp_point_free(&pk_eph_chip);
+        return ret;
+}
+
+void pace_benchmark(void)
+{
+        LOG_INF("=== PACE benchmark (%s) ===", pace_backend_name());
+
+        for (size_t i = 0; i < ARRAY_SIZE(pace_curves); i++)
+        {
+                uint32_t map_cyc = 0;
+                uint32_t agree_cyc = 0;
+                int ret = 0;
+
+                if (!pace_loaded[i])
+                {
+                        continue;
+                }
+
+                // Table built outside the timed rounds, as a second handshake would find it
+                if (!pace_group(i))
+                {
+                        continue;
+                }
+                for (int r = 0; r < PACE_BENCH_ROUNDS && ret == 0; r++)
+                {
+                        ret = pace_bench_round(&pace_groups[i], &map_cyc, &agree_cyc);
+                }
+                if (ret != 0)
+                {
+                        LOG_ERR("%s: benchmark failed (%d)", pace_curves[i].name, ret);
+                        continue;
+                }
+
+                LOG_INF("%s: mapping %u us, key agreement %u us, ECC per handshake %u us",
+                        pace_curves[i].name, k_cyc_to_us_floor32(map_cyc / PACE_BENCH_ROUNDS),
+                        k_cyc_to_us_floor32(agree_cyc / PACE_BENCH_ROUNDS),
+                        k_cyc_to_us_floor32((map_cyc + agree_cyc) / PACE_BENCH_ROUNDS));
+        }
+}
+
+#endif /* CONFIG_PACE_BENCHMARK */
@@ -0,0 +1,64 @@
+/**
+ * @file pace.h
+ * @brief ICAO 9303 PACE v2: Generic Mapping, ECDH, AES secure messaging
+ */
+
+#ifndef PACE_H_
+#define PACE_H_
+
+#include <zephyr/kernel.h>
+
+#include "mrtd.h"
+
+#define PACE_KEY_MAX 32
+
+/* Password reference (MSE:Set AT tag 83) */
+#define PACE_PASSWORD_MRZ 0x01
+#define PACE_PASSWORD_CAN 0x02
+
+/* Protocol and domain parameters chosen from EF.CardAccess */
+struct pace_params
+{
+        uint8_t key_len;  // AES key size: 16, 24 or 32
+        uint8_t param_id; // Standardized domain parameters (ICAO 9303-11 table 6)
+        uint8_t curve;    // Index into the preloaded curve table
+};
+
+/* Session keys for AES secure messaging, SSC starts at zero */
+struct pace_session
+{
+        uint8_t ks_enc[PACE_KEY_MAX];
+        uint8_t ks_mac[PACE_KEY_MAX];
+        uint8_t key_len;
+};
+
+/*
+ * Start PSA Crypto and load the supported curves. A curve's fixed point
+ * table is built by the first handshake on it.
+ */
+int pace_init(void);
+
+/* Which implementation performs the elliptic curve arithmetic */
+const char *pace_backend_name(void);
+
+/*
+ * Pick the first supported PACEInfo (ECDH-GM with AES) from EF.CardAccess.
+ * Returns -ENOTSUP if the document offers nothing this reader implements.
+ */
+int pace_parse_card_access(const uint8_t *buf, size_t len, struct pace_params *params);
+
+/*
+ * Run MSE:Set AT and the four GENERAL AUTHENTICATE steps at MF level.
+ * pi is the password: SHA-1 of the MRZ info, or the CAN digits.
+ * Working state comes from the session arena (see session_mem.h).
+ */
+int pace_authenticate(struct mrtd_session *mrtd, const struct pace_params *params,
+                      uint8_t password_ref, const uint8_t *pi, size_t pi_len,
+                      struct pace_session *session);
+
+#if defined(CONFIG_PACE_BENCHMARK)
+/* Time the PCD side of a handshake (mapping + key agreement) per curve */
+void pace_benchmark(void);
+#endif
+
+#endif /* PACE_H_ */
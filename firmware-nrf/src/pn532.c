@@ -0,0 +1,1342 @@
+/**
+ * @file pn532.c
+ * @brief PN532 command layer: framing, response wait and init
+ *
+ * Frame encoding and checksums are shared by every host interface; the
+ * selected backend in pn532_transport.h only moves bytes.
+ */
+
+#include "pn532.h"
+#include "pn532_transport.h"
+#include "metrics.h"
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(pn532, LOG_LEVEL_DBG);
+
+/* ==================== PN532 Configuration ==================== */
+#define PN532_PREAMBLE 0x00
+#define PN532_STARTCODE1 0x00
+#define PN532_STARTCODE2 0xFF
+#define PN532_POSTAMBLE 0x00
+
+#define PN532_HOSTTOPN532 0xD4
+#define PN532_PN532TOHOST 0xD5
+
+/* Frame codec */
+#define PN532_EXTENDED_LEN 0xFF
+#define PN532_ACK_LEN 6
+#define PN532_CMD_OFFSET (PN532_FRAME_HEADROOM + PN532_EXT_HEADER_LEN + 1) // Largest header + TFI
+
+/* InDataExchange / InPSL status byte */
+#define PN532_STATUS_ERROR_MASK 0x3F
+#define PN532_STATUS_TIMEOUT 0x01
+#define PN532_STATUS_COLLISION 0x06
+
+/* RFConfiguration items */
+#define PN532_RFCFG_FIELD 0x01
+#define PN532_RF_OFF_TIME_MS 10
+
+/* Diagnose tests */
+#define PN532_DIAG_ATTENTION 0x06 // Attention request: ISO14443-4 card presence
+#define PN532_PRESENCE_TIMEOUT_MS 100
+
+/* PowerDown: wake-up over the host interface in use */
+#if defined(CONFIG_PN532_TRANSPORT_SPI)
+#define PN532_WAKE_HOST BIT(5)
+#elif defined(CONFIG_PN532_TRANSPORT_UART)
+#define PN532_WAKE_HOST BIT(4)
+#else
+#define PN532_WAKE_HOST BIT(7)
+#endif
+#define PN532_POWERDOWN_IRQ 0x01      // GenerateIRQ on wake-up
+#define PN532_POWERDOWN_TIMEOUT_MS 100
+#define PN532_POWERDOWN_WAKE_MS 2     // Oscillator start-up after the wake-up sequence
+
+/* Init: full probe (cold or unknown module) and the fast path for a cached one */
+#define PN532_RESET_PULSE_MS 100
+#define PN532_RESET_SETTLE_MS 500
+#define PN532_FAST_RESET_PULSE_MS 10
+#define PN532_FAST_RESET_SETTLE_MS 10
+#define PN532_WAKEUP_MS 20
+#define PN532_PROBE_TIMEOUT_MS 1000
+#define PN532_FAST_PROBE_TIMEOUT_MS 100
+#define PN532_PROBE_ATTEMPTS 3
+#define PN532_PROBE_RETRY_MS 100
+
+/* Response wait engine */
+#define PN532_ACK_TIMEOUT_MS 50
+#define PN532_POLL_INTERVAL_MS 2
+
+/* GPIO Pins */
+#define PN532_IRQ_NODE DT_ALIAS(pn532irq)
+#define PN532_RST_NODE DT_ALIAS(pn532rst)
+
+#if defined(CONFIG_PN532_TRANSPORT_SPI)
+#define PN532_TRANSPORT (&pn532_transport_spi)
+#elif defined(CONFIG_PN532_TRANSPORT_UART)
+#define PN532_TRANSPORT (&pn532_transport_uart)
+#else
+#define PN532_TRANSPORT (&pn532_transport_i2c)
+#endif
+
+/* ==================== Global Variables ==================== */
+static const struct pn532_transport *transport = PN532_TRANSPORT;
+
+static const struct gpio_dt_spec pn532_irq = GPIO_DT_SPEC_GET_OR(PN532_IRQ_NODE, gpios, {0});
+static const struct gpio_dt_spec pn532_rst = GPIO_DT_SPEC_GET(PN532_RST_NODE, gpios);
+
+/* Frame buffers: static RAM so the bus DMA can use them in place */
+static uint8_t pn532_tx_frame[PN532_FRAME_HEADROOM + PN532_FRAME_MAX];
+static uint8_t pn532_rx_frame[PN532_FRAME_HEADROOM + PN532_FRAME_MAX];
+static uint8_t pn532_ack_frame[PN532_FRAME_HEADROOM + PN532_ACK_LEN];
+
+/* IRQ line state: falls back to polling the transport when not wired */
+static struct gpio_callback pn532_irq_cb_data;
+static K_SEM_DEFINE(pn532_irq_sem, 0, 1);
+static bool pn532_irq_enabled;
+
+/* Address and firmware of the last module found, kept in settings ("pn532/id") */
+struct pn532_id
+{
+        uint8_t addr; // I2C address, 0 for SPI/UART
+        uint8_t ic;   // 0x32 for a PN532
+        uint8_t ver;
+        uint8_t rev;
+};
+
+#if defined(CONFIG_PN532_FAST_BOOT)
+static struct pn532_id pn532_cached_id;
+static bool pn532_cached_valid;
+#endif
+
+/* One-shot hook for the application, e.g. an InAutoPoll left running */
+static atomic_ptr_t pn532_ready_cb = ATOMIC_PTR_INIT(NULL);
+
+/* Deadline of the command currently waiting for its response */
+static int64_t pn532_cmd_deadline;
+
+/* RF bit rate of the current ISO14443-4 session and per-rate counters */
+static uint8_t rf_bitrate = PN532_BR_106;
+static struct pn532_rf_stats rf_stats;
+
+/* ==================== Response Wait Engine ==================== */
+
+static void pn532_irq_handler(const struct device *dev, struct gpio_callback *cb,
+                              uint32_t pins)
+{
+        pn532_ready_cb_t ready = (pn532_ready_cb_t)atomic_ptr_clear(&pn532_ready_cb);
+
+        k_sem_give(&pn532_irq_sem);
+        if (ready)
+        {
+                ready();
+        }
+}
+
+int pn532_notify_ready(pn532_ready_cb_t cb)
+{
+        if (cb == NULL)
+        {
+                atomic_ptr_clear(&pn532_ready_cb);
+                return 0;
+        }
+
+        if (!pn532_irq_enabled)
+        {
+                return -ENOTSUP;
+        }
+
+        atomic_ptr_set(&pn532_ready_cb, (void *)cb);
+
+        /* The frame may already be pending, its edge gone before the hook was set */
+        if (gpio_pin_get_dt(&pn532_irq) > 0)
+        {
+                cb = (pn532_ready_cb_t)atomic_ptr_clear(&pn532_ready_cb);
+                if (cb)
+                {
+                        cb();
+                }
+        }
+
+        return 0;
+}
+
+static int pn532_irq_setup(void)
+{
+        int ret;
+
+        if (pn532_irq.port == NULL || !gpio_is_ready_dt(&pn532_irq))
+        {
+                LOG_WRN("PN532 IRQ line not available, polling ready status");
+                return -ENODEV;
+        }
+
+        ret = gpio_pin_configure_dt(&pn532_irq, GPIO_INPUT);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        ret = gpio_pin_interrupt_configure_dt(&pn532_irq, GPIO_INT_EDGE_TO_ACTIVE);
+        if (ret != 0)
+        {
+                LOG_WRN("PN532 IRQ interrupt config failed: %d, polling ready status", ret);
+                return ret;
+        }
+
+        gpio_init_callback(&pn532_irq_cb_data, pn532_irq_handler, BIT(pn532_irq.pin));
+        ret = gpio_add_callback(pn532_irq.port, &pn532_irq_cb_data);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        pn532_irq_enabled = true;
+        LOG_INF("PN532 IRQ line enabled");
+        return 0;
+}
+
+static int32_t pn532_remaining_ms(int64_t deadline)
+{
+        int64_t remaining = deadline - k_uptime_get();
+
+        return remaining > 0 ? (int32_t)remaining : 0;
+}
+
+/*
+ * Block until the PN532 signals a pending frame or the deadline passes.
+ * IRQ is active while a frame is waiting, so the level is checked after
+ * re-arming the semaphore to avoid losing an edge that already happened.
+ */
+static int pn532_wait_ready(int64_t deadline)
+{
+        if (pn532_irq_enabled)
+        {
+                while (true)
+                {
+                        k_sem_reset(&pn532_irq_sem);
+                        if (gpio_pin_get_dt(&pn532_irq) > 0)
+                        {
+                                return 0;
+                        }
+
+                        int32_t remaining = pn532_remaining_ms(deadline);
+                        if (remaining == 0 ||
+                            k_sem_take(&pn532_irq_sem, K_MSEC(remaining)) != 0)
+                        {
+                                return -ETIMEDOUT;
+                        }
+                }
+        }
+
+        /* No IRQ line: ask the transport (I2C/SPI status byte, UART RX data) */
+        while (true)
+        {
+                if (transport->poll_ready() > 0)
+                {
+                        return 0;
+                }
+
+                if (pn532_remaining_ms(deadline) == 0)
+                {
+                        return -ETIMEDOUT;
+                }
+
+                k_sleep(K_MSEC(PN532_POLL_INTERVAL_MS));
+        }
+}
+
+static int pn532_wait_cmd(void)
+{
+        return pn532_wait_ready(pn532_cmd_deadline);
+}
+
+/* ==================== Frame Codec ==================== */
+
+/*
+ * Parse a frame header.
+ * Returns the header size in bytes and stores LEN (TFI + data) in data_len.
+ */
+static int pn532_parse_header(const uint8_t *hdr, uint16_t *data_len)
+{
+        if (hdr[0] != PN532_PREAMBLE ||
+            hdr[1] != PN532_STARTCODE1 ||
+            hdr[2] != PN532_STARTCODE2)
+        {
+                LOG_ERR("Invalid response frame header");
+                LOG_ERR("Expected: 00 00 FF, Got: %02X %02X %02X", hdr[0], hdr[1], hdr[2]);
+                return -EINVAL;
+        }
+
+        if (hdr[3] == PN532_EXTENDED_LEN && hdr[4] == PN532_EXTENDED_LEN)
+        {
+                uint8_t lcs = hdr[5] + hdr[6] + hdr[7];
+
+                if (lcs != 0)
+                {
+                        LOG_ERR("Extended length checksum mismatch");
+                        return -EBADMSG;
+                }
+
+                *data_len = ((uint16_t)hdr[5] << 8) | hdr[6];
+                return PN532_EXT_HEADER_LEN;
+        }
+
+        if ((uint8_t)(hdr[3] + hdr[4]) != 0)
+        {
+                LOG_ERR("Length checksum mismatch: LEN=0x%02X, LCS=0x%02X", hdr[3], hdr[4]);
+                return -EBADMSG;
+        }
+
+        *data_len = hdr[3];
+        return PN532_NORMAL_HEADER_LEN;
+}
+
+/* Total frame size (header + data + DCS + postamble), used by the backends */
+static int pn532_frame_len(const uint8_t *hdr)
+{
+        uint16_t data_len;
+        int hdr_len = pn532_parse_header(hdr, &data_len);
+
+        if (hdr_len < 0)
+        {
+                LOG_HEXDUMP_ERR(hdr, PN532_EXT_HEADER_LEN, "Header:");
+                return hdr_len;
+        }
+
+        if (data_len < 2 || data_len > PN532_FRAME_MAX_DATA)
+        {
+                LOG_ERR("Unexpected frame length: %u", data_len);
+                return -EBADMSG;
+        }
+
+        return hdr_len + data_len + 2;
+}
+
+uint8_t *pn532_command_buffer(void)
+{
+        transport->flush(K_MSEC(PN532_ACK_TIMEOUT_MS));
+        return &pn532_tx_frame[PN532_CMD_OFFSET];
+}
+
+int pn532_write_command(uint16_t cmd_len)
+{
+        const uint8_t *cmd = &pn532_tx_frame[PN532_CMD_OFFSET];
+        uint16_t len = cmd_len + 1; // TFI + command data
+        uint8_t *frame;
+
+        if (len > PN532_FRAME_MAX_DATA)
+        {
+                LOG_ERR("Command too long: %u bytes", cmd_len);
+                return -EMSGSIZE;
+        }
+
+        metrics_pn532_begin(cmd[0]);
+
+        // Header is written backwards from the TFI so it ends right before cmd
+        if (len < PN532_EXTENDED_LEN)
+        {
+                frame = &pn532_tx_frame[PN532_CMD_OFFSET - 1 - PN532_NORMAL_HEADER_LEN];
+                frame[3] = len;
+                frame[4] = ~len + 1;
+        }
+        else
+        {
+                // Extended information frame: FF FF LENM LENL LCS
+                frame = &pn532_tx_frame[PN532_CMD_OFFSET - 1 - PN532_EXT_HEADER_LEN];
+                frame[3] = PN532_EXTENDED_LEN;
+                frame[4] = PN532_EXTENDED_LEN;
+                frame[5] = len >> 8;
+                frame[6] = len & 0xFF;
+                frame[7] = ~((len >> 8) + (len & 0xFF)) + 1;
+        }
+
+        frame[0] = PN532_PREAMBLE;
+        frame[1] = PN532_STARTCODE1;
+        frame[2] = PN532_STARTCODE2;
+        pn532_tx_frame[PN532_CMD_OFFSET - 1] = PN532_HOSTTOPN532;
+
+        uint8_t dcs = PN532_HOSTTOPN532;
+        for (uint16_t i = 0; i < cmd_len; i++)
+        {
+                dcs += cmd[i];
+        }
+
+        uint16_t idx = PN532_CMD_OFFSET + cmd_len;
+        pn532_tx_frame[idx++] = ~dcs + 1;
+        pn532_tx_frame[idx++] = PN532_POSTAMBLE;
+
+        uint16_t frame_len = &pn532_tx_frame[idx] - frame;
+        LOG_HEXDUMP_DBG(frame, frame_len, "TX frame:");
+
+        return transport->write(frame, frame_len);
+}
+
+static const uint8_t ack_frame[PN532_ACK_LEN] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+static int pn532_read_ack(void)
+{
+        uint8_t *ack = &pn532_ack_frame[PN532_FRAME_HEADROOM];
+
+        int ret = transport->read(ack, PN532_ACK_LEN);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        // Log ACK frame for debugging
+        LOG_HEXDUMP_DBG(ack, PN532_ACK_LEN, "ACK frame:");
+
+        if (memcmp(ack, ack_frame, sizeof(ack_frame)) != 0)
+        {
+                LOG_DBG("Unexpected ACK frame");
+                return -EIO;
+        }
+
+        return 0;
+}
+
+/* Pick up the result of the command write and wait for its ACK */
+static int pn532_await_ack(void)
+{
+        int ret = transport->flush(K_MSEC(PN532_ACK_TIMEOUT_MS));
+
+        if (ret != 0)
+        {
+                LOG_ERR("Command write failed: %d", ret);
+                return ret;
+        }
+
+        // Wait for ACK ready (bounded by the command deadline)
+        ret = pn532_wait_ready(MIN(pn532_cmd_deadline, k_uptime_get() + PN532_ACK_TIMEOUT_MS));
+        if (ret == 0)
+        {
+                ret = pn532_read_ack();
+        }
+
+        return ret;
+}
+
+/*
+ * Wait for the response frame until pn532_cmd_deadline and validate it;
+ * expect is the frame length if the caller knows it, else 0
+ */
+static int pn532_receive_frame(const uint8_t **resp, uint16_t *resp_len, uint16_t expect)
+{
+        uint8_t *frame = &pn532_rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t data_len;
+        int hdr_len;
+        int ret;
+
+        ret = pn532_wait_cmd();
+        if (ret != 0)
+        {
+                LOG_DBG("Response timeout");
+                return ret;
+        }
+
+        ret = transport->read_frame(frame, PN532_FRAME_MAX, expect, pn532_frame_len,
+                                    pn532_wait_cmd);
+        if (ret == -EAGAIN)
+        {
+                LOG_DBG("PN532 not ready or no card present");
+                return ret;
+        }
+        if (ret < 0)
+        {
+                LOG_ERR("Failed to read response frame: %d", ret);
+                return ret;
+        }
+
+        hdr_len = pn532_parse_header(frame, &data_len);
+        if (hdr_len < 0)
+        {
+                return hdr_len;
+        }
+
+        const uint8_t *data = &frame[hdr_len];
+
+        if (data[0] != PN532_PN532TOHOST)
+        {
+                LOG_ERR("Unexpected TFI: 0x%02X", data[0]);
+                return -EBADMSG;
+        }
+
+        uint8_t dcs = 0;
+        for (uint16_t i = 0; i <= data_len; i++)
+        {
+                dcs += data[i]; // TFI + data + DCS sums to zero
+        }
+        if (dcs != 0)
+        {
+                LOG_ERR("Data checksum mismatch");
+                return -EBADMSG;
+        }
+
+        *resp = &data[1];
+        *resp_len = data_len - 1; // Exclude TFI
+
+        LOG_HEXDUMP_DBG(*resp, *resp_len, "Response data:");
+
+        return 0;
+}
+
+static int pn532_read_frame_response(const uint8_t **resp, uint16_t *resp_len,
+                                     uint16_t timeout_ms, uint16_t expect)
+{
+        pn532_cmd_deadline = k_uptime_get() + timeout_ms;
+
+        if (pn532_await_ack() != 0)
+        {
+                // ACK is optional, the response read validates the frame
+                LOG_DBG("ACK read failed or invalid");
+        }
+
+        int ret = pn532_receive_frame(resp, resp_len, expect);
+
+        metrics_pn532_end();
+        return ret;
+}
+
+int pn532_read_response(const uint8_t **resp, uint16_t *resp_len, uint16_t timeout_ms)
+{
+        return pn532_read_frame_response(resp, resp_len, timeout_ms, 0);
+}
+
+int pn532_send_command(uint16_t cmd_len)
+{
+        int ret = pn532_write_command(cmd_len);
+
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        pn532_cmd_deadline = k_uptime_get() + PN532_ACK_TIMEOUT_MS;
+        return pn532_await_ack();
+}
+
+int pn532_receive(const uint8_t **resp, uint16_t *resp_len, uint16_t timeout_ms)
+{
+        pn532_cmd_deadline = k_uptime_get() + timeout_ms;
+
+        int ret = pn532_receive_frame(resp, resp_len, 0);
+
+        // Still pending: the sample covers the whole command once it answers
+        if (ret != -ETIMEDOUT)
+        {
+                metrics_pn532_end();
+        }
+        return ret;
+}
+
+int pn532_abort(void)
+{
+        // An ACK frame from the host aborts the command in progress
+        uint8_t *ack = &pn532_tx_frame[PN532_FRAME_HEADROOM];
+        int ret;
+
+        transport->flush(K_MSEC(PN532_ACK_TIMEOUT_MS));
+        memcpy(ack, ack_frame, sizeof(ack_frame));
+        ret = transport->write(ack, sizeof(ack_frame));
+        if (ret == 0)
+        {
+                ret = transport->flush(K_MSEC(PN532_ACK_TIMEOUT_MS));
+        }
+
+        LOG_DBG("Command aborted: %d", ret);
+        return ret;
+}
+
+/* ==================== Card Detection ==================== */
+
+/*
+ * Type A: Tg SENS_RES(2) SEL_RES NFCIDLength NFCID1 [ATS]
+ * Type B: Tg ATQB(12) ATTRIB_RES length ATTRIB_RES, UID is the PUPI
+ *
+ * The bit rate capability byte is TA(1) of the ATS for Type A and the
+ * first protocol info byte of the ATQB for Type B; both share one layout.
+ */
+int pn532_decode_target(uint8_t type, const uint8_t *data, uint16_t len,
+                        struct pn532_target *target)
+{
+        target->type = type;
+        target->bitrate_caps = 0;
+
+        if (type == PN532_TARGET_ISO14443B)
+        {
+                if (len < 13)
+                {
+                        return -EBADMSG;
+                }
+
+                target->tg = data[0];
+                target->uid_len = 4;
+                memcpy(target->uid, &data[2], 4); // ATQB: 0x50 PUPI(4) AppData(4) ProtInfo(3)
+                target->bitrate_caps = data[10];
+                return 0;
+        }
+
+        if (len < 5 || data[4] > sizeof(target->uid) || len < 5 + data[4])
+        {
+                return -EBADMSG;
+        }
+
+        target->tg = data[0];
+        target->uid_len = data[4];
+        memcpy(target->uid, &data[5], target->uid_len);
+
+        // ATS: TL T0 [TA] ..., TA present when T0 bit 5 is set
+        const uint8_t *ats = &data[5 + target->uid_len];
+        uint16_t ats_len = len - 5 - target->uid_len;
+
+        if (ats_len >= 3 && ats[0] >= 3 && (ats[1] & 0x10))
+        {
+                target->bitrate_caps = ats[2];
+        }
+
+        return 0;
+}
+
+int pn532_autopoll_start(const struct pn532_autopoll_cfg *cfg)
+{
+        uint8_t *cmd = pn532_command_buffer();
+
+        if (cfg->num_types == 0 || cfg->num_types > ARRAY_SIZE(cfg->types))
+        {
+                return -EINVAL;
+        }
+
+        cmd[0] = PN532_CMD_INAUTOPOLL;
+        cmd[1] = cfg->polls ? cfg->polls : PN532_AUTOPOLL_ENDLESS;
+        cmd[2] = cfg->period;
+        memcpy(&cmd[3], cfg->types, cfg->num_types);
+
+        return pn532_send_command(3 + cfg->num_types);
+}
+
+int pn532_autopoll_wait(struct pn532_target *target, uint16_t timeout_ms)
+{
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        ret = pn532_receive(&resp, &resp_len, timeout_ms);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        // D5 61 NbTg Type1 Length1 TargetData1 ...
+        if (resp_len < 2 || resp[0] != (PN532_CMD_INAUTOPOLL + 1))
+        {
+                return -EINVAL;
+        }
+
+        if (resp[1] == 0 || resp_len < 4 || resp_len < 4 + resp[3])
+        {
+                return -ENODEV;
+        }
+
+        return pn532_decode_target(resp[2], &resp[4], resp[3], target);
+}
+
+/* ==================== RF Session ==================== */
+
+static const uint16_t bitrate_kbps[PN532_BR_COUNT] = {106, 212, 424};
+
+uint16_t pn532_bitrate_kbps(uint8_t bitrate)
+{
+        return bitrate < PN532_BR_COUNT ? bitrate_kbps[bitrate] : 0;
+}
+
+/* Highest symmetric rate in a TA(1) style capability byte (DS and DR bits) */
+static uint8_t pn532_card_bitrate(uint8_t caps)
+{
+        if ((caps & 0x22) == 0x22)
+        {
+                return PN532_BR_424;
+        }
+        if ((caps & 0x11) == 0x11)
+        {
+                return PN532_BR_212;
+        }
+
+        return PN532_BR_106;
+}
+
+/*
+ * Map an InDataExchange/InPSL status byte to an errno. Errors on the air
+ * get -ECOMM, which no other layer returns, so the rate fallback and the
+ * RF statistics never mistake a MAC or parse failure for one.
+ */
+static int pn532_status_error(uint8_t status)
+{
+        status &= PN532_STATUS_ERROR_MASK;
+
+        if (status == 0)
+        {
+                return 0;
+        }
+        if (status <= PN532_STATUS_COLLISION)
+        {
+                // Timeout, CRC, parity, bit count, framing, collision
+                LOG_DBG("PN532 RF error 0x%02X", status);
+                return -ECOMM;
+        }
+
+        LOG_DBG("PN532 status error 0x%02X", status);
+        return -EIO;
+}
+
+static void pn532_rf_count(int ret)
+{
+        rf_stats.exchanges[rf_bitrate]++;
+
+        if (ret == -ECOMM)
+        {
+                rf_stats.errors[rf_bitrate]++;
+        }
+}
+
+uint8_t pn532_bitrate(void)
+{
+        return rf_bitrate;
+}
+
+int pn532_negotiate_bitrate(const struct pn532_target *target, uint8_t max)
+{
+        uint8_t br = MIN(max, pn532_card_bitrate(target->bitrate_caps));
+        uint8_t *cmd;
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        rf_bitrate = PN532_BR_106;
+
+        // Type B rates are fixed by ATTRIB during activation, InPSL only sends PPS
+        if (target->type == PN532_TARGET_ISO14443B || br == PN532_BR_106)
+        {
+                goto done;
+        }
+
+        cmd = pn532_command_buffer();
+        cmd[0] = PN532_CMD_INPSL;
+        cmd[1] = target->tg;
+        cmd[2] = br; // BRit
+        cmd[3] = br; // BRti
+
+        ret = pn532_write_command(4);
+        if (ret == 0)
+        {
+                ret = pn532_read_response(&resp, &resp_len, 100);
+        }
+        if (ret == 0)
+        {
+                ret = (resp_len >= 2 && resp[0] == PN532_CMD_INPSL + 1) ?
+                      pn532_status_error(resp[1]) : -EINVAL;
+        }
+
+        if (ret != 0)
+        {
+                // PPS is refused without changing the rate, carry on at 106
+                LOG_WRN("InPSL to %u kbps failed: %d", bitrate_kbps[br], ret);
+                if (ret == -ECOMM)
+                {
+                        rf_stats.errors[br]++;
+                }
+                goto done;
+        }
+
+        rf_bitrate = br;
+
+done:
+        rf_stats.sessions[rf_bitrate]++;
+        LOG_INF("RF bit rate: %u kbps (card caps 0x%02X)", bitrate_kbps[rf_bitrate],
+                target->bitrate_caps);
+        return rf_bitrate;
+}
+
+int pn532_rf_field(bool on)
+{
+        uint8_t *cmd = pn532_command_buffer();
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        cmd[0] = PN532_CMD_RFCONFIGURATION;
+        cmd[1] = PN532_RFCFG_FIELD;
+        cmd[2] = on ? 0x01 : 0x00;
+
+        ret = pn532_write_command(3);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return pn532_read_response(&resp, &resp_len, 100);
+}
+
+int pn532_target_present(void)
+{
+        uint8_t *cmd = pn532_command_buffer();
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        cmd[0] = PN532_CMD_DIAGNOSE;
+        cmd[1] = PN532_DIAG_ATTENTION;
+
+        ret = pn532_write_command(2);
+        if (ret == 0)
+        {
+                ret = pn532_read_response(&resp, &resp_len, PN532_PRESENCE_TIMEOUT_MS);
+        }
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        // D5 01 Status: 0x00 when the card answered the attention request
+        if (resp_len < 2 || resp[0] != PN532_CMD_DIAGNOSE + 1)
+        {
+                return -EINVAL;
+        }
+
+        return resp[1] == 0x00 ? 1 : 0;
+}
+
+int pn532_bitrate_fallback(void)
+{
+        int ret;
+
+        LOG_WRN("RF errors at %u kbps, falling back to 106 kbps",
+                bitrate_kbps[rf_bitrate]);
+        rf_stats.fallbacks++;
+        rf_bitrate = PN532_BR_106;
+
+        // A PPS is only valid right after activation, so power-cycle the card
+        ret = pn532_rf_field(false);
+        if (ret == 0)
+        {
+                k_sleep(K_MSEC(PN532_RF_OFF_TIME_MS));
+                ret = pn532_rf_field(true);
+        }
+
+        return ret;
+}
+
+void pn532_rf_stats_get(struct pn532_rf_stats *stats)
+{
+        *stats = rf_stats;
+}
+
+uint8_t *pn532_exchange_buffer(void)
+{
+        return pn532_command_buffer() + 2; // InDataExchange Tg
+}
+
+int pn532_exchange(uint8_t tg, uint16_t len, uint16_t expect_len, uint8_t **resp,
+                   uint16_t *resp_len, uint16_t timeout_ms)
+{
+        uint8_t *cmd = pn532_exchange_buffer() - 2;
+        const uint8_t *data;
+        uint16_t frame_len = 0;
+        int ret;
+
+        // TFI, D5 41, status, then the card's response
+        if (expect_len)
+        {
+                uint16_t data_len = 3 + expect_len;
+
+                frame_len = (data_len > 0xFF ? PN532_EXT_HEADER_LEN : PN532_NORMAL_HEADER_LEN) +
+                            data_len + 2;
+        }
+
+        cmd[0] = PN532_CMD_INDATAEXCHANGE;
+        cmd[1] = tg;
+
+        ret = pn532_write_command(len + 2);
+        if (ret == 0)
+        {
+                ret = pn532_read_frame_response(&data, resp_len, timeout_ms, frame_len);
+        }
+        if (ret == 0)
+        {
+                // D5 41 Status DataIn
+                if (*resp_len < 2 || data[0] != PN532_CMD_INDATAEXCHANGE + 1)
+                {
+                        ret = -EINVAL;
+                }
+                else
+                {
+                        ret = pn532_status_error(data[1]);
+                        // RX frame is ours until the next command, callers may unwrap in place
+                        *resp = (uint8_t *)&data[2];
+                        *resp_len -= 2;
+                }
+        }
+
+        pn532_rf_count(ret);
+        return ret;
+}
+
+/* ==================== Power Down ==================== */
+
+static bool pn532_asleep;
+static uint8_t pn532_sleep_wake;
+
+int pn532_power_down(uint8_t wake)
+{
+        uint8_t *cmd;
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        if (pn532_asleep)
+        {
+                if (wake == pn532_sleep_wake)
+                {
+                        return 0;
+                }
+
+                ret = pn532_wake_up();
+                if (ret != 0)
+                {
+                        return ret;
+                }
+        }
+
+        cmd = pn532_command_buffer();
+        cmd[0] = PN532_CMD_POWERDOWN;
+        cmd[1] = PN532_WAKE_HOST | wake;
+        cmd[2] = PN532_POWERDOWN_IRQ;
+
+        ret = pn532_write_command(3);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        ret = pn532_read_response(&resp, &resp_len, PN532_POWERDOWN_TIMEOUT_MS);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        // D5 17 Status
+        if (resp_len < 2 || resp[0] != PN532_CMD_POWERDOWN + 1)
+        {
+                return -EINVAL;
+        }
+
+        ret = pn532_status_error(resp[1]);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        pn532_asleep = true;
+        pn532_sleep_wake = wake;
+
+        if (transport->suspend)
+        {
+                ret = transport->suspend();
+                if (ret != 0)
+                {
+                        LOG_WRN("Bus suspend failed: %d", ret);
+                }
+        }
+
+        LOG_DBG("PN532 powered down, wake 0x%02X", cmd[1]);
+        return 0;
+}
+
+int pn532_wake_up(void)
+{
+        int ret;
+
+        if (!pn532_asleep)
+        {
+                return 0;
+        }
+
+        // The IRQ edge of a host wake-up is not news to anyone
+        pn532_notify_ready(NULL);
+
+        if (transport->resume)
+        {
+                ret = transport->resume();
+                if (ret != 0)
+                {
+                        LOG_ERR("Bus resume failed: %d", ret);
+                        return ret;
+                }
+        }
+
+        ret = transport->wakeup();
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        k_sleep(K_MSEC(PN532_POWERDOWN_WAKE_MS));
+        pn532_asleep = false;
+        return 0;
+}
+
+bool pn532_powered_down(void)
+{
+        return pn532_asleep;
+}
+
+/* ==================== Init ==================== */
+
+static int pn532_reset(uint16_t pulse_ms, uint16_t settle_ms)
+{
+        LOG_INF("Resetting PN532...");
+        gpio_pin_set_dt(&pn532_rst, 0);
+        k_sleep(K_MSEC(pulse_ms));
+        gpio_pin_set_dt(&pn532_rst, 1);
+        k_sleep(K_MSEC(settle_ms));
+        return 0;
+}
+
+/* One GetFirmwareVersion round trip at the current address */
+static int pn532_get_firmware(struct pn532_id *id, uint16_t timeout_ms)
+{
+        uint8_t *cmd = pn532_command_buffer();
+        const uint8_t *resp;
+        uint16_t resp_len;
+        int ret;
+
+        cmd[0] = PN532_CMD_GETFIRMWAREVERSION;
+        ret = pn532_write_command(1);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        ret = pn532_read_response(&resp, &resp_len, timeout_ms);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        // D5 03 IC Ver Rev Support
+        if (resp_len < 4 || resp[0] != PN532_CMD_GETFIRMWAREVERSION + 1)
+        {
+                return -EINVAL;
+        }
+
+        id->ic = resp[1];
+        id->ver = resp[2];
+        id->rev = resp[3];
+        return 0;
+}
+
+/* ==================== Fast Boot ==================== */
+
+#if defined(CONFIG_PN532_FAST_BOOT)
+static int pn532_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                              void *cb_arg)
+{
+        if (!settings_name_steq(name, "id", NULL))
+        {
+                return -ENOENT;
+        }
+
+        if (len != sizeof(pn532_cached_id) ||
+            read_cb(cb_arg, &pn532_cached_id, sizeof(pn532_cached_id)) != sizeof(pn532_cached_id))
+        {
+                return -EINVAL;
+        }
+
+        pn532_cached_valid = true;
+        return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(pn532, "pn532", NULL, pn532_settings_set, NULL, NULL);
+
+static void pn532_cache_store(const struct pn532_id *id)
+{
+        int ret;
+
+        if (pn532_cached_valid && memcmp(id, &pn532_cached_id, sizeof(*id)) == 0)
+        {
+                return;
+        }
+
+        ret = settings_save_one("pn532/id", id, sizeof(*id));
+        if (ret != 0)
+        {
+                LOG_WRN("Could not cache PN532 address: %d", ret);
+                return;
+        }
+
+        pn532_cached_id = *id;
+        pn532_cached_valid = true;
+}
+
+/*
+ * Short reset and a single GetFirmwareVersion at the cached address. Any
+ * failure drops back to the full probe, which refreshes the cache.
+ */
+static bool pn532_probe_cached(struct pn532_id *id)
+{
+        int ret;
+
+        if (!pn532_cached_valid)
+        {
+                return false;
+        }
+
+        pn532_reset(PN532_FAST_RESET_PULSE_MS, PN532_FAST_RESET_SETTLE_MS);
+
+        if (transport->set_address)
+        {
+                transport->set_address(pn532_cached_id.addr);
+        }
+        transport->wakeup();
+        k_sleep(K_MSEC(PN532_WAKEUP_MS));
+
+        ret = pn532_get_firmware(id, PN532_FAST_PROBE_TIMEOUT_MS);
+        if (ret != 0)
+        {
+                LOG_WRN("No PN532 at cached address 0x%02X (%d), full probe",
+                        pn532_cached_id.addr, ret);
+                return false;
+        }
+
+        id->addr = pn532_cached_id.addr;
+        return true;
+}
+#else
+static void pn532_cache_store(const struct pn532_id *id)
+{
+}
+
+static bool pn532_probe_cached(struct pn532_id *id)
+{
+        return false;
+}
+#endif
+
+const char *pn532_transport_name(void)
+{
+        return transport->name;
+}
+
+int pn532_hw_init(void)
+{
+        int ret;
+
+        if (!gpio_is_ready_dt(&pn532_rst))
+        {
+                LOG_ERR("PN532 RST GPIO not ready");
+                return -ENODEV;
+        }
+
+        gpio_pin_configure_dt(&pn532_rst, GPIO_OUTPUT_ACTIVE);
+        pn532_irq_setup();
+
+        ret = transport->init();
+        if (ret != 0)
+        {
+                LOG_ERR("PN532 %s transport init failed: %d", transport->name, ret);
+                return ret;
+        }
+
+        LOG_INF("PN532 transport: %s", transport->name);
+        return 0;
+}
+
+/* Hard reset, then try both I2C addresses with retries (like Arduino library) */
+static int pn532_probe_all(struct pn532_id *id)
+{
+        static const uint8_t addresses[] = {0x24, 0x48};
+        int num_addresses = transport->set_address ? ARRAY_SIZE(addresses) : 1;
+        int ret;
+
+        ret = pn532_reset(PN532_RESET_PULSE_MS, PN532_RESET_SETTLE_MS);
+        if (ret != 0)
+        {
+                LOG_ERR("Reset failed");
+                return ret;
+        }
+
+        for (int addr_idx = 0; addr_idx < num_addresses; addr_idx++)
+        {
+                id->addr = 0;
+                if (transport->set_address)
+                {
+                        id->addr = addresses[addr_idx];
+                        transport->set_address(id->addr);
+                        LOG_INF("Trying PN532 at address 0x%02X...", id->addr);
+                }
+
+                // Wakeup sequence
+                ret = transport->wakeup();
+                if (ret != 0)
+                {
+                        LOG_WRN("Wakeup write failed: %d", ret);
+                }
+                k_sleep(K_MSEC(PN532_WAKEUP_MS));
+
+                // Try to get firmware version with retries
+                for (int retry = 0; retry < PN532_PROBE_ATTEMPTS; retry++)
+                {
+                        LOG_INF("  Attempt %d/%d", retry + 1, PN532_PROBE_ATTEMPTS);
+
+                        ret = pn532_get_firmware(id, PN532_PROBE_TIMEOUT_MS);
+                        if (ret == 0)
+                        {
+                                return 0;
+                        }
+
+                        LOG_WRN("  Probe failed: %d", ret);
+                        k_sleep(K_MSEC(PN532_PROBE_RETRY_MS));
+                }
+        }
+
+        LOG_ERR("PN532 not found over %s", transport->name);
+        LOG_ERR("Check:");
+        LOG_ERR("  1. PN532 power (VCC = 3.3V)");
+        LOG_ERR("  2. PN532 mode switches (I2C: SEL0=OFF SEL1=ON, SPI: SEL0=ON SEL1=OFF,"
+                " HSU: both OFF)");
+        LOG_ERR("  3. Wiring (bus and IRQ connections)");
+        return -ENODEV;
+}
+
+int pn532_init(void)
+{
+        struct pn532_id id;
+        int ret;
+        uint8_t *cmd;
+        const uint8_t *resp;
+        uint16_t resp_len;
+
+        LOG_INF("Initializing PN532 (Arduino style)...");
+        pn532_asleep = false; // Both probes start with a hard reset
+
+        if (!pn532_probe_cached(&id))
+        {
+                ret = pn532_probe_all(&id);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+        }
+
+        LOG_INF("✓✓✓ PN532 FOUND over %s! ✓✓✓", transport->name);
+        LOG_INF("Firmware: PN5%02X v%u.%u", id.ic, id.ver, id.rev);
+        pn532_cache_store(&id);
+
+        // Configure SAM (like Arduino)
+        LOG_INF("Configuring SAM...");
+        cmd = pn532_command_buffer();
+        cmd[0] = PN532_CMD_SAMCONFIGURATION;
+        cmd[1] = 0x01; // Normal mode
+        cmd[2] = 0x14; // Timeout 50ms * 20 = 1 second
+        cmd[3] = 0x01; // Use IRQ pin
+
+        ret = pn532_write_command(4);
+        if (ret != 0)
+        {
+                LOG_ERR("SAM config write failed");
+                return ret;
+        }
+
+        ret = pn532_read_response(&resp, &resp_len, 1000);
+        if (ret != 0)
+        {
+                LOG_ERR("SAM config response failed");
+                return ret;
+        }
+
+        LOG_INF("✓ PN532 initialized successfully!");
+        return 0;
+}
+
+/* ==================== Benchmark ==================== */
+
+#if defined(CONFIG_PN532_POWER_BENCHMARK)
+#define PN532_BENCH_DWELL_MS 5000
+#define PN532_BENCH_ROUNDS 20
+#define PN532_BENCH_SLEEP_MS 20
+
+void pn532_power_benchmark(void)
+{
+        struct pn532_id id;
+        uint32_t total_us = 0;
+        uint32_t max_us = 0;
+        int rounds = 0;
+        int ret;
+
+        // Current is read off a power analyser (e.g. PPK2), one window per state
+        LOG_INF("=== PN532 Power Benchmark ===");
+        LOG_INF("[1/3] Idle, RF field off: %u ms", PN532_BENCH_DWELL_MS);
+        pn532_rf_field(false);
+        k_sleep(K_MSEC(PN532_BENCH_DWELL_MS));
+
+        LOG_INF("[2/3] RF field on: %u ms", PN532_BENCH_DWELL_MS);
+        pn532_rf_field(true);
+        k_sleep(K_MSEC(PN532_BENCH_DWELL_MS));
+        pn532_rf_field(false);
+
+        LOG_INF("[3/3] PowerDown, bus suspended: %u ms", PN532_BENCH_DWELL_MS);
+        ret = pn532_power_down(PN532_WAKE_RF);
+        if (ret != 0)
+        {
+                LOG_ERR("PowerDown failed: %d", ret);
+                return;
+        }
+        k_sleep(K_MSEC(PN532_BENCH_DWELL_MS));
+
+        // Wake-up latency: host wake-up sequence to the first command answered
+        for (; rounds < PN532_BENCH_ROUNDS; rounds++)
+        {
+                ret = pn532_power_down(0);
+                if (ret != 0)
+                {
+                        break;
+                }
+                k_sleep(K_MSEC(PN532_BENCH_SLEEP_MS));
+
+                uint32_t start = k_cycle_get_32();
+
+                ret = pn532_wake_up();
+                if (ret == 0)
+                {
+                        ret = pn532_get_firmware(&id, PN532_FAST_PROBE_TIMEOUT_MS);
+                }
+
+                uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+                if (ret != 0)
+                {
+                        break;
+                }
+
+                total_us += us;
+                max_us = MAX(max_us, us);
+        }
+
+        pn532_wake_up();
+
+        if (rounds == 0)
+        {
+                LOG_ERR("Wake-up benchmark failed: %d", ret);
+                return;
+        }
+
+        LOG_INF("Wake-up to first response: avg %u us, max %u us (%d rounds)",
+                total_us / rounds, max_us, rounds);
+}
+#endif
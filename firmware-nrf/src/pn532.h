@@ -0,0 +1,183 @@
+/**
+ * @file pn532.h
+ * @brief PN532 command layer: framing, response wait and init
+ */
+
+#ifndef PN532_H_
+#define PN532_H_
+
+#include <zephyr/kernel.h>
+
+/* PN532 Commands */
+#define PN532_CMD_GETFIRMWAREVERSION 0x02
+#define PN532_CMD_SAMCONFIGURATION 0x14
+#define PN532_CMD_INLISTPASSIVETARGET 0x4A
+#define PN532_CMD_INDATAEXCHANGE 0x40
+#define PN532_CMD_INAUTOPOLL 0x60
+#define PN532_CMD_INPSL 0x4E
+#define PN532_CMD_RFCONFIGURATION 0x32
+#define PN532_CMD_DIAGNOSE 0x00
+#define PN532_CMD_POWERDOWN 0x16
+
+/* ISO14443A Types */
+#define PN532_MIFARE_ISO14443A 0x00
+
+/* InAutoPoll target types */
+#define PN532_TARGET_ISO14443A 0x20 // Passive 106 kbps ISO/IEC 14443-4 Type A
+#define PN532_TARGET_ISO14443B 0x23 // Passive 106 kbps ISO/IEC 14443-4 Type B
+#define PN532_AUTOPOLL_ENDLESS 0xFF
+
+/* PowerDown wake-up sources on top of the host interface (WakeUpEnable) */
+#define PN532_WAKE_RF BIT(3) // External RF field (RF level detector)
+
+/* InDataExchange DataOut/DataIn limit (APDU, or card response including SW1 SW2) */
+#define PN532_EXCHANGE_MAX 262
+
+/* RF bit rates (InPSL BRit/BRti) */
+#define PN532_BR_106 0x00
+#define PN532_BR_212 0x01
+#define PN532_BR_424 0x02
+#define PN532_BR_COUNT 3
+
+struct pn532_target
+{
+        uint8_t tg;
+        uint8_t type;
+        uint8_t uid[10];
+        uint8_t uid_len;
+        uint8_t bitrate_caps; // TA(1) / ATQB protocol info, 0 = 106 kbps only
+};
+
+struct pn532_rf_stats
+{
+        uint32_t sessions[PN532_BR_COUNT];  // Sessions run at each rate
+        uint32_t exchanges[PN532_BR_COUNT]; // InDataExchange calls per rate
+        uint32_t errors[PN532_BR_COUNT];    // RF timeout/CRC errors (-ECOMM, PSL too) per rate
+        uint32_t fallbacks;                 // Sessions dropped back to 106 kbps
+};
+
+struct pn532_autopoll_cfg
+{
+        uint8_t polls;  // Passes over all types, 0 = endless
+        uint8_t period; // 150 ms units, 1..15
+        uint8_t num_types;
+        uint8_t types[4];
+};
+
+/* Configure the IRQ/RST lines and the selected host interface */
+int pn532_hw_init(void);
+
+/* Hard reset, probe and SAM configuration */
+int pn532_init(void);
+
+const char *pn532_transport_name(void);
+
+/*
+ * Command bytes are built directly in the TX frame, after the space
+ * reserved for the header, so no copy is needed before the transfer.
+ * Waits for a previous frame still in flight before handing it out.
+ */
+uint8_t *pn532_command_buffer(void);
+
+/*
+ * Frame the cmd_len bytes in pn532_command_buffer() and start sending.
+ * Returns as soon as the transfer is queued; pn532_read_response() picks
+ * up the write result, so the caller can do other work in between.
+ */
+int pn532_write_command(uint16_t cmd_len);
+
+/*
+ * Wait for the ACK and the response frame, bounded by timeout_ms.
+ * On success *resp points into the RX frame (after the TFI) and stays
+ * valid until the next command is sent.
+ */
+int pn532_read_response(const uint8_t **resp, uint16_t *resp_len, uint16_t timeout_ms);
+
+/* Frame and send a command, returning once the PN532 has ACKed it */
+int pn532_send_command(uint16_t cmd_len);
+
+/*
+ * Wait up to timeout_ms for the response of a command already ACKed by
+ * pn532_send_command(). -ETIMEDOUT leaves the command pending, so this
+ * can be called again to keep waiting.
+ */
+int pn532_receive(const uint8_t **resp, uint16_t *resp_len, uint16_t timeout_ms);
+
+/* Abort the command in progress (e.g. an endless InAutoPoll) */
+int pn532_abort(void);
+
+/*
+ * Start endless InAutoPoll over cfg->types. The PN532 raises IRQ as soon
+ * as a target answers, so pn532_autopoll_wait() returns within one RF
+ * poll period of a card being presented.
+ */
+int pn532_autopoll_start(const struct pn532_autopoll_cfg *cfg);
+int pn532_autopoll_wait(struct pn532_target *target, uint16_t timeout_ms);
+
+/*
+ * Have cb called once, from the IRQ handler, when the PN532 next signals a
+ * pending frame, so a caller can sleep until e.g. InAutoPoll finds a card
+ * and then collect it with a zero timeout. NULL cancels the hook.
+ * Returns -ENOTSUP when the IRQ line is not wired; the caller has to poll.
+ */
+typedef void (*pn532_ready_cb_t)(void);
+int pn532_notify_ready(pn532_ready_cb_t cb);
+
+/* Decode InListPassiveTarget / InAutoPoll target data of the given type */
+int pn532_decode_target(uint8_t type, const uint8_t *data, uint16_t len,
+                        struct pn532_target *target);
+
+/*
+ * Switch an activated ISO14443-4 target to the fastest rate both sides
+ * support, capped at max (PN532_BR_*). Returns the rate in use; a refused
+ * PPS leaves the session at 106 kbps.
+ */
+int pn532_negotiate_bitrate(const struct pn532_target *target, uint8_t max);
+uint8_t pn532_bitrate(void);
+uint16_t pn532_bitrate_kbps(uint8_t bitrate);
+
+/*
+ * Give up on the negotiated rate: power-cycle the RF field so the card
+ * can be activated again and stay at 106 kbps.
+ */
+int pn532_bitrate_fallback(void);
+
+int pn532_rf_field(bool on);
+
+/*
+ * ISO14443-4 presence check on the activated target (Diagnose, attention
+ * request test). Returns 1 while the card answers, 0 once it is gone.
+ */
+int pn532_target_present(void);
+
+void pn532_rf_stats_get(struct pn532_rf_stats *stats);
+
+/*
+ * PowerDown: the PN532 sleeps until the host interface (or one of the
+ * PN532_WAKE_* sources in wake) wakes it, and pulls IRQ low when it does,
+ * so pn532_notify_ready() sees an RF wake-up. The bus is suspended until
+ * pn532_wake_up(). Calling it again with other wake sources re-arms them.
+ */
+int pn532_power_down(uint8_t wake);
+int pn532_wake_up(void);
+bool pn532_powered_down(void);
+
+#if defined(CONFIG_PN532_POWER_BENCHMARK)
+/* Hold each power state for a power analyser, then time PowerDown wake-ups */
+void pn532_power_benchmark(void);
+#endif
+
+/*
+ * InDataExchange. The APDU is built in place at pn532_exchange_buffer(),
+ * which holds up to PN532_EXCHANGE_MAX bytes. On success resp points at
+ * the card response (after the status byte) and may be modified in place.
+ * RF timeouts and CRC/framing errors reported by the PN532 return -ECOMM;
+ * host-side timeouts and frame errors keep -ETIMEDOUT and -EBADMSG.
+ * expect_len is the response length the card should send (SW included,
+ * 0 if unknown); over I2C it lets a long response arrive in one read.
+ */
+uint8_t *pn532_exchange_buffer(void);
+int pn532_exchange(uint8_t tg, uint16_t len, uint16_t expect_len, uint8_t **resp,
+                   uint16_t *resp_len, uint16_t timeout_ms);
+
+#endif /* PN532_H_ */
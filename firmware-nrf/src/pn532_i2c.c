@@ -0,0 +1,296 @@
+/**
+ * @file pn532_i2c.c
+ * @brief Asynchronous I2C transport for the PN532 (TWIM EasyDMA)
+ *
+ * Transfers are started with i2c_transfer_cb() so the TWIM moves the
+ * caller's buffer by EasyDMA while the submitting thread carries on.
+ * Drivers without the callback API (or builds without CONFIG_I2C_CALLBACK)
+ * run the same blocking transfer on a dedicated work queue instead, so the
+ * caller sees identical async semantics either way.
+ *
+ * Every I2C read starts with a status byte (0x01 = ready), and the PN532
+ * restarts the frame on each read transaction.
+ */
+
+#include "pn532_transport.h"
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device.h>
+
+LOG_MODULE_REGISTER(pn532_i2c, LOG_LEVEL_INF);
+
+#define PN532_I2C_NODE DT_NODELABEL(i2c0)
+#define PN532_I2C_DEFAULT_ADDR 0x24
+#define PN532_I2C_READY 0x01
+#define PN532_I2C_XFER_TIMEOUT_MS 100
+#define PN532_I2C_SHORT_FRAME 32 // First read: whole status replies and short R-APDUs
+#define PN532_I2C_WORKQ_STACK_SIZE 1024
+#define PN532_I2C_WORKQ_PRIORITY K_PRIO_COOP(7)
+
+BUILD_ASSERT(PN532_I2C_SHORT_FRAME >= PN532_EXT_HEADER_LEN, "First read must cover the header");
+
+/* Completion callback, may run in ISR context */
+typedef void (*pn532_i2c_done_t)(int result, void *user_data);
+
+/* ==================== Global Variables ==================== */
+static const struct device *i2c_bus = DEVICE_DT_GET(PN532_I2C_NODE);
+static uint16_t i2c_address = PN532_I2C_DEFAULT_ADDR;
+static uint8_t status_byte;
+
+/* In-flight transfer; the message must outlive the submitting call */
+static struct i2c_msg xfer_msg;
+static pn532_i2c_done_t xfer_cb;
+static void *xfer_user_data;
+static int xfer_result;
+static K_SEM_DEFINE(xfer_idle, 1, 1);
+
+/* Fallback for drivers without i2c_transfer_cb() */
+static K_THREAD_STACK_DEFINE(xfer_workq_stack, PN532_I2C_WORKQ_STACK_SIZE);
+static struct k_work_q xfer_workq;
+static struct k_work xfer_work;
+
+/* ==================== Transfer Engine ==================== */
+
+static void xfer_complete(const struct device *dev, int result, void *data)
+{
+        pn532_i2c_done_t cb = xfer_cb;
+        void *user_data = xfer_user_data;
+
+        xfer_result = result;
+        k_sem_give(&xfer_idle);
+
+        if (cb)
+        {
+                cb(result, user_data);
+        }
+}
+
+static void xfer_work_handler(struct k_work *work)
+{
+        int ret = i2c_transfer(i2c_bus, &xfer_msg, 1, i2c_address);
+
+        xfer_complete(i2c_bus, ret, NULL);
+}
+
+/* Start a transfer and return immediately; waits for a previous one first */
+static int xfer_submit(uint8_t flags, uint8_t *buf, uint16_t len,
+                       pn532_i2c_done_t cb, void *user_data)
+{
+        if (k_sem_take(&xfer_idle, K_MSEC(PN532_I2C_XFER_TIMEOUT_MS)) != 0)
+        {
+                LOG_WRN("Previous transfer still in flight");
+                return -EBUSY;
+        }
+
+        xfer_msg.buf = buf;
+        xfer_msg.len = len;
+        xfer_msg.flags = flags | I2C_MSG_STOP;
+        xfer_cb = cb;
+        xfer_user_data = user_data;
+
+#if defined(CONFIG_I2C_CALLBACK)
+        int ret = i2c_transfer_cb(i2c_bus, &xfer_msg, 1, i2c_address, xfer_complete, NULL);
+
+        if (ret != -ENOSYS)
+        {
+                if (ret != 0)
+                {
+                        xfer_result = ret;
+                        k_sem_give(&xfer_idle);
+                }
+                return ret;
+        }
+#endif
+
+        k_work_submit_to_queue(&xfer_workq, &xfer_work);
+        return 0;
+}
+
+/* Wait for the in-flight transfer (if any) and return its result */
+static int xfer_flush(k_timeout_t timeout)
+{
+        int result;
+
+        if (k_sem_take(&xfer_idle, timeout) != 0)
+        {
+                return -ETIMEDOUT;
+        }
+
+        result = xfer_result;
+        k_sem_give(&xfer_idle);
+
+        return result;
+}
+
+static int xfer_sync(uint8_t flags, uint8_t *buf, uint16_t len)
+{
+        int ret = xfer_submit(flags, buf, len, NULL, NULL);
+
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return xfer_flush(K_MSEC(PN532_I2C_XFER_TIMEOUT_MS));
+}
+
+/* ==================== Transport Operations ==================== */
+
+static int i2c_transport_init(void)
+{
+        if (!device_is_ready(i2c_bus))
+        {
+                LOG_ERR("I2C bus not ready");
+                return -ENODEV;
+        }
+
+        k_work_init(&xfer_work, xfer_work_handler);
+        k_work_queue_start(&xfer_workq, xfer_workq_stack,
+                           K_THREAD_STACK_SIZEOF(xfer_workq_stack),
+                           PN532_I2C_WORKQ_PRIORITY, NULL);
+        k_thread_name_set(&xfer_workq.thread, "pn532_i2c");
+
+        return 0;
+}
+
+static void i2c_transport_set_address(uint16_t addr)
+{
+        xfer_flush(K_MSEC(PN532_I2C_XFER_TIMEOUT_MS));
+        i2c_address = addr;
+}
+
+static int i2c_transport_wakeup(void)
+{
+        // Send wakeup sequence (like Arduino library)
+        static uint8_t wake_cmd[] = {0x55, 0x55, 0x00, 0x00, 0x00};
+
+        return xfer_sync(I2C_MSG_WRITE, wake_cmd, sizeof(wake_cmd));
+}
+
+static int i2c_transport_write(uint8_t *frame, uint16_t len)
+{
+        return xfer_submit(I2C_MSG_WRITE, frame, len, NULL, NULL);
+}
+
+static int i2c_transport_poll_ready(void)
+{
+        int ret = xfer_sync(I2C_MSG_READ, &status_byte, 1);
+
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return status_byte == PN532_I2C_READY;
+}
+
+/* The status byte lands in the headroom in front of buf */
+static int i2c_transport_read(uint8_t *buf, uint16_t len)
+{
+        int ret = xfer_sync(I2C_MSG_READ, buf - 1, len + 1);
+
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return buf[-1] == PN532_I2C_READY ? 0 : -EAGAIN;
+}
+
+/*
+ * Read the expected frame, or the header plus a short tail when the
+ * caller does not know the length; most frames are done in one
+ * transaction. Only a frame longer than that takes a second phase: ask
+ * the PN532 to resend it (NACK), then read exactly the frame size.
+ * Cheaper than always clocking a worst-case sized frame over the bus.
+ */
+static int i2c_transport_read_frame(uint8_t *buf, uint16_t size, uint16_t expect,
+                                    pn532_frame_len_t frame_len, pn532_wait_t wait)
+{
+        static uint8_t nack[] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00}; // RAM for DMA
+        uint16_t first = MIN(size, MAX(expect, PN532_I2C_SHORT_FRAME));
+        int total;
+        int ret;
+
+        // Phase 1: status byte + the expected frame, at least a header and a short tail
+        ret = i2c_transport_read(buf, first);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        total = frame_len(buf);
+        if (total < 0)
+        {
+                return total;
+        }
+        if (total > size)
+        {
+                return -ENOBUFS;
+        }
+        if (total <= first)
+        {
+                return total;
+        }
+
+        // Phase 2: request retransmission and read exactly the frame
+        ret = xfer_sync(I2C_MSG_WRITE, nack, sizeof(nack));
+        if (ret != 0)
+        {
+                LOG_ERR("NACK write failed: %d", ret);
+                return ret;
+        }
+
+        ret = wait();
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        ret = i2c_transport_read(buf, total);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        return total;
+}
+
+#if defined(CONFIG_PM_DEVICE)
+/* The TWIM switches to the i2c0_sleep pinctrl state while suspended */
+static int i2c_transport_suspend(void)
+{
+        int ret;
+
+        xfer_flush(K_MSEC(PN532_I2C_XFER_TIMEOUT_MS));
+        ret = pm_device_action_run(i2c_bus, PM_DEVICE_ACTION_SUSPEND);
+
+        return ret == -EALREADY ? 0 : ret;
+}
+
+static int i2c_transport_resume(void)
+{
+        int ret = pm_device_action_run(i2c_bus, PM_DEVICE_ACTION_RESUME);
+
+        return ret == -EALREADY ? 0 : ret;
+}
+#endif
+
+const struct pn532_transport pn532_transport_i2c = {
+    .name = "I2C",
+    .init = i2c_transport_init,
+    .set_address = i2c_transport_set_address,
+    .wakeup = i2c_transport_wakeup,
+    .write = i2c_transport_write,
+    .flush = xfer_flush,
+    .poll_ready = i2c_transport_poll_ready,
+    .read = i2c_transport_read,
+    .read_frame = i2c_transport_read_frame,
+#if defined(CONFIG_PM_DEVICE)
+    .suspend = i2c_transport_suspend,
+    .resume = i2c_transport_resume,
+#endif
+};
@@ -0,0 +1,79 @@
+/**
+ * @file pn532_transport.h
+ * @brief PN532 host interface backends (I2C, SPI, HSU)
+ *
+ * Backends only move bytes; framing and checksums live in pn532.c and are
+ * shared by all of them. The backend is selected with the
+ * CONFIG_PN532_TRANSPORT choice, which defaults from the devicetree
+ * compatible (nxp,pn532-spi / nxp,pn532-uart, otherwise I2C).
+ */
+
+#ifndef PN532_TRANSPORT_H_
+#define PN532_TRANSPORT_H_
+
+#include <zephyr/kernel.h>
+
+/* Frame layout needed by the backends */
+#define PN532_NORMAL_HEADER_LEN 5 // 00 00 FF LEN LCS
+#define PN532_EXT_HEADER_LEN 8    // 00 00 FF FF FF LENM LENL LCS
+#define PN532_FRAME_MAX_DATA 265  // TFI + PD0..PDn, PN532 extended frame limit
+#define PN532_FRAME_MAX (PN532_EXT_HEADER_LEN + PN532_FRAME_MAX_DATA + 2)
+
+/*
+ * Frame buffers handed to write(), read() and read_frame() have this many
+ * writable bytes in front of them, so backends can place a bus prefix
+ * (I2C status byte, SPI DW/DR opcode) without copying the frame.
+ */
+#define PN532_FRAME_HEADROOM 1
+
+/* Returns the total frame length for a header, or a negative errno */
+typedef int (*pn532_frame_len_t)(const uint8_t *hdr);
+
+/* Blocks until the PN532 signals a pending frame (bounded by the command deadline) */
+typedef int (*pn532_wait_t)(void);
+
+struct pn532_transport
+{
+        const char *name;
+
+        int (*init)(void);
+
+        /* I2C only: select the slave address to probe (NULL otherwise) */
+        void (*set_address)(uint16_t addr);
+
+        /* Bring the PN532 out of power-down / low-VBAT state */
+        int (*wakeup)(void);
+
+        /* Start sending a frame; the buffer must stay untouched until flush() */
+        int (*write)(uint8_t *frame, uint16_t len);
+
+        /* Wait for the last write to complete and return its result */
+        int (*flush)(k_timeout_t timeout);
+
+        /* 1 if a frame is pending, 0 if not, negative errno on bus error */
+        int (*poll_ready)(void);
+
+        /* Read len bytes of a pending fixed-size frame (ACK) */
+        int (*read)(uint8_t *buf, uint16_t len);
+
+        /*
+         * Read one whole frame into buf: at least PN532_EXT_HEADER_LEN
+         * header bytes first, then the remainder reported by frame_len()
+         * if the first read did not already cover it. expect is the frame
+         * length the caller expects (0 if unknown), so a backend that has
+         * to size its first read can cover the whole frame. Returns the
+         * frame length read.
+         */
+        int (*read_frame)(uint8_t *buf, uint16_t size, uint16_t expect,
+                          pn532_frame_len_t frame_len, pn532_wait_t wait);
+
+        /* Park the bus while the PN532 is in PowerDown (NULL if there is nothing to do) */
+        int (*suspend)(void);
+        int (*resume)(void);
+};
+
+extern const struct pn532_transport pn532_transport_i2c;
+extern const struct pn532_transport pn532_transport_spi;
+extern const struct pn532_transport pn532_transport_uart;
+
+#endif /* PN532_TRANSPORT_H_ */
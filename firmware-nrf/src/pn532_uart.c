@@ -0,0 +1,177 @@
+/**
+ * @file pn532_uart.c
+ * @brief HSU (high speed UART) transport for the PN532
+ *
+ * Received bytes are collected by the UART RX interrupt into a ring
+ * buffer. The frame stream has no status byte, so a frame is pending as
+ * soon as bytes are buffered; the header and the remainder are taken
+ * from the stream back to back.
+ */
+
+#include "pn532_transport.h"
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(pn532_uart, LOG_LEVEL_INF);
+
+#define PN532_UART_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(nxp_pn532_uart)
+#define PN532_UART_RX_BUF_SIZE 512
+#define PN532_UART_BYTE_TIMEOUT_MS 20
+
+/* ==================== Global Variables ==================== */
+static const struct device *uart_dev = DEVICE_DT_GET(DT_BUS(PN532_UART_NODE));
+
+RING_BUF_DECLARE(uart_rx_ring, PN532_UART_RX_BUF_SIZE);
+static K_SEM_DEFINE(uart_rx_sem, 0, 1);
+
+/* ==================== RX Interrupt ==================== */
+
+static void uart_isr(const struct device *dev, void *user_data)
+{
+        uint8_t chunk[16];
+
+        while (uart_irq_update(dev) && uart_irq_rx_ready(dev))
+        {
+                int n = uart_fifo_read(dev, chunk, sizeof(chunk));
+
+                if (n <= 0)
+                {
+                        break;
+                }
+
+                if (ring_buf_put(&uart_rx_ring, chunk, n) < n)
+                {
+                        LOG_WRN("RX ring overflow");
+                }
+                k_sem_give(&uart_rx_sem);
+        }
+}
+
+/* Take exactly len bytes from the stream, waiting for stragglers */
+static int uart_rx(uint8_t *buf, uint16_t len)
+{
+        uint16_t got = 0;
+
+        while (got < len)
+        {
+                got += ring_buf_get(&uart_rx_ring, buf + got, len - got);
+                if (got < len &&
+                    k_sem_take(&uart_rx_sem, K_MSEC(PN532_UART_BYTE_TIMEOUT_MS)) != 0)
+                {
+                        return -ETIMEDOUT;
+                }
+        }
+
+        return 0;
+}
+
+/* ==================== Transport Operations ==================== */
+
+static int uart_transport_init(void)
+{
+        if (!device_is_ready(uart_dev))
+        {
+                LOG_ERR("UART not ready");
+                return -ENODEV;
+        }
+
+        uart_irq_callback_user_data_set(uart_dev, uart_isr, NULL);
+        uart_irq_rx_enable(uart_dev);
+
+        return 0;
+}
+
+static int uart_transport_send(const uint8_t *buf, uint16_t len)
+{
+        for (uint16_t i = 0; i < len; i++)
+        {
+                uart_poll_out(uart_dev, buf[i]);
+        }
+
+        return 0;
+}
+
+static int uart_transport_wakeup(void)
+{
+        // HSU wakeup: long preamble of 0x55 followed by zeros
+        static const uint8_t wake_cmd[] = {0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                           0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+        ring_buf_reset(&uart_rx_ring);
+        return uart_transport_send(wake_cmd, sizeof(wake_cmd));
+}
+
+static int uart_transport_write(uint8_t *frame, uint16_t len)
+{
+        // Drop anything left over from an aborted exchange
+        ring_buf_reset(&uart_rx_ring);
+        k_sem_reset(&uart_rx_sem);
+
+        return uart_transport_send(frame, len);
+}
+
+static int uart_transport_flush(k_timeout_t timeout)
+{
+        return 0;
+}
+
+static int uart_transport_poll_ready(void)
+{
+        return ring_buf_is_empty(&uart_rx_ring) ? 0 : 1;
+}
+
+static int uart_transport_read(uint8_t *buf, uint16_t len)
+{
+        return uart_rx(buf, len);
+}
+
+/* The UART hands over the frame as it arrives, expect is not needed */
+static int uart_transport_read_frame(uint8_t *buf, uint16_t size, uint16_t expect,
+                                     pn532_frame_len_t frame_len, pn532_wait_t wait)
+{
+        int total;
+        int ret;
+
+        ret = uart_rx(buf, PN532_EXT_HEADER_LEN);
+        if (ret != 0)
+        {
+                return ret;
+        }
+
+        total = frame_len(buf);
+        if (total < 0)
+        {
+                return total;
+        }
+        if (total > size)
+        {
+                return -ENOBUFS;
+        }
+
+        if (total > PN532_EXT_HEADER_LEN)
+        {
+                ret = uart_rx(buf + PN532_EXT_HEADER_LEN, total - PN532_EXT_HEADER_LEN);
+                if (ret != 0)
+                {
+                        return ret;
+                }
+        }
+
+        return total;
+}
+
+const struct pn532_transport pn532_transport_uart = {
+    .name = "HSU",
+    .init = uart_transport_init,
+    .set_address = NULL,
+    .wakeup = uart_transport_wakeup,
+    .write = uart_transport_write,
+    .flush = uart_transport_flush,
+    .poll_ready = uart_transport_poll_ready,
+    .read = uart_transport_read,
+    .read_frame = uart_transport_read_frame,
+};
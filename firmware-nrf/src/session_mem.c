@@ -0,0 +1,138 @@
+/**
+ * @file session_mem.c
+ * @brief Per-session memory: a bump arena plus fixed-block pools
+ *
+ * Everything a card session needs beyond the static driver buffers comes
+ * from here, so stack use stays flat and nothing fragments over thousands
+ * of sessions: the arena is rewound in one step when the session ends and
+ * the pools only ever hand out blocks of one size.
+ */
+
+#include "session_mem.h"
+
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "mrtd.h"
+#include "sm.h"
+
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+#include <mbedtls/memory_buffer_alloc.h>
+#endif
+
+LOG_MODULE_REGISTER(session_mem, LOG_LEVEL_INF);
+
+#define SESSION_ALIGN 8 // mbedTLS contexts hold 64-bit members
+
+static uint8_t __aligned(SESSION_ALIGN) arena[CONFIG_PASSPORT_SESSION_ARENA_SIZE];
+static size_t arena_used;
+static size_t arena_peak;
+static uint32_t sessions;
+
+K_MEM_SLAB_DEFINE_STATIC(ef_slab, ROUND_UP(MRTD_SMALL_EF_MAX, SESSION_ALIGN),
+                         CONFIG_PASSPORT_EF_POOL_BLOCKS, SESSION_ALIGN);
+K_MEM_SLAB_DEFINE_STATIC(crypto_slab, ROUND_UP(sizeof(struct sm_ctx), SESSION_ALIGN),
+                         CONFIG_PASSPORT_CRYPTO_POOL_BLOCKS, SESSION_ALIGN);
+
+static struct k_mem_slab *const pools[SESSION_POOL_COUNT] = {
+    [SESSION_POOL_EF] = &ef_slab,
+    [SESSION_POOL_CRYPTO] = &crypto_slab,
+};
+static uint32_t pool_peak[SESSION_POOL_COUNT];
+
+/* ==================== Arena ==================== */
+
+void *session_alloc(size_t size)
+{
+        size_t start = ROUND_UP(arena_used, SESSION_ALIGN);
+
+        if (size > sizeof(arena) - MIN(start, sizeof(arena)))
+        {
+                LOG_ERR("Session arena exhausted (%zu + %zu of %zu bytes)", start, size,
+                        sizeof(arena));
+                return NULL;
+        }
+
+        arena_used = start + size;
+        arena_peak = MAX(arena_peak, arena_used);
+        return &arena[start];
+}
+
+void session_reset(void)
+{
+        // Scratch may hold key material (PACE nonce, K_pi)
+        memset(arena, 0, arena_used);
+        arena_used = 0;
+}
+
+void session_finished(void)
+{
+        sessions++;
+}
+
+/* ==================== Pools ==================== */
+
+void *session_pool_alloc(enum session_pool pool)
+{
+        void *block;
+
+        if (k_mem_slab_alloc(pools[pool], &block, K_NO_WAIT) != 0)
+        {
+                LOG_ERR("Session pool %d exhausted", pool);
+                return NULL;
+        }
+
+        pool_peak[pool] = MAX(pool_peak[pool], k_mem_slab_num_used_get(pools[pool]));
+        return block;
+}
+
+void session_pool_free(enum session_pool pool, void *block)
+{
+        k_mem_slab_free(pools[pool], block);
+}
+
+/* ==================== Statistics ==================== */
+
+void session_mem_stats_get(struct session_mem_stats *stats)
+{
+        stats->sessions = sessions;
+        stats->arena_size = sizeof(arena);
+        stats->arena_peak = arena_peak;
+        for (int i = 0; i < SESSION_POOL_COUNT; i++)
+        {
+                stats->pool_blocks[i] = k_mem_slab_num_used_get(pools[i]) +
+                                        k_mem_slab_num_free_get(pools[i]);
+                stats->pool_peak[i] = pool_peak[i];
+        }
+}
+
+void session_mem_log(void)
+{
+        struct session_mem_stats stats;
+
+        session_mem_stats_get(&stats);
+        LOG_INF("Session memory after %u sessions:", stats.sessions);
+        LOG_INF("  Arena: %zu / %zu bytes", stats.arena_peak, stats.arena_size);
+        LOG_INF("  EF pool: %u / %u blocks", stats.pool_peak[SESSION_POOL_EF],
+                stats.pool_blocks[SESSION_POOL_EF]);
+        LOG_INF("  Crypto pool: %u / %u blocks", stats.pool_peak[SESSION_POOL_CRYPTO],
+                stats.pool_blocks[SESSION_POOL_CRYPTO]);
+
+#if defined(CONFIG_MBEDTLS_MEMORY_DEBUG)
+        size_t max_used;
+        size_t max_blocks;
+
+        mbedtls_memory_buffer_alloc_max_get(&max_used, &max_blocks);
+        LOG_INF("  mbedTLS heap: %zu / %u bytes (%zu blocks)", max_used,
+                CONFIG_MBEDTLS_HEAP_SIZE, max_blocks);
+#endif
+
+#if defined(CONFIG_THREAD_STACK_INFO) && defined(CONFIG_INIT_STACKS)
+        size_t unused;
+
+        if (k_thread_stack_space_get(k_current_get(), &unused) == 0)
+        {
+                LOG_INF("  Reader stack: %zu bytes never used", unused);
+        }
+#endif
+}
@@ -0,0 +1,56 @@
+/**
+ * @file session_mem.h
+ * @brief Per-session memory: a bump arena plus fixed-block pools
+ */
+
+#ifndef SESSION_MEM_H_
+#define SESSION_MEM_H_
+
+#include <zephyr/kernel.h>
+
+/* Fixed-block pools, one k_mem_slab each */
+enum session_pool
+{
+        SESSION_POOL_EF,     // MRTD_SMALL_EF_MAX file/APDU buffers
+        SESSION_POOL_CRYPTO, // struct sm_ctx (expanded key schedules)
+        SESSION_POOL_COUNT
+};
+
+struct session_mem_stats
+{
+        uint32_t sessions; // Finished documents, see session_finished()
+        size_t arena_size;
+        size_t arena_peak; // Highest arena use of any session
+        uint32_t pool_blocks[SESSION_POOL_COUNT];
+        uint32_t pool_peak[SESSION_POOL_COUNT];
+};
+
+/*
+ * Scratch memory that lives until session_reset(), e.g. the working state
+ * of a PACE handshake. Never freed on its own; returns NULL when the arena
+ * (CONFIG_PASSPORT_SESSION_ARENA_SIZE) is exhausted.
+ */
+void *session_alloc(size_t size);
+
+/* End of card session: drop every arena allocation at once */
+void session_reset(void);
+
+/*
+ * A document finished, read or failed. Counted here rather than in
+ * session_reset(), which also runs on RF fallback and RESET.
+ */
+void session_finished(void);
+
+/* One block from a pool, NULL if all are in use; does not wait */
+void *session_pool_alloc(enum session_pool pool);
+void session_pool_free(enum session_pool pool, void *block);
+
+void session_mem_stats_get(struct session_mem_stats *stats);
+
+/*
+ * Log the high-water marks (arena, pools, mbedTLS heap, and the reader
+ * stack with CONFIG_THREAD_STACK_INFO and CONFIG_INIT_STACKS)
+ */
+void session_mem_log(void);
+
+#endif /* SESSION_MEM_H_ */
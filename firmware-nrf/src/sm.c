@@ -0,0 +1,698 @@
+/**
+ * @file sm.c
+ * @brief ISO 7816-4 secure messaging for eMRTD (3DES for BAC, AES for PACE)
+ *
+ * Wrapping and unwrapping work in place on the APDU buffer. The command
+ * data is CBC-encrypted straight into its DO'87' slot a few bytes further
+ * on, carrying one block ahead so no input is overwritten before it is
+ * read; responses are decrypted the same way towards the buffer start.
+ * The MAC is fed piecewise (SSC, header, data objects) instead of
+ * assembling the padded MAC input in a second buffer. No heap is used.
+ */
+
+#include "sm.h"
+
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include <mbedtls/platform_util.h>
+
+LOG_MODULE_REGISTER(sm, LOG_LEVEL_DBG);
+
+#define SM_MAX_BLOCK 16
+
+/* Protected command/response data objects */
+#define SM_DO_CRYPTOGRAM 0x87
+#define SM_DO_LE 0x97
+#define SM_DO_STATUS 0x99
+#define SM_DO_MAC 0x8E
+#define SM_PADDING_INDICATOR 0x01
+
+#define SM_SW_OK 0x9000
+
+/* Incremental ISO 9797-1 MAC (retail MAC for 3DES, CMAC for AES) */
+struct sm_mac
+{
+        uint8_t x[SM_MAX_BLOCK];
+        uint8_t buf[SM_MAX_BLOCK];
+        uint8_t n;
+};
+
+/* ==================== Block Primitives ==================== */
+
+static void sm_block_encrypt(struct sm_ctx *sm, uint8_t *blk)
+{
+        if (sm->cipher == SM_CIPHER_3DES)
+        {
+                mbedtls_des3_crypt_ecb(&sm->des.enc, blk, blk);
+        }
+        else
+        {
+                mbedtls_aes_crypt_ecb(&sm->aes.enc, MBEDTLS_AES_ENCRYPT, blk, blk);
+        }
+}
+
+static void sm_block_decrypt(struct sm_ctx *sm, uint8_t *blk)
+{
+        if (sm->cipher == SM_CIPHER_3DES)
+        {
+                mbedtls_des3_crypt_ecb(&sm->des.dec, blk, blk);
+        }
+        else
+        {
+                mbedtls_aes_crypt_ecb(&sm->aes.dec, MBEDTLS_AES_DECRYPT, blk, blk);
+        }
+}
+
+static void sm_ssc_inc(struct sm_ctx *sm)
+{
+        for (int i = sm->block_size - 1; i >= 0; i--)
+        {
+                if (++sm->ssc[i] != 0)
+                {
+                        break;
+                }
+        }
+}
+
+/* 3DES (BAC) uses a zero IV, AES (PACE) uses E(KS_enc, SSC) */
+static void sm_iv(struct sm_ctx *sm, uint8_t *iv)
+{
+        if (sm->cipher == SM_CIPHER_3DES)
+        {
+                memset(iv, 0, sm->block_size);
+                return;
+        }
+
+        memcpy(iv, sm->ssc, sm->block_size);
+        sm_block_encrypt(sm, iv);
+}
+
+/* ==================== MAC ==================== */
+
+static void sm_mac_update(struct sm_ctx *sm, struct sm_mac *m, const uint8_t *data, size_t len)
+{
+        const uint8_t bs = sm->block_size;
+
+        while (len > 0)
+        {
+                // Keep the last block buffered: CMAC treats it differently
+                if (m->n == bs)
+                {
+                        for (int j = 0; j < bs; j++)
+                        {
+                                m->x[j] ^= m->buf[j];
+                        }
+
+                        if (sm->cipher == SM_CIPHER_3DES)
+                        {
+                                mbedtls_des_crypt_ecb(&sm->des.mac_k1, m->x, m->x);
+                        }
+                        else
+                        {
+                                mbedtls_aes_crypt_ecb(&sm->aes.mac, MBEDTLS_AES_ENCRYPT, m->x, m->x);
+                        }
+                        m->n = 0;
+                }
+
+                size_t take = MIN(bs - m->n, len);
+
+                memcpy(&m->buf[m->n], data, take);
+                m->n += take;
+                data += take;
+                len -= take;
+        }
+}
+
+/* ISO 9797-1 padding method 2 */
+static void sm_mac_pad(struct sm_ctx *sm, struct sm_mac *m)
+{
+        static const uint8_t pad = 0x80;
+
+        sm_mac_update(sm, m, &pad, 1);
+        memset(&m->buf[m->n], 0, sm->block_size - m->n);
+        m->n = sm->block_size;
+}
+
+static void sm_mac_final(struct sm_ctx *sm, struct sm_mac *m, uint8_t mac[SM_MAC_LEN])
+{
+        for (int j = 0; j < sm->block_size; j++)
+        {
+                m->x[j] ^= m->buf[j];
+        }
+
+        if (sm->cipher == SM_CIPHER_3DES)
+        {
+                // Retail MAC output transformation: E(K1, D(K2, E(K1, x)))
+                mbedtls_des_crypt_ecb(&sm->des.mac_k1, m->x, m->x);
+                mbedtls_des_crypt_ecb(&sm->des.mac_k2, m->x, m->x);
+                mbedtls_des_crypt_ecb(&sm->des.mac_k1, m->x, m->x);
+        }
+        else
+        {
+                for (int j = 0; j < sm->block_size; j++)
+                {
+                        m->x[j] ^= sm->aes.cmac_k1[j];
+                }
+                mbedtls_aes_crypt_ecb(&sm->aes.mac, MBEDTLS_AES_ENCRYPT, m->x, m->x);
+        }
+
+        memcpy(mac, m->x, SM_MAC_LEN);
+        mbedtls_platform_zeroize(m, sizeof(*m));
+}
+
+/* ==================== In-place CBC ==================== */
+
+/* Block at byte offset off of data[0..len), with method 2 padding past the end */
+static void sm_read_block(const uint8_t *data, size_t len, size_t off, uint8_t bs,
+                          uint8_t *blk)
+{
+        size_t avail = off < len ? MIN(bs, len - off) : 0;
+
+        memcpy(blk, &data[off], avail);
+        for (size_t p = avail; p < bs; p++)
+        {
+                blk[p] = (off + p == len) ? 0x80 : 0x00;
+        }
+}
+
+/*
+ * Pad and encrypt buf[src..src+len) to buf[dst..], dst >= src and less
+ * than one block apart. The next input block is read before the current
+ * output block lands on top of it. Returns the padded length.
+ */
+static size_t sm_encrypt(struct sm_ctx *sm, uint8_t *buf, size_t src, size_t len, size_t dst)
+{
+        const uint8_t bs = sm->block_size;
+        size_t padded = ROUND_DOWN(len, bs) + bs;
+        uint8_t chain[SM_MAX_BLOCK];
+        uint8_t cur[SM_MAX_BLOCK];
+        uint8_t next[SM_MAX_BLOCK];
+
+        sm_iv(sm, chain);
+        sm_read_block(&buf[src], len, 0, bs, cur);
+
+        for (size_t off = 0; off < padded; off += bs)
+        {
+                if (off + bs < padded)
+                {
+                        sm_read_block(&buf[src], len, off + bs, bs, next);
+                }
+
+                for (int j = 0; j < bs; j++)
+                {
+                        chain[j] ^= cur[j];
+                }
+                sm_block_encrypt(sm, chain);
+                memcpy(&buf[dst + off], chain, bs);
+                memcpy(cur, next, bs);
+        }
+
+        mbedtls_platform_zeroize(cur, sizeof(cur));
+        mbedtls_platform_zeroize(next, sizeof(next));
+        return padded;
+}
+
+/*
+ * Decrypt src[0..len) to dst, dst <= src, and strip the padding. Each
+ * ciphertext block is saved before the plaintext overwrites its tail.
+ * Returns the plaintext length.
+ */
+static int sm_decrypt(struct sm_ctx *sm, uint8_t *dst, const uint8_t *src, size_t len)
+{
+        const uint8_t bs = sm->block_size;
+        uint8_t chain[SM_MAX_BLOCK];
+        uint8_t cur[SM_MAX_BLOCK];
+        uint8_t x[SM_MAX_BLOCK];
+        size_t i;
+
+        sm_iv(sm, chain);
+
+        for (size_t off = 0; off < len; off += bs)
+        {
+                memcpy(cur, &src[off], bs);
+                memcpy(x, cur, bs);
+                sm_block_decrypt(sm, x);
+
+                for (int j = 0; j < bs; j++)
+                {
+                        x[j] ^= chain[j];
+                }
+                memcpy(chain, cur, bs);
+                memcpy(&dst[off], x, bs);
+        }
+
+        mbedtls_platform_zeroize(x, sizeof(x));
+
+        for (i = len; i > 0 && dst[i - 1] == 0x00; i--)
+        {
+        }
+        if (i == 0 || dst[i - 1] != 0x80)
+        {
+                return -EBADMSG;
+        }
+
+        return i - 1;
+}
+
+/* ==================== Session ==================== */
+
+int sm_init_3des(struct sm_ctx *sm, const uint8_t ks_enc[16], const uint8_t ks_mac[16],
+                 const uint8_t ssc[8])
+{
+        int ret = 0;
+
+        memset(sm, 0, sizeof(*sm));
+        sm->cipher = SM_CIPHER_3DES;
+        sm->block_size = 8;
+        memcpy(sm->ssc, ssc, 8);
+
+        mbedtls_des3_init(&sm->des.enc);
+        mbedtls_des3_init(&sm->des.dec);
+        mbedtls_des_init(&sm->des.mac_k1);
+        mbedtls_des_init(&sm->des.mac_k2);
+
+        ret |= mbedtls_des3_set2key_enc(&sm->des.enc, ks_enc);
+        ret |= mbedtls_des3_set2key_dec(&sm->des.dec, ks_enc);
+        ret |= mbedtls_des_setkey_enc(&sm->des.mac_k1, ks_mac);
+        ret |= mbedtls_des_setkey_dec(&sm->des.mac_k2, ks_mac + 8);
+
+        return ret == 0 ? 0 : -EIO;
+}
+
+int sm_init_aes(struct sm_ctx *sm, const uint8_t *ks_enc, const uint8_t *ks_mac,
+                size_t key_len)
+{
+        uint8_t l[16] = {0};
+        int ret = 0;
+
+        if (key_len != 16 && key_len != 24 && key_len != 32)
+        {
+                return -EINVAL;
+        }
+
+        memset(sm, 0, sizeof(*sm));
+        sm->cipher = SM_CIPHER_AES;
+        sm->block_size = 16;
+
+        mbedtls_aes_init(&sm->aes.enc);
+        mbedtls_aes_init(&sm->aes.dec);
+        mbedtls_aes_init(&sm->aes.mac);
+
+        ret |= mbedtls_aes_setkey_enc(&sm->aes.enc, ks_enc, key_len * 8);
+        ret |= mbedtls_aes_setkey_dec(&sm->aes.dec, ks_enc, key_len * 8);
+        ret |= mbedtls_aes_setkey_enc(&sm->aes.mac, ks_mac, key_len * 8);
+        if (ret != 0)
+        {
+                return -EIO;
+        }
+
+        // CMAC subkey K1 = L << 1 (xor Rb on carry), L = E(K, 0)
+        mbedtls_aes_crypt_ecb(&sm->aes.mac, MBEDTLS_AES_ENCRYPT, l, l);
+        for (int i = 0; i < 16; i++)
+        {
+                sm->aes.cmac_k1[i] = (l[i] << 1) | (i < 15 ? l[i + 1] >> 7 : 0);
+        }
+        if (l[0] & 0x80)
+        {
+                sm->aes.cmac_k1[15] ^= 0x87;
+        }
+
+        mbedtls_platform_zeroize(l, sizeof(l));
+        return 0;
+}
+
+void sm_free(struct sm_ctx *sm)
+{
+        if (sm->cipher == SM_CIPHER_3DES)
+        {
+                mbedtls_des3_free(&sm->des.enc);
+                mbedtls_des3_free(&sm->des.dec);
+                mbedtls_des_free(&sm->des.mac_k1);
+                mbedtls_des_free(&sm->des.mac_k2);
+        }
+        else
+        {
+                mbedtls_aes_free(&sm->aes.enc);
+                mbedtls_aes_free(&sm->aes.dec);
+                mbedtls_aes_free(&sm->aes.mac);
+        }
+
+        mbedtls_platform_zeroize(sm, sizeof(*sm));
+}
+
+/* ==================== Wrap / Unwrap ==================== */
+
+int sm_wrap(struct sm_ctx *sm, uint8_t *apdu, uint16_t *len, uint16_t cap)
+{
+        const uint8_t bs = sm->block_size;
+        struct sm_mac mac = {0};
+        uint16_t n = *len;
+        uint16_t lc = 0;
+        bool has_le = false;
+        uint8_t le = 0;
+
+        // Short APDU cases: 1 (header), 2 (Le), 3 (Lc data), 4 (Lc data Le)
+        if (n < 4)
+        {
+                return -EINVAL;
+        }
+        if (n == 5)
+        {
+                has_le = true;
+                le = apdu[4];
+        }
+        else if (n > 5)
+        {
+                lc = apdu[4];
+                if (lc == 0 || (n != 5 + lc && n != 6 + lc))
+                {
+                        return -EINVAL;
+                }
+                if (n == 6 + lc)
+                {
+                        has_le = true;
+                        le = apdu[5 + lc];
+                }
+        }
+
+        size_t padded = lc ? ROUND_DOWN(lc, bs) + bs : 0;
+        size_t do87_len = padded + 1;                                // Padding indicator + cryptogram
+        size_t do87_hdr = lc ? (do87_len < 0x80 ? 2 : 3) + 1 : 0; // Tag, length, indicator
+        size_t body = (lc ? do87_hdr + padded : 0) + (has_le ? 3 : 0) + 2 + SM_MAC_LEN;
+
+        if (body > 0xFF || 5 + body + 1 > cap)
+        {
+                return -ENOBUFS;
+        }
+
+        sm_ssc_inc(sm);
+        apdu[0] |= 0x0C; // CLA: SM with authenticated header
+
+        size_t pos = 5;
+
+        if (lc)
+        {
+                sm_encrypt(sm, apdu, 5, lc, 5 + do87_hdr);
+                apdu[pos++] = SM_DO_CRYPTOGRAM;
+                if (do87_len >= 0x80)
+                {
+                        apdu[pos++] = 0x81;
+                }
+                apdu[pos++] = do87_len;
+                apdu[pos++] = SM_PADDING_INDICATOR;
+                pos += padded;
+        }
+
+        if (has_le)
+        {
+                apdu[pos++] = SM_DO_LE;
+                apdu[pos++] = 0x01;
+                apdu[pos++] = le;
+        }
+
+        // MAC over pad(SSC || pad(header) || DO'87' || DO'97')
+        sm_mac_update(sm, &mac, sm->ssc, bs);
+        sm_mac_update(sm, &mac, apdu, 4);
+        sm_mac_pad(sm, &mac);
+        sm_mac_update(sm, &mac, &apdu[5], pos - 5);
+        sm_mac_pad(sm, &mac);
+
+        apdu[pos++] = SM_DO_MAC;
+        apdu[pos++] = SM_MAC_LEN;
+        sm_mac_final(sm, &mac, &apdu[pos]);
+        pos += SM_MAC_LEN;
+
+        apdu[4] = pos - 5; // Lc
+        apdu[pos++] = 0x00; // Le
+        *len = pos;
+
+        return 0;
+}
+
+int sm_unwrap(struct sm_ctx *sm, uint8_t *resp, uint16_t *len, uint16_t *sw)
+{
+        const uint8_t bs = sm->block_size;
+        struct sm_mac mac = {0};
+        uint8_t expected[SM_MAC_LEN];
+        uint16_t n = *len;
+        uint16_t sw_protected = 0;
+        bool has_sw = false;
+        size_t crypto_off = 0;
+        size_t crypto_len = 0;
+        size_t mac_off = 0;
+        bool has_mac = false;
+        uint8_t diff = 0;
+
+        if (n < 2)
+        {
+                return -EBADMSG;
+        }
+
+        uint16_t sw_plain = ((uint16_t)resp[n - 2] << 8) | resp[n - 1];
+
+        n -= 2;
+        sm_ssc_inc(sm);
+
+        if (n == 0)
+        {
+                // Errors may come back unprotected; success never does
+                *sw = sw_plain;
+                *len = 0;
+                return sw_plain == SM_SW_OK ? -EBADMSG : 0;
+        }
+
+        for (size_t pos = 0; pos < n;)
+        {
+                uint8_t tag = resp[pos];
+                size_t hdr = 2;
+                size_t l;
+
+                if (pos + 2 > n)
+                {
+                        return -EBADMSG;
+                }
+
+                l = resp[pos + 1];
+                if (l == 0x81 && pos + 3 <= n)
+                {
+                        l = resp[pos + 2];
+                        hdr = 3;
+                }
+                else if (l == 0x82 && pos + 4 <= n)
+                {
+                        l = ((size_t)resp[pos + 2] << 8) | resp[pos + 3];
+                        hdr = 4;
+                }
+                else if (l >= 0x80)
+                {
+                        return -EBADMSG;
+                }
+
+                if (pos + hdr + l > n)
+                {
+                        return -EBADMSG;
+                }
+
+                switch (tag)
+                {
+                case SM_DO_CRYPTOGRAM:
+                        crypto_off = pos + hdr;
+                        crypto_len = l;
+                        break;
+                case SM_DO_STATUS:
+                        if (l != 2)
+                        {
+                                return -EBADMSG;
+                        }
+                        sw_protected = ((uint16_t)resp[pos + hdr] << 8) | resp[pos + hdr + 1];
+                        has_sw = true;
+                        break;
+                case SM_DO_MAC:
+                        if (l != SM_MAC_LEN)
+                        {
+                                return -EBADMSG;
+                        }
+                        mac_off = pos;
+                        has_mac = true;
+                        break;
+                default:
+                        break;
+                }
+
+                pos += hdr + l;
+        }
+
+        if (!has_mac)
+        {
+                return -EBADMSG;
+        }
+
+        // MAC over pad(SSC || everything before DO'8E')
+        sm_mac_update(sm, &mac, sm->ssc, bs);
+        sm_mac_update(sm, &mac, resp, mac_off);
+        sm_mac_pad(sm, &mac);
+        sm_mac_final(sm, &mac, expected);
+
+        for (int j = 0; j < SM_MAC_LEN; j++)
+        {
+                diff |= expected[j] ^ resp[mac_off + 2 + j];
+        }
+        if (diff)
+        {
+                LOG_ERR("Response MAC mismatch");
+                return -EBADMSG;
+        }
+
+        *sw = has_sw ? sw_protected : sw_plain;
+        *len = 0;
+
+        if (crypto_len > 0)
+        {
+                if (resp[crypto_off] != SM_PADDING_INDICATOR || (crypto_len - 1) % bs != 0)
+                {
+                        return -EBADMSG;
+                }
+
+                int plain = sm_decrypt(sm, resp, &resp[crypto_off + 1], crypto_len - 1);
+
+                if (plain < 0)
+                {
+                        return plain;
+                }
+                *len = plain;
+        }
+
+        return 0;
+}
+
+/* ==================== Benchmark ==================== */
+
+#if defined(CONFIG_SM_BENCHMARK)
+
+#include "mrtd.h"
+
+#define SM_BENCH_DG1_LEN 93
+#define SM_BENCH_DG2_LEN (20 * 1024)
+#define SM_BENCH_BUF_LEN 262
+
+/* Card side of one READ BINARY: protected response for data_len bytes */
+static uint16_t sm_bench_response(struct sm_ctx *card, uint8_t *buf, uint16_t data_len)
+{
+        struct sm_mac mac = {0};
+        size_t padded = ROUND_DOWN(data_len, card->block_size) + card->block_size;
+        size_t do87_len = padded + 1;
+        size_t hdr = (do87_len < 0x80 ? 2 : 3) + 1;
+        size_t pos = 0;
+
+        sm_ssc_inc(card); // Command
+        sm_ssc_inc(card); // Response
+
+        memset(buf, 0xA5, data_len);
+        sm_encrypt(card, buf, 0, data_len, hdr);
+
+        buf[pos++] = SM_DO_CRYPTOGRAM;
+        if (do87_len >= 0x80)
+        {
+                buf[pos++] = 0x81;
+        }
+        buf[pos++] = do87_len;
+        buf[pos++] = SM_PADDING_INDICATOR;
+        pos += padded;
+
+        buf[pos++] = SM_DO_STATUS;
+        buf[pos++] = 0x02;
+        buf[pos++] = 0x90;
+        buf[pos++] = 0x00;
+
+        sm_mac_update(card, &mac, card->ssc, card->block_size);
+        sm_mac_update(card, &mac, buf, pos);
+        sm_mac_pad(card, &mac);
+
+        buf[pos++] = SM_DO_MAC;
+        buf[pos++] = SM_MAC_LEN;
+        sm_mac_final(card, &mac, &buf[pos]);
+        pos += SM_MAC_LEN;
+
+        buf[pos++] = 0x90;
+        buf[pos++] = 0x00;
+        return pos;
+}
+
+static void sm_bench_suite(const char *name, struct sm_ctx *host, struct sm_ctx *card)
+{
+        static const uint16_t files[] = {SM_BENCH_DG1_LEN, SM_BENCH_DG2_LEN};
+        static uint8_t buf[SM_BENCH_BUF_LEN];
+        uint16_t max_le = mrtd_max_le(host->block_size);
+        uint32_t wrap_cyc = 0;
+        uint32_t unwrap_cyc = 0;
+        uint32_t apdus = 0;
+
+        for (size_t f = 0; f < ARRAY_SIZE(files); f++)
+        {
+                for (uint16_t off = 0; off < files[f]; off += max_le)
+                {
+                        uint16_t le = MIN(max_le, files[f] - off);
+                        uint16_t len = 5;
+                        uint16_t sw;
+                        uint32_t t0;
+                        int ret;
+
+                        buf[0] = 0x00;
+                        buf[1] = 0xB0;
+                        buf[2] = off >> 8;
+                        buf[3] = off & 0xFF;
+                        buf[4] = le;
+
+                        t0 = k_cycle_get_32();
+                        ret = sm_wrap(host, buf, &len, sizeof(buf));
+                        wrap_cyc += k_cycle_get_32() - t0;
+
+                        len = sm_bench_response(card, buf, le);
+
+                        t0 = k_cycle_get_32();
+                        ret |= sm_unwrap(host, buf, &len, &sw);
+                        unwrap_cyc += k_cycle_get_32() - t0;
+
+                        if (ret != 0 || len != le || sw != SM_SW_OK)
+                        {
+                                LOG_ERR("%s benchmark failed at offset %u", name, off);
+                                return;
+                        }
+                        apdus++;
+                }
+        }
+
+        LOG_INF("%s: DG1+DG2 (%u B) in %u APDUs, Le %u", name,
+                SM_BENCH_DG1_LEN + SM_BENCH_DG2_LEN, apdus, max_le);
+        LOG_INF("  wrap %u us/APDU, unwrap %u us/APDU, total %u us",
+                k_cyc_to_us_floor32(wrap_cyc / apdus), k_cyc_to_us_floor32(unwrap_cyc / apdus),
+                k_cyc_to_us_floor32(wrap_cyc + unwrap_cyc));
+}
+
+void sm_benchmark(void)
+{
+        static const uint8_t keys[32] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+                                         0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10,
+                                         0x0F, 0x1E, 0x2D, 0x3C, 0x4B, 0x5A, 0x69, 0x78,
+                                         0x87, 0x96, 0xA5, 0xB4, 0xC3, 0xD2, 0xE1, 0xF0};
+        static const uint8_t ssc[8] = {0};
+        static struct sm_ctx host;
+        static struct sm_ctx card;
+
+        LOG_INF("=== Secure messaging benchmark ===");
+
+        sm_init_3des(&host, keys, &keys[16], ssc);
+        sm_init_3des(&card, keys, &keys[16], ssc);
+        sm_bench_suite("3DES", &host, &card);
+        sm_free(&host);
+        sm_free(&card);
+
+        sm_init_aes(&host, keys, &keys[16], 16);
+        sm_init_aes(&card, keys, &keys[16], 16);
+        sm_bench_suite("AES-128", &host, &card);
+        sm_free(&host);
+        sm_free(&card);
+}
+
+#endif /* CONFIG_SM_BENCHMARK */
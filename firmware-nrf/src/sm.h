@@ -0,0 +1,89 @@
+/**
+ * @file sm.h
+ * @brief ISO 7816-4 secure messaging for eMRTD (3DES for BAC, AES for PACE)
+ */
+
+#ifndef SM_H_
+#define SM_H_
+
+#include <zephyr/kernel.h>
+
+#include <mbedtls/aes.h>
+#include <mbedtls/des.h>
+
+#define APDU_MAX_LEN 261
+
+typedef struct
+{
+        uint8_t data[APDU_MAX_LEN];
+        uint16_t len;
+} apdu_t;
+
+#define SM_CIPHER_3DES 0
+#define SM_CIPHER_AES 1
+
+#define SM_MAC_LEN 8
+
+/*
+ * Session state. Key schedules are expanded once when the session starts,
+ * so wrapping an APDU costs only the block cipher calls themselves.
+ */
+struct sm_ctx
+{
+        uint8_t cipher;
+        uint8_t block_size;
+        uint8_t ssc[16]; // Send sequence counter, block_size bytes used
+        union
+        {
+                struct
+                {
+                        mbedtls_des3_context enc;
+                        mbedtls_des3_context dec;
+                        mbedtls_des_context mac_k1;
+                        mbedtls_des_context mac_k2; // Decrypt schedule for the retail MAC
+                } des;
+                struct
+                {
+                        mbedtls_aes_context enc;
+                        mbedtls_aes_context dec;
+                        mbedtls_aes_context mac;
+                        uint8_t cmac_k1[16]; // CMAC subkey for a complete last block
+                } aes;
+        };
+};
+
+/* BAC: 2-key 3DES, retail MAC, SSC from the mutual authentication */
+int sm_init_3des(struct sm_ctx *sm, const uint8_t ks_enc[16], const uint8_t ks_mac[16],
+                 const uint8_t ssc[8]);
+
+/* PACE: AES-128/192/256, CMAC, SSC starts at zero */
+int sm_init_aes(struct sm_ctx *sm, const uint8_t *ks_enc, const uint8_t *ks_mac,
+                size_t key_len);
+
+void sm_free(struct sm_ctx *sm);
+
+/*
+ * Protect a short APDU (cases 1-4) in place: the command data is encrypted
+ * into DO'87', Le moves to DO'97' and DO'8E' is appended. cap is the size
+ * of the buffer; returns -ENOBUFS if the protected APDU does not fit.
+ */
+int sm_wrap(struct sm_ctx *sm, uint8_t *apdu, uint16_t *len, uint16_t cap);
+
+/*
+ * Verify and decrypt a response (body + SW1 SW2) in place. On success the
+ * plaintext starts at resp, *len is its length and *sw the protected
+ * status word. An unprotected error status is passed through in *sw.
+ */
+int sm_unwrap(struct sm_ctx *sm, uint8_t *resp, uint16_t *len, uint16_t *sw);
+
+static inline int sm_wrap_apdu(struct sm_ctx *sm, apdu_t *apdu)
+{
+        return sm_wrap(sm, apdu->data, &apdu->len, sizeof(apdu->data));
+}
+
+#if defined(CONFIG_SM_BENCHMARK)
+/* Time wrap/unwrap for a simulated DG1 + DG2 read with both cipher suites */
+void sm_benchmark(void);
+#endif
+
+#endif /* SM_H_ */
@@ -0,0 +1,27 @@
+/**
+ * @file i2c_async.h
+ * @brief Test I2C controller that completes transfers asynchronously
+ *
+ * Implements i2c_transfer_cb() like the nRF TWIM driver: the call only
+ * starts the transfer, and the callback runs later from a timer (ISR
+ * context) once the emulated PN532 has been served. Selected by the
+ * async.overlay scenario in place of the emulated controller.
+ */
+
+#ifndef I2C_ASYNC_H_
+#define I2C_ASYNC_H_
+
+#include <stdbool.h>
+
+struct i2c_async_state
+{
+        bool pending;  // Started by transfer_cb, callback not run yet
+        int callbacks; // Transfers completed through the callback
+        int blocking;  // Transfers through i2c_transfer(), i.e. the fallback
+};
+
+extern struct i2c_async_state i2c_async;
+
+void i2c_async_reset(void);
+
+#endif /* I2C_ASYNC_H_ */
@@ -0,0 +1,267 @@
+/**
+ * @file main.c
+ * @brief PN532 I2C transport tests against an emulated PN532
+ */
+
+#include "i2c_async.h"
+#include "pn532_emul.h"
+#include "pn532_transport.h"
+
+#include <string.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/ztest.h>
+
+#define PN532_ADDR 0x24
+#define TEST_TIMEOUT_MS 100
+#define TEST_SHORT_DATA 7 // Frame fits the first read
+#define TEST_LONG_DATA 60 // Frame needs the NACK and a second read
+
+/* async.overlay: i2c0 implements i2c_transfer_cb() instead of being the emulated controller */
+#define TEST_ASYNC_BUS DT_NODE_HAS_COMPAT(DT_NODELABEL(i2c0), test_i2c_async)
+
+static const struct pn532_transport *transport = &pn532_transport_i2c;
+
+/* Frame buffers with the headroom the transport expects; static, as for EasyDMA */
+static uint8_t tx_frame[PN532_FRAME_HEADROOM + PN532_FRAME_MAX];
+static uint8_t rx_frame[PN532_FRAME_HEADROOM + PN532_FRAME_MAX];
+
+/* Normal information frames only: 00 00 FF LEN LCS, data, DCS 00 */
+static int frame_len(const uint8_t *hdr)
+{
+        if (hdr[0] != 0x00 || hdr[1] != 0x00 || hdr[2] != 0xFF ||
+            (uint8_t)(hdr[3] + hdr[4]) != 0)
+        {
+                return -EBADMSG;
+        }
+
+        return PN532_NORMAL_HEADER_LEN + hdr[3] + 2;
+}
+
+static int wait_ready(void)
+{
+        int ret;
+
+        while ((ret = transport->poll_ready()) == 0)
+        {
+                k_sleep(K_MSEC(1));
+        }
+
+        return ret < 0 ? ret : 0;
+}
+
+static void fill_data(uint8_t *data, uint8_t len)
+{
+        data[0] = 0xD5; // TFI: PN532 to host
+        for (int i = 1; i < len; i++)
+        {
+                data[i] = (uint8_t)i;
+        }
+}
+
+ZTEST(pn532_i2c, test_write)
+{
+        static const uint8_t get_firmware_version[] = {0x00, 0x00, 0xFF, 0x02, 0xFE,
+                                                       0xD4, 0x02, 0x2A, 0x00};
+        uint8_t *frame = &tx_frame[PN532_FRAME_HEADROOM];
+
+        memcpy(frame, get_firmware_version, sizeof(get_firmware_version));
+
+        /* Returns once queued; the result comes with flush() */
+        zassert_ok(transport->write(frame, sizeof(get_firmware_version)));
+        zassert_ok(transport->flush(K_MSEC(TEST_TIMEOUT_MS)));
+
+        zassert_equal(pn532_emul.writes, 1);
+        zassert_equal(pn532_emul.written_len, sizeof(get_firmware_version));
+        zassert_mem_equal(pn532_emul.written, get_firmware_version, sizeof(get_firmware_version));
+}
+
+ZTEST(pn532_i2c, test_ready_wait)
+{
+        int polls = 0;
+        int ret;
+
+        pn532_emul.busy_reads = 3;
+
+        while ((ret = transport->poll_ready()) == 0)
+        {
+                polls++;
+        }
+
+        zassert_equal(ret, 1, "poll_ready: %d", ret);
+        zassert_equal(polls, 3);
+        zassert_equal(pn532_emul.last_read_len, 1, "Status polls read one byte");
+}
+
+ZTEST(pn532_i2c, test_read_frame_short)
+{
+        uint8_t data[TEST_SHORT_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, 0, frame_len, wait_ready), total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(pn532_emul.reads, 1, "Short frame must take a single read");
+        zassert_equal(pn532_emul.nacks, 0);
+}
+
+ZTEST(pn532_i2c, test_read_frame_two_phase)
+{
+        uint8_t data[TEST_LONG_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, 0, frame_len, wait_ready), total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(pn532_emul.nacks, 1, "Long frame is resent after a NACK");
+        zassert_equal(pn532_emul.reads, 2);
+        zassert_equal(pn532_emul.last_read_len, total + 1, "Second read is exactly the frame");
+}
+
+ZTEST(pn532_i2c, test_read_frame_expected)
+{
+        uint8_t data[TEST_LONG_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        /* The caller knows the length (READ BINARY Le): one read, no NACK */
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, total, frame_len, wait_ready),
+                      total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(pn532_emul.reads, 1);
+        zassert_equal(pn532_emul.nacks, 0);
+}
+
+ZTEST(pn532_i2c, test_read_frame_longer_than_expected)
+{
+        uint8_t data[TEST_LONG_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, total - 10, frame_len,
+                                            wait_ready),
+                      total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(pn532_emul.nacks, 1, "Longer than expected falls back to the NACK");
+        zassert_equal(pn532_emul.reads, 2);
+        zassert_equal(pn532_emul.last_read_len, total + 1);
+}
+
+ZTEST(pn532_i2c, test_read_frame_not_ready)
+{
+        uint8_t data[TEST_SHORT_DATA];
+
+        fill_data(data, sizeof(data));
+        pn532_emul_set_response(data, sizeof(data));
+        pn532_emul.busy_reads = 1;
+
+        zassert_equal(transport->read_frame(&rx_frame[PN532_FRAME_HEADROOM], PN532_FRAME_MAX, 0,
+                                            frame_len, wait_ready),
+                      -EAGAIN);
+}
+
+#if TEST_ASYNC_BUS
+
+ZTEST(pn532_i2c, test_async_write)
+{
+        static const uint8_t ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+        uint8_t *frame = &tx_frame[PN532_FRAME_HEADROOM];
+
+        memcpy(frame, ack, sizeof(ack));
+
+        zassert_ok(transport->write(frame, sizeof(ack)));
+        zassert_true(i2c_async.pending, "write() waited for the transfer");
+        zassert_equal(pn532_emul.writes, 0);
+
+        zassert_ok(transport->flush(K_MSEC(TEST_TIMEOUT_MS)));
+        zassert_false(i2c_async.pending);
+        zassert_equal(i2c_async.callbacks, 1);
+        zassert_equal(i2c_async.blocking, 0, "Fell back to the work queue");
+        zassert_mem_equal(pn532_emul.written, ack, sizeof(ack));
+}
+
+ZTEST(pn532_i2c, test_async_read)
+{
+        uint8_t data[TEST_SHORT_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        zassert_equal(transport->poll_ready(), 1);
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, 0, frame_len, wait_ready), total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(i2c_async.callbacks, 2);
+        zassert_equal(i2c_async.blocking, 0, "Fell back to the work queue");
+}
+
+ZTEST(pn532_i2c, test_async_nack)
+{
+        uint8_t data[TEST_LONG_DATA];
+        uint8_t *buf = &rx_frame[PN532_FRAME_HEADROOM];
+        uint16_t total;
+
+        fill_data(data, sizeof(data));
+        total = pn532_emul_set_response(data, sizeof(data));
+
+        /* First read, NACK write, ready poll, full read: all completed by the callback */
+        zassert_equal(transport->read_frame(buf, PN532_FRAME_MAX, 0, frame_len, wait_ready), total);
+        zassert_mem_equal(buf, pn532_emul.response, total);
+        zassert_equal(pn532_emul.nacks, 1);
+        zassert_equal(pn532_emul.last_read_len, total + 1);
+        zassert_equal(i2c_async.callbacks, pn532_emul.reads + pn532_emul.nacks);
+        zassert_equal(i2c_async.blocking, 0, "Fell back to the work queue");
+}
+
+#else
+
+static void transfer_done(const struct device *dev, int result, void *data)
+{
+}
+
+ZTEST(pn532_i2c, test_enosys_fallback)
+{
+        const struct device *bus = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+        uint8_t byte = 0;
+        struct i2c_msg msg = {
+            .buf = &byte,
+            .len = 1,
+            .flags = I2C_MSG_READ | I2C_MSG_STOP,
+        };
+
+        /* The emulated controller has no callback API, like some real drivers */
+        zassert_equal(i2c_transfer_cb(bus, &msg, 1, PN532_ADDR, transfer_done, NULL), -ENOSYS);
+
+        /* The transport still works, on its own work queue instead */
+        zassert_equal(transport->poll_ready(), 1);
+        zassert_equal(strcmp(pn532_emul.thread, "pn532_i2c"), 0, "Ran on %s", pn532_emul.thread);
+}
+
+#endif
+
+static void *pn532_i2c_setup(void)
+{
+        zassert_ok(transport->init());
+        return NULL;
+}
+
+static void pn532_i2c_before(void *fixture)
+{
+        transport->flush(K_MSEC(TEST_TIMEOUT_MS));
+        pn532_emul_reset();
+        i2c_async_reset();
+}
+
+ZTEST_SUITE(pn532_i2c, NULL, pn532_i2c_setup, pn532_i2c_before, NULL, NULL);
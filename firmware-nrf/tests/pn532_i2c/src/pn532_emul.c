@@ -0,0 +1,124 @@
+/**
+ * @file pn532_emul.c
+ * @brief Emulated PN532 on the I2C emulator bus or the async test bus
+ */
+
+#define DT_DRV_COMPAT nxp_pn532_i2c
+
+#include "pn532_emul.h"
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+
+#define PN532_I2C_READY 0x01
+
+static const uint8_t nack_frame[] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
+
+struct pn532_emul_state pn532_emul;
+
+void pn532_emul_reset(void)
+{
+        memset(&pn532_emul, 0, sizeof(pn532_emul));
+}
+
+uint16_t pn532_emul_set_response(const uint8_t *data, uint8_t len)
+{
+        uint8_t *frame = pn532_emul.response;
+        uint8_t dcs = 0;
+
+        frame[0] = 0x00;
+        frame[1] = 0x00;
+        frame[2] = 0xFF;
+        frame[3] = len;
+        frame[4] = (uint8_t)(0x100 - len);
+        for (int i = 0; i < len; i++)
+        {
+                frame[PN532_NORMAL_HEADER_LEN + i] = data[i];
+                dcs += data[i];
+        }
+        frame[PN532_NORMAL_HEADER_LEN + len] = (uint8_t)(0x100 - dcs);
+        frame[PN532_NORMAL_HEADER_LEN + len + 1] = 0x00;
+
+        pn532_emul.response_len = PN532_NORMAL_HEADER_LEN + len + 2;
+        return pn532_emul.response_len;
+}
+
+/* Every read restarts the frame, like the PN532 does on each read transaction */
+static void pn532_emul_read(uint8_t *buf, uint32_t len)
+{
+        bool ready = pn532_emul.busy_reads == 0;
+
+        if (!ready)
+        {
+                pn532_emul.busy_reads--;
+        }
+
+        memset(buf, 0, len);
+        buf[0] = ready ? PN532_I2C_READY : 0x00;
+        if (ready && len > 1)
+        {
+                memcpy(&buf[1], pn532_emul.response, MIN(len - 1, pn532_emul.response_len));
+        }
+
+        pn532_emul.reads++;
+        pn532_emul.last_read_len = len;
+}
+
+static void pn532_emul_write(const uint8_t *buf, uint32_t len)
+{
+        if (len == sizeof(nack_frame) && memcmp(buf, nack_frame, len) == 0)
+        {
+                pn532_emul.nacks++;
+                return;
+        }
+
+        len = MIN(len, sizeof(pn532_emul.written));
+        memcpy(pn532_emul.written, buf, len);
+        pn532_emul.written_len = len;
+        pn532_emul.writes++;
+}
+
+int pn532_emul_xfer(struct i2c_msg *msgs, int num_msgs)
+{
+        const char *name = k_thread_name_get(k_current_get());
+
+        strncpy(pn532_emul.thread, name ? name : "", sizeof(pn532_emul.thread) - 1);
+
+        for (int i = 0; i < num_msgs; i++)
+        {
+                if (msgs[i].flags & I2C_MSG_READ)
+                {
+                        pn532_emul_read(msgs[i].buf, msgs[i].len);
+                }
+                else
+                {
+                        pn532_emul_write(msgs[i].buf, msgs[i].len);
+                }
+        }
+
+        return 0;
+}
+
+/* On the emulated controller the PN532 is an I2C emulator; the async test bus calls in directly */
+#if DT_NODE_HAS_COMPAT(DT_INST_BUS(0), zephyr_i2c_emul_controller)
+static int pn532_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+                               int addr)
+{
+        return pn532_emul_xfer(msgs, num_msgs);
+}
+
+static const struct i2c_emul_api pn532_emul_api = {
+    .transfer = pn532_emul_transfer,
+};
+
+static int pn532_emul_init(const struct emul *target, const struct device *parent)
+{
+        pn532_emul_reset();
+        return 0;
+}
+
+EMUL_DT_INST_DEFINE(0, pn532_emul_init, NULL, NULL, &pn532_emul_api, NULL);
+#endif
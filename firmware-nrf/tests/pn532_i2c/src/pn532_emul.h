@@ -0,0 +1,44 @@
+/**
+ * @file pn532_emul.h
+ * @brief Emulated PN532 on the I2C emulator bus or the async test bus
+ *
+ * Answers every read with the I2C status byte and, once ready, the start
+ * of the pending response frame, as the PN532 does. Records what the
+ * transport did so tests can check it.
+ */
+
+#ifndef PN532_EMUL_H_
+#define PN532_EMUL_H_
+
+#include "pn532_transport.h"
+
+#include <zephyr/drivers/i2c.h>
+
+struct pn532_emul_state
+{
+        /* Set by the test */
+        uint8_t response[PN532_FRAME_MAX];
+        uint16_t response_len;
+        int busy_reads; // Reads left that report "not ready"
+
+        /* Recorded by the emulator */
+        uint8_t written[PN532_FRAME_MAX];
+        uint16_t written_len;
+        int writes;
+        int reads;
+        int nacks;
+        uint16_t last_read_len; // Including the status byte
+        char thread[CONFIG_THREAD_MAX_NAME_LEN]; // Thread that ran the last transfer
+};
+
+extern struct pn532_emul_state pn532_emul;
+
+void pn532_emul_reset(void);
+
+/* Queue a normal information frame carrying data as the next response */
+uint16_t pn532_emul_set_response(const uint8_t *data, uint8_t len);
+
+/* Serve one I2C transaction addressed to the PN532 */
+int pn532_emul_xfer(struct i2c_msg *msgs, int num_msgs);
+
+#endif /* PN532_EMUL_H_ */
@@ -0,0 +1,145 @@
+/**
+ * @file main.c
+ * @brief BAC key derivation and 3DES secure messaging against the worked
+ * example of ICAO Doc 9303 Part 11, Appendix D
+ */
+
+#include "bac.h"
+#include "sm.h"
+
+#include <string.h>
+#include <zephyr/ztest.h>
+
+/* D.2: MRZ information L898902C<3 690806 1 940623 6 */
+static const char doc_number[] = "L898902C<";
+static const char dob[] = "690806";
+static const char expiry[] = "940623";
+
+static const uint8_t k_seed[16] = {0x23, 0x9A, 0xB9, 0xCB, 0x28, 0x2D, 0xAF, 0x66,
+                                   0x23, 0x1D, 0xC5, 0xA4, 0xDF, 0x6B, 0xFB, 0xAE};
+static const uint8_t k_enc[BAC_KEY_LEN] = {0xAB, 0x94, 0xFD, 0xEC, 0xF2, 0x67, 0x4F, 0xDF,
+                                           0xB9, 0xB3, 0x91, 0xF8, 0x5D, 0x7F, 0x76, 0xF2};
+static const uint8_t k_mac[BAC_KEY_LEN] = {0x79, 0x62, 0xD9, 0xEC, 0xE0, 0x3D, 0x1A, 0xCD,
+                                           0x4C, 0x76, 0x08, 0x9D, 0xCE, 0x13, 0x15, 0x43};
+
+/* D.3: session keys and SSC after the mutual authentication */
+static const uint8_t ks_enc[BAC_KEY_LEN] = {0x97, 0x9E, 0xC1, 0x3B, 0x1C, 0xBF, 0xE9, 0xDC,
+                                            0xD0, 0x1A, 0xB0, 0xFE, 0xD3, 0x07, 0xEA, 0xE5};
+static const uint8_t ks_mac[BAC_KEY_LEN] = {0xF1, 0xCB, 0x1F, 0x1F, 0xB5, 0xAD, 0xF2, 0x08,
+                                            0x80, 0x6B, 0x89, 0xDC, 0x57, 0x9D, 0xC1, 0xF8};
+static const uint8_t ssc[BAC_SSC_LEN] = {0x88, 0x70, 0x22, 0x12, 0x0C, 0x06, 0xC2, 0x26};
+
+static struct sm_ctx sm;
+
+/* Wrap cmd, compare with protected, then unwrap resp into plain */
+static void check_apdu(const uint8_t *cmd, uint16_t cmd_len, const uint8_t *protected,
+                       uint16_t protected_len, const uint8_t *resp, uint16_t resp_len,
+                       const uint8_t *plain, uint16_t plain_len)
+{
+        uint8_t buf[APDU_MAX_LEN];
+        uint16_t len = cmd_len;
+        uint16_t sw;
+
+        memcpy(buf, cmd, cmd_len);
+        zassert_ok(sm_wrap(&sm, buf, &len, sizeof(buf)));
+        zassert_equal(len, protected_len);
+        zassert_mem_equal(buf, protected, protected_len);
+
+        memcpy(buf, resp, resp_len);
+        len = resp_len;
+        zassert_ok(sm_unwrap(&sm, buf, &len, &sw));
+        zassert_equal(sw, 0x9000);
+        zassert_equal(len, plain_len);
+        if (plain_len)
+        {
+                zassert_mem_equal(buf, plain, plain_len);
+        }
+}
+
+ZTEST(sm, test_bac_derive_keys)
+{
+        struct bac_keys keys;
+
+        zassert_ok(bac_derive_keys(doc_number, strlen(doc_number), dob, expiry, &keys));
+        zassert_mem_equal(keys.mrz_hash, k_seed, sizeof(k_seed), "K_seed is the hash prefix");
+        zassert_mem_equal(keys.k_enc, k_enc, sizeof(k_enc));
+        zassert_mem_equal(keys.k_mac, k_mac, sizeof(k_mac));
+}
+
+/* D.4: SELECT EF.COM, then READ BINARY of its 4 byte header and the rest */
+ZTEST(sm, test_wrap_unwrap)
+{
+        static const uint8_t select[] = {0x00, 0xA4, 0x02, 0x0C, 0x02, 0x01, 0x1E};
+        static const uint8_t select_sm[] = {0x0C, 0xA4, 0x02, 0x0C, 0x15, 0x87, 0x09, 0x01,
+                                            0x63, 0x75, 0x43, 0x29, 0x08, 0xC0, 0x44, 0xF6,
+                                            0x8E, 0x08, 0xBF, 0x8B, 0x92, 0xD6, 0x35, 0xFF,
+                                            0x24, 0xF8, 0x00};
+        static const uint8_t select_resp[] = {0x99, 0x02, 0x90, 0x00, 0x8E, 0x08, 0xFA, 0x85,
+                                              0x5A, 0x5D, 0x4C, 0x50, 0xA8, 0xED, 0x90, 0x00};
+
+        static const uint8_t read_hdr[] = {0x00, 0xB0, 0x00, 0x00, 0x04};
+        static const uint8_t read_hdr_sm[] = {0x0C, 0xB0, 0x00, 0x00, 0x0D, 0x97, 0x01,
+                                              0x04, 0x8E, 0x08, 0xED, 0x67, 0x05, 0x41,
+                                              0x7E, 0x96, 0xBA, 0x55, 0x00};
+        static const uint8_t read_hdr_resp[] = {
+            0x87, 0x09, 0x01, 0x9F, 0xF0, 0xEC, 0x34, 0xF9, 0x92, 0x26, 0x51, 0x99, 0x02, 0x90,
+            0x00, 0x8E, 0x08, 0xAD, 0x55, 0xCC, 0x17, 0x14, 0x0B, 0x2D, 0xED, 0x90, 0x00};
+        static const uint8_t com_hdr[] = {0x60, 0x14, 0x5F, 0x01};
+
+        static const uint8_t read_rest[] = {0x00, 0xB0, 0x00, 0x04, 0x12};
+        static const uint8_t read_rest_sm[] = {0x0C, 0xB0, 0x00, 0x04, 0x0D, 0x97, 0x01,
+                                               0x12, 0x8E, 0x08, 0x2E, 0xA2, 0x8A, 0x70,
+                                               0xF3, 0xC7, 0xB5, 0x35, 0x00};
+        static const uint8_t read_rest_resp[] = {
+            0x87, 0x19, 0x01, 0xFB, 0x92, 0x35, 0xF4, 0xE4, 0x03, 0x7F, 0x23, 0x27, 0xDC,
+            0xC8, 0x96, 0x4F, 0x1F, 0x9B, 0x8C, 0x30, 0xF4, 0x2C, 0x8E, 0x2F, 0xFF, 0x22,
+            0x4A, 0x99, 0x02, 0x90, 0x00, 0x8E, 0x08, 0xC8, 0xB2, 0x78, 0x7E, 0xAE, 0xA0,
+            0x7D, 0x74, 0x90, 0x00};
+        static const uint8_t com_rest[] = {0x04, 0x30, 0x31, 0x30, 0x36, 0x5F, 0x36,
+                                           0x06, 0x30, 0x34, 0x30, 0x30, 0x30, 0x30,
+                                           0x5C, 0x02, 0x61, 0x75};
+
+        check_apdu(select, sizeof(select), select_sm, sizeof(select_sm), select_resp,
+                   sizeof(select_resp), NULL, 0);
+        check_apdu(read_hdr, sizeof(read_hdr), read_hdr_sm, sizeof(read_hdr_sm), read_hdr_resp,
+                   sizeof(read_hdr_resp), com_hdr, sizeof(com_hdr));
+        check_apdu(read_rest, sizeof(read_rest), read_rest_sm, sizeof(read_rest_sm),
+                   read_rest_resp, sizeof(read_rest_resp), com_rest, sizeof(com_rest));
+}
+
+ZTEST(sm, test_unwrap_bad_mac)
+{
+        // D.4 SELECT and its response, the protected status changed
+        static const uint8_t select[] = {0x00, 0xA4, 0x02, 0x0C, 0x02, 0x01, 0x1E};
+        static const uint8_t resp[] = {0x99, 0x02, 0x90, 0x00, 0x8E, 0x08, 0xFA, 0x85,
+                                       0x5A, 0x5D, 0x4C, 0x50, 0xA8, 0xED, 0x90, 0x00};
+        uint8_t buf[APDU_MAX_LEN];
+        uint16_t len = sizeof(select);
+        uint16_t sw;
+
+        memcpy(buf, select, sizeof(select));
+        zassert_ok(sm_wrap(&sm, buf, &len, sizeof(buf)));
+
+        memcpy(buf, resp, sizeof(resp));
+        buf[3] ^= 0x01; // Status 9001 under the MAC of 9000
+        len = sizeof(resp);
+        zassert_equal(sm_unwrap(&sm, buf, &len, &sw), -EBADMSG);
+}
+
+/* Logs per-APDU wrap/unwrap time for 3DES and AES-128 */
+ZTEST(sm, test_benchmark)
+{
+        sm_benchmark();
+}
+
+static void sm_before(void *fixture)
+{
+        zassert_ok(sm_init_3des(&sm, ks_enc, ks_mac, ssc));
+}
+
+static void sm_after(void *fixture)
+{
+        sm_free(&sm);
+}
+
+ZTEST_SUITE(sm, NULL, NULL, sm_before, sm_after, NULL);
@@ -0,0 +1,58 @@
+/**
+ * @file mrtd_stub.c
+ * @brief The few mrtd/pn532 symbols bac.c and sm.c link against
+ *
+ * The tests never reach the card, so the transceive paths only fail.
+ */
+
+#include "mrtd.h"
+#include "pn532.h"
+
+static uint8_t exchange_buf[PN532_EXCHANGE_MAX];
+
+uint8_t *pn532_exchange_buffer(void)
+{
+        return exchange_buf;
+}
+
+int mrtd_transceive(struct mrtd_session *session, uint16_t apdu_len, const uint8_t **data,
+                    uint16_t *data_len, uint16_t *sw)
+{
+        return -ENOTSUP;
+}
+
+int mrtd_sw_error(uint16_t sw)
+{
+        return sw == 0x9000 ? 0 : -EIO;
+}
+
+/* As in mrtd.c: digits, then letters from 10, '<' counts as zero */
+char mrtd_check_digit(const char *field, size_t len)
+{
+        static const uint8_t weights[] = {7, 3, 1};
+        int sum = 0;
+
+        for (size_t i = 0; i < len; i++)
+        {
+                char c = field[i];
+                int v = 0;
+
+                if (c >= '0' && c <= '9')
+                {
+                        v = c - '0';
+                }
+                else if (c >= 'A' && c <= 'Z')
+                {
+                        v = c - 'A' + 10;
+                }
+                sum += v * weights[i % 3];
+        }
+
+        return '0' + (sum % 10);
+}
+
+/* Benchmark READ BINARY size: the usual SM chunk, its response fits a short APDU */
+uint16_t mrtd_max_le(uint8_t block_size)
+{
+        return block_size ? 0xDF : 0x100;
+}